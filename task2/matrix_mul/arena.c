@@ -0,0 +1,108 @@
+#include "arena.h"
+
+/**
+ * Rounds bytes up to a multiple of ARENA_ALIGNMENT
+*/
+inline size_t ARENA_round(size_t bytes){
+    return (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+/**
+ * Creates an arena that can hand out `size` bytes
+ * NOTE: Remember that every allocation is rounded up to ARENA_ALIGNMENT (size the arena with ARENA_round)
+ * RAISES: Exits if could not allocate memory
+*/
+struct Arena* ARENA_create(size_t size){
+    struct Arena* arena = malloc(sizeof(struct Arena));
+    if (arena == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for Arena\n");
+        exit(1);
+    }
+    arena->size = ARENA_round(size);
+    arena->used = 0;
+    arena->base = NULL;
+
+#ifdef __linux__
+    if (arena->size >= ARENA_HUGE_PAGE_SIZE){
+        // Explicit huge pages only work if the admin reserved some, so this fails more often than not
+        size_t huge_size = (arena->size + ARENA_HUGE_PAGE_SIZE - 1) / ARENA_HUGE_PAGE_SIZE * ARENA_HUGE_PAGE_SIZE;
+        void* block = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (block != MAP_FAILED){
+            arena->base = block;
+            arena->size = huge_size;
+            arena->backing = ARENA_HUGETLB;
+            return arena;
+        }
+
+        block = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block != MAP_FAILED){
+            madvise(block, arena->size, MADV_HUGEPAGE); // Just a hint, it is fine if THP is disabled
+            arena->base = block;
+            arena->backing = ARENA_MMAP;
+            return arena;
+        }
+    }
+#endif
+
+    arena->base = aligned_alloc(ARENA_ALIGNMENT, arena->size);
+    if (arena->base == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for Arena\n");
+        exit(1);
+    }
+    arena->backing = ARENA_HEAP;
+    return arena;
+}
+
+/**
+ * Hands out `bytes` bytes from the arena (aligned to ARENA_ALIGNMENT)
+ * NOTE: Memory is only given back when the whole arena is freed
+ * RAISES: Exits if the arena does not have enough space left
+*/
+void* ARENA_alloc(struct Arena* arena, size_t bytes){
+    bytes = ARENA_round(bytes);
+    if (arena->size - arena->used < bytes){
+        fprintf(stderr, "ERROR! Arena ran out of space (%zu of %zu bytes used, %zu requested)\n", arena->used, arena->size, bytes);
+        exit(1);
+    }
+    void* ptr = arena->base + arena->used;
+    arena->used += bytes;
+    return ptr;
+}
+
+/**
+ * Remembers how much of the arena is in use (so that everything allocated after this can be given back with ARENA_rewind)
+*/
+size_t ARENA_mark(struct Arena* arena){
+    return arena->used;
+}
+
+/**
+ * Gives back everything allocated since ARENA_mark returned mark (lets an arena be used as a stack of scratch space)
+ * NOTE: Anything allocated after the mark must not be used anymore
+*/
+void ARENA_rewind(struct Arena* arena, size_t mark){
+    arena->used = mark;
+}
+
+/**
+ * Frees the arena and everything allocated from it
+*/
+void ARENA_free(struct Arena* arena){
+    switch (arena->backing){
+    case ARENA_HEAP:
+        free(arena->base);
+        break;
+
+#ifdef __linux__
+    case ARENA_MMAP:
+    case ARENA_HUGETLB:
+        munmap(arena->base, arena->size);
+        break;
+#endif
+
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected arena backing %d\n", arena->backing);
+        exit(1);
+    }
+    free(arena);
+}
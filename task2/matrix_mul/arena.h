@@ -0,0 +1,46 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides a simple bump allocator over one big 64 byte aligned block
+ * Used so a whole batch of matrices (structs + data) is a single allocation instead of 2 mallocs per matrix
+ * 
+ * On linux big arenas are mmapped and we try to get huge pages for them (explicit MAP_HUGETLB first, then transparent huge pages)
+ * 
+*/ 
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Every allocation from an arena is aligned to this (a cache line, and enough for any SIMD load we do)
+#define ARENA_ALIGNMENT 64
+// Arenas at least this big are mmapped (so that they can be backed by huge pages)
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+enum ARENA_Backing{
+    ARENA_HEAP, // aligned_alloc
+    ARENA_MMAP, // mmap (with transparent huge pages requested)
+    ARENA_HUGETLB, // mmap with MAP_HUGETLB
+};
+
+struct Arena{
+    char* base; // Start of the block
+    size_t size; // Size of the block in bytes
+    size_t used; // Number of bytes handed out so far
+    enum ARENA_Backing backing; // Where the block came from (so that we know how to free it)
+};
+
+size_t ARENA_round(size_t bytes);
+struct Arena* ARENA_create(size_t size);
+void* ARENA_alloc(struct Arena* arena, size_t bytes);
+size_t ARENA_mark(struct Arena* arena);
+void ARENA_rewind(struct Arena* arena, size_t mark);
+void ARENA_free(struct Arena* arena);
+
+#include "arena.c"
@@ -0,0 +1,245 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Benchmarks every micro kernel and worker pool configuration in process (instead of graphit.py launching a process per run
+ * and parsing its millisecond "Time elapsed")
+ *
+ * For every instruction set the cpu has a micro kernel for (see KERNEL_init_max), every configuration in BENCH_CONFIGS and
+ * every order in BENCH_TESTS: runs a few untimed warmup trials, then the timed trials (each trial being `operations`
+ * multiplications, timed with time_ns) and writes the statistics of the time per multiplication
+ *
+ * Inputs:
+ *  --dtype={int32|int64|float|double} (optional, defaults to int64)
+ *  --max_order=N (optional, skips the BENCH_TESTS with a bigger order, defaults to BENCH_MAX_ORDER)
+ *  --warmup=N (optional, untimed trials before every test, defaults to BENCH_WARMUP)
+ *  --threads={N|auto} (optional, defaults to auto), --pin={none|cores|threads} (optional, defaults to none), same as parallel.c
+ *
+ * Outputs:
+ *  stdout:
+ *      One line per test
+ *  bench_{configuration}_{isa}_{dtype}.json:
+ *      {order: {"iterc", "ops", "avg", "median", "p99", "min", "gflops"}} (the same schema graphit.py plots)
+ *      avg is the mean of the trials left after trimming BENCH_CUTOFF_P off both ends, all times are in ms per multiplication
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix.h"
+#include "options.h"
+#include "common.h"
+#include "worker_pool.h"
+#include "kernel.h"
+#include "tasks.h"
+
+// Orders bigger than this are skipped unless --max_order says otherwise (the last few of BENCH_TESTS take a good while)
+#define BENCH_MAX_ORDER 1000
+// Untimed trials run before the timed ones of every test (warms up the caches, the packing buffers and the pool)
+#define BENCH_WARMUP 2
+// Fraction of the trials dropped off each end before averaging (same as graphit.py's CUTOFF_P)
+#define BENCH_CUTOFF_P 0.1
+// Seed the operands are generated from (the values don't matter, they just have to be the same for every configuration)
+#define BENCH_SEED 0xBE7C4ULL
+
+struct BENCH_Test{
+    long long int order; // Order of the (square) matrices multiplied
+    long long int operations; // Multiplications per trial
+    int trials; // Timed trials
+};
+
+// The sizes graphit.py used to time (order, multiplications per trial, trials)
+static const struct BENCH_Test BENCH_TESTS[] = {
+    {10, 1000, 100}, {15, 1000, 100}, {20, 1000, 100}, {25, 1000, 100}, {30, 1000, 100},
+    {50, 1000, 100}, {60, 1000, 100}, {70, 1000, 100}, {80, 1000, 100}, {90, 1000, 100},
+    {100, 100, 100}, {125, 80, 100}, {150, 50, 100}, {175, 10, 100}, {200, 5, 10},
+    {300, 5, 10}, {400, 5, 10}, {500, 5, 10}, {600, 5, 10}, {750, 5, 5},
+    {900, 5, 5}, {1000, 5, 5}, {1500, 2, 5}, {2000, 1, 5}, {2500, 1, 5},
+};
+
+struct BENCH_Config{
+    const char* name; // Used in the output file name
+    bool pooled; // Whether the multiplications go through a worker pool (like parallel.c) or run on this thread (like sequential.c)
+    enum WP_Mode mode; // The pool's scheduler (if pooled)
+};
+
+static const struct BENCH_Config BENCH_CONFIGS[] = {
+    {"sequential", false, WP_SHARED_QUEUE},
+    {"shared", true, WP_SHARED_QUEUE},
+    {"stealing", true, WP_WORK_STEALING},
+};
+
+struct BENCH_Stats{
+    double avg; // Trimmed mean
+    double median;
+    double p99;
+    double min;
+    double gflops; // Going by avg (2 * order^3 flops per multiplication)
+};
+
+#pragma region Business Logix
+void bench_config(const struct BENCH_Config* config, struct Options* options, long long int max_order, int warmup);
+long long int run_trial(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options);
+void compute_stats(long long int* times, int trials, const struct BENCH_Test* test, struct BENCH_Stats* stats);
+int compare_times(const void* a, const void* b);
+#pragma endregion
+
+int main(int argc, char* argv[]){
+    struct Options options = {0}; // Only what create_worker_pool and request_multiplications look at is set
+    options.dtype = MATRIX_INT64;
+    options.scheduler = WP_SHARED_QUEUE;
+    options.threads = 0;
+    options.pin = TOPO_PIN_NONE;
+    resolve_granularity(&options);
+
+    long long int max_order = BENCH_MAX_ORDER;
+    int warmup = BENCH_WARMUP;
+    for (int i = 1; i < argc; ++i){
+        bool valid = false;
+        if (strncmp(argv[i], "--dtype=", 8) == 0) valid = MATRIX_dtype_parse(argv[i] + 8, &options.dtype);
+        else if (strncmp(argv[i], "--max_order=", 12) == 0) valid = (max_order = atoll(argv[i] + 12)) > 0;
+        else if (strncmp(argv[i], "--warmup=", 9) == 0) valid = (warmup = atoi(argv[i] + 9)) >= 0;
+        else if (strcmp(argv[i], "--threads=auto") == 0) valid = true;
+        else if (strncmp(argv[i], "--threads=", 10) == 0) valid = (options.threads = atoi(argv[i] + 10)) > 0;
+        else if (strncmp(argv[i], "--pin=", 6) == 0) valid = TOPO_policy_parse(argv[i] + 6, &options.pin);
+        if (!valid){
+            fprintf(stderr, "ERROR! Invalid arguments to `%s`. Expected usage: `%s [--dtype={int32|int64|float|double}] [--max_order=N] [--warmup=N] [--threads={N|auto}] [--pin={none|cores|threads}]`\n", argv[0], argv[0]);
+            exit(1);
+        }
+    }
+
+    const char* previous_isa = NULL;
+    for (int isa = 0; isa < KERNEL_ISA_COUNT; ++isa){
+        KERNEL_init_max(isa);
+        if (previous_isa != NULL && strcmp(KERNEL_isa[options.dtype], previous_isa) == 0) continue; // The cpu (or dtype) has no kernel for this one
+        previous_isa = KERNEL_isa[options.dtype];
+
+        for (size_t i = 0; i < sizeof(BENCH_CONFIGS) / sizeof(BENCH_CONFIGS[0]); ++i){
+            bench_config(&BENCH_CONFIGS[i], &options, max_order, warmup);
+        }
+    }
+}
+
+#pragma region Business Logix Impl
+/**
+ * Runs every test (up to max_order) with the micro kernels currently installed and one configuration, and writes the json
+ * RAISES: Exits if the json could not be written or if could not allocate memory
+*/
+void bench_config(const struct BENCH_Config* config, struct Options* options, long long int max_order, int warmup){
+    const char* isa = KERNEL_isa[options->dtype];
+    const char* dtype = MATRIX_dtype_name(options->dtype);
+
+    char path[256];
+    snprintf(path, sizeof(path), "bench_%s_%s_%s.json", config->name, isa, dtype);
+    FILE* json = fopen(path, "w");
+    if (json == NULL){
+        fprintf(stderr, "ERROR! Could not create `%s`\n", path);
+        exit(1);
+    }
+
+    struct WorkerPool* worker_pool = NULL;
+    if (config->pooled){
+        options->scheduler = config->mode;
+        worker_pool = create_worker_pool(options);
+    }
+
+    fprintf(json, "{");
+    bool first = true;
+    for (size_t t = 0; t < sizeof(BENCH_TESTS) / sizeof(BENCH_TESTS[0]); ++t){
+        const struct BENCH_Test* test = &BENCH_TESTS[t];
+        if (test->order > max_order) continue;
+
+        struct Matrix** operand_as = create_matrix_array(test->operations, test->order, test->order, options->dtype);
+        struct Matrix** operand_bs = create_matrix_array(test->operations, test->order, test->order, options->dtype);
+        struct Matrix** products   = create_matrix_array(test->operations, test->order, test->order, options->dtype);
+        if (worker_pool != NULL){
+            request_init_operand(operand_as, test->operations, RNG_stream(BENCH_SEED, OPERAND_A_STREAM), 1, worker_pool);
+            request_init_operand(operand_bs, test->operations, RNG_stream(BENCH_SEED, OPERAND_B_STREAM), 1, worker_pool);
+            WP_wait_idle(worker_pool);
+        } else{
+            init_operand(operand_as, test->operations, RNG_stream(BENCH_SEED, OPERAND_A_STREAM), 1);
+            init_operand(operand_bs, test->operations, RNG_stream(BENCH_SEED, OPERAND_B_STREAM), 1);
+        }
+
+        long long int* times = malloc(test->trials * sizeof(long long int));
+        if (times == NULL){
+            fprintf(stderr, "ERROR! Could not allocate memory for the trial times\n");
+            exit(1);
+        }
+        for (int trial = 0; trial < warmup; ++trial){
+            run_trial(operand_as, operand_bs, products, test->operations, worker_pool, options);
+        }
+        for (int trial = 0; trial < test->trials; ++trial){
+            times[trial] = run_trial(operand_as, operand_bs, products, test->operations, worker_pool, options);
+        }
+
+        struct BENCH_Stats stats;
+        compute_stats(times, test->trials, test, &stats);
+        fprintf(json, "%s\n    \"%lld\": {\"iterc\": %d, \"ops\": %lld, \"avg\": %.9g, \"median\": %.9g, \"p99\": %.9g, \"min\": %.9g, \"gflops\": %.6g}",
+            first? "" : ",", test->order, test->trials, test->operations, stats.avg, stats.median, stats.p99, stats.min, stats.gflops);
+        first = false;
+        printf("%-10s %-7s %-6s N=%-5lld avg %.6fms median %.6fms p99 %.6fms %.3f GFLOP/s\n", config->name, isa, dtype, test->order, stats.avg, stats.median, stats.p99, stats.gflops);
+        fflush(stdout);
+
+        free(times);
+        free_matrix_array(operand_as, test->operations);
+        free_matrix_array(operand_bs, test->operations);
+        free_matrix_array(products  , test->operations);
+    }
+    fprintf(json, "\n}\n");
+    fclose(json);
+
+    if (worker_pool != NULL){
+        WP_request_stop(worker_pool);
+        WP_join(worker_pool);
+        WP_free(worker_pool);
+    }
+}
+
+/**
+ * Does `count` multiplications (on the pool if there is one, on this thread otherwise) and returns how long that took in ns
+*/
+long long int run_trial(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options){
+    long long int start = time_ns();
+    if (worker_pool != NULL){
+        request_multiplications(operand_as, operand_bs, products, count, worker_pool, options);
+        WP_wait_idle(worker_pool);
+    } else{
+        for (long long int i = 0; i < count; ++i){ // Same as sequential.c's multiply
+            struct Arena* scratch = STRASSEN_thread_scratch(STRASSEN_scratch_bytes(operand_as[i]->rows, operand_as[i]->cols, operand_bs[i]->cols, products[i]->dtype, options->strassen_cutoff));
+            STRASSEN_multiply(operand_as[i], operand_bs[i], products[i], options->strassen_cutoff, scratch);
+        }
+    }
+    return time_ns() - start;
+}
+
+/**
+ * Summarizes the trial times (in ns per trial) into ms per multiplication
+ * NOTE: Sorts times
+*/
+void compute_stats(long long int* times, int trials, const struct BENCH_Test* test, struct BENCH_Stats* stats){
+    qsort(times, trials, sizeof(long long int), compare_times);
+    double scale = 1e-6 / test->operations; // ns per trial -> ms per multiplication
+
+    int cutoff = (int)(trials * BENCH_CUTOFF_P);
+    double sum = 0;
+    for (int i = cutoff; i < trials - cutoff; ++i) sum += times[i];
+    stats->avg = sum / (trials - 2 * cutoff) * scale;
+
+    stats->median = ((trials % 2)? times[trials / 2] : (times[trials / 2 - 1] + times[trials / 2]) / 2.0) * scale;
+    int p99 = (99 * trials + 99) / 100 - 1; // Nearest rank
+    stats->p99 = times[p99] * scale;
+    stats->min = times[0] * scale;
+    stats->gflops = 2.0 * test->order * test->order * test->order / (stats->avg * 1e6);
+}
+
+/**
+ * qsort comparator for trial times
+*/
+int compare_times(const void* a, const void* b){
+    long long int x = *(const long long int*)a, y = *(const long long int*)b;
+    return (x > y) - (x < y);
+}
+#pragma endregion
@@ -0,0 +1,120 @@
+#include "binlog.h"
+
+/**
+ * Rounds bytes up to a multiple of BINLOG_ALIGNMENT
+*/
+inline size_t BINLOG_round(size_t bytes){
+    return (bytes + BINLOG_ALIGNMENT - 1) / BINLOG_ALIGNMENT * BINLOG_ALIGNMENT;
+}
+
+/**
+ * Gets the start of a matrix record (which is 0 for operand a, 1 for operand b and 2 for the product)
+*/
+inline char* _BINLOG_record(struct BinLog* log, long long int operation, int which){
+    return log->base + BINLOG_round(sizeof(struct BINLOG_FileHeader)) + (operation * BINLOG_MATRICES_PER_OPERATION + which) * log->record_size;
+}
+
+/**
+ * Creates a log with room for `operations` operations, where every matrix is rows x cols of dtype (as create_matrix_array makes them)
+ * The headers are filled in right away, the data is filled in by BINLOG_write
+ * RAISES: Exits if the file could not be created or if could not allocate memory
+*/
+struct BinLog* BINLOG_create(const char* path, long long int operations, long long int rows, long long int cols, enum MATRIX_DType dtype){
+    struct BinLog* log = malloc(sizeof(struct BinLog));
+    if (log == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for BinLog\n");
+        exit(1);
+    }
+    log->operations = operations;
+    log->record_size = BINLOG_round(sizeof(struct BINLOG_MatrixHeader)) + BINLOG_round(rows * cols * MATRIX_dtype_size(dtype));
+    log->size = BINLOG_round(sizeof(struct BINLOG_FileHeader)) + operations * BINLOG_MATRICES_PER_OPERATION * log->record_size;
+    log->base = NULL;
+    log->file = NULL;
+
+#ifdef __linux__
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0){
+        fprintf(stderr, "ERROR! Could not create product log `%s`\n", path);
+        exit(1);
+    }
+    if (ftruncate(fd, log->size) == 0){
+        void* base = mmap(NULL, log->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) log->base = base;
+    }
+    close(fd); // NOTE: The mapping keeps the file alive
+#endif
+
+    if (log->base == NULL){ // No mmap, build it in memory and write it out at the end
+        log->file = fopen(path, "wb");
+        log->base = calloc(log->size, 1);
+        if (log->file == NULL || log->base == NULL){
+            fprintf(stderr, "ERROR! Could not create product log `%s`\n", path);
+            exit(1);
+        }
+    }
+
+    struct BINLOG_FileHeader file_header = {
+        .version = BINLOG_VERSION,
+        .operations = operations,
+        .matrices_per_operation = BINLOG_MATRICES_PER_OPERATION,
+    };
+    memcpy(file_header.magic, BINLOG_MAGIC, sizeof(file_header.magic));
+    memcpy(log->base, &file_header, sizeof(file_header));
+
+    struct BINLOG_MatrixHeader matrix_header = {
+        .rows = rows,
+        .cols = cols,
+        .dtype = dtype,
+        .element_size = MATRIX_dtype_size(dtype),
+    };
+    for (long long int operation = 0; operation < operations; ++operation){
+        for (int which = 0; which < BINLOG_MATRICES_PER_OPERATION; ++which){
+            memcpy(_BINLOG_record(log, operation, which), &matrix_header, sizeof(matrix_header));
+        }
+    }
+    return log;
+}
+
+/**
+ * Copies elements [start, end) of a matrix into its record (which is 0 for operand a, 1 for operand b and 2 for the product)
+ * NOTE: Different threads may write different parts of the log at the same time
+*/
+void BINLOG_write(struct BinLog* log, long long int operation, int which, struct Matrix* matrix, long long int start, long long int end){
+    size_t element_size = MATRIX_dtype_size(matrix->dtype);
+    char* data = _BINLOG_record(log, operation, which) + BINLOG_round(sizeof(struct BINLOG_MatrixHeader));
+    memcpy(data + start * element_size, (char*)matrix->data + start * element_size, (end - start) * element_size);
+}
+
+/**
+ * Copies elements [start, end) of a whole matrix array into the log (numbered as if the matrices were laid out back to back, like fill_operands)
+*/
+void BINLOG_write_array(struct BinLog* log, int which, struct Matrix** matrices, long long int start, long long int end){
+    long long int elements = matrices[0]->rows * matrices[0]->cols;
+    while (start < end){
+        long long int first = start % elements;
+        long long int last = (end - (start - first) < elements)? end - (start - first) : elements;
+        BINLOG_write(log, start / elements, which, matrices[start / elements], first, last);
+        start += last - first;
+    }
+}
+
+/**
+ * Finishes the log (unmaps it, or writes it out) and frees it
+ * RAISES: Exits if the log could not be written
+*/
+void BINLOG_close(struct BinLog* log){
+    if (log->file != NULL){
+        if (fwrite(log->base, 1, log->size, log->file) != log->size){
+            fprintf(stderr, "ERROR! Could not write product log\n");
+            exit(1);
+        }
+        fclose(log->file);
+        free(log->base);
+    }
+#ifdef __linux__
+    else{
+        munmap(log->base, log->size);
+    }
+#endif
+    free(log);
+}
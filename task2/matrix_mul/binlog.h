@@ -0,0 +1,71 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides a compact binary product log (instead of printing every element as text)
+ * 
+ * File layout (every integer is little endian, as written by the machine):
+ *  BINLOG_FileHeader
+ *  For every operation, 3 records (operand a, operand b, product), each of which is
+ *      BINLOG_MatrixHeader, padded to BINLOG_ALIGNMENT bytes
+ *      rows * cols elements of raw (row major) data, padded to BINLOG_ALIGNMENT bytes
+ * 
+ * Since every record's offset is known up front the whole file is mmapped and any thread can copy any part of any
+ * matrix straight into it (no formatting, no locks), the kernel writes the pages back in the background
+ * Anywhere without mmap the file is built in memory and written out in one go by BINLOG_close
+ * 
+ * logread.c reads these back (checks them with Freivalds or dumps them as text for check_answers.py)
+ * 
+*/ 
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "matrix.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define BINLOG_MAGIC "MATMULOG"
+#define BINLOG_VERSION 1
+// Records (and the data in them) start at multiples of this, so that a mapped matrix is as aligned as an arena one
+#define BINLOG_ALIGNMENT 64
+// Matrices logged per operation (operand a, operand b, product)
+#define BINLOG_MATRICES_PER_OPERATION 3
+
+struct BINLOG_FileHeader{
+    char magic[8]; // BINLOG_MAGIC (no null terminator)
+    int64_t version; // BINLOG_VERSION
+    int64_t operations; // Number of operations logged
+    int64_t matrices_per_operation; // BINLOG_MATRICES_PER_OPERATION
+};
+
+struct BINLOG_MatrixHeader{
+    int64_t rows; // The number of rows in the matrix
+    int64_t cols; // The number of columns in the matrix
+    int32_t dtype; // enum MATRIX_DType
+    int32_t element_size; // Size of an element in bytes (so that readers can skip dtypes they don't know)
+};
+
+struct BinLog{
+    char* base; // The whole file (mapped, or in memory if we couldn't map it)
+    size_t size; // Size of the file in bytes
+    size_t record_size; // Bytes per matrix record (header + data, both padded)
+    long long int operations; // Number of operations the file has room for
+    FILE* file; // Only used when the file isn't mapped (written out by BINLOG_close)
+};
+
+size_t BINLOG_round(size_t bytes);
+struct BinLog* BINLOG_create(const char* path, long long int operations, long long int rows, long long int cols, enum MATRIX_DType dtype);
+void BINLOG_write(struct BinLog* log, long long int operation, int which, struct Matrix* matrix, long long int start, long long int end);
+void BINLOG_write_array(struct BinLog* log, int which, struct Matrix** matrices, long long int start, long long int end);
+void BINLOG_close(struct BinLog* log);
+char* _BINLOG_record(struct BinLog* log, long long int operation, int which);
+
+#include "binlog.c"
@@ -0,0 +1,328 @@
+#include "chain.h"
+
+/**
+ * Parses the dimensions of a chain (`d0,d1,...,dn` means n matrices, the i'th one being d(i-1) x d(i))
+ * Returns the (malloced) dimensions and sets count to the number of matrices, NULL if the text isn't a valid chain
+ * RAISES: Exits if could not allocate memory
+*/
+long long int* CHAIN_parse_dims(const char* text, long long int* count){
+    long long int dim_count = 1;
+    for (const char* c = text; *c != '\0'; ++c) dim_count += (*c == ',');
+    if (dim_count < 2) return NULL;
+
+    long long int* dims = malloc(dim_count * sizeof(long long int));
+    if (dims == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the chain\n");
+        exit(1);
+    }
+    for (long long int i = 0; i < dim_count; ++i){
+        char* end;
+        dims[i] = strtoll(text, &end, 10);
+        if (end == text || dims[i] <= 0 || (*end != ',' && *end != '\0')){
+            free(dims);
+            return NULL;
+        }
+        text = end + 1;
+    }
+    *count = dim_count - 1;
+    return dims;
+}
+
+/**
+ * Finds the parenthesization of a chain of count matrices (dims as in CHAIN_parse_dims) that takes the fewest multiply-adds
+ * split[i * count + j] is set to the k that the sub chain i..j (inclusive) is split at (into i..k and k+1..j)
+ * Returns the multiply-adds the whole chain takes
+ * NOTE: O(count^3), the usual dynamic program (cost[i][j] = min over k of cost[i][k] + cost[k+1][j] + d(i) d(k+1) d(j+1))
+ * RAISES: Exits if could not allocate memory
+*/
+long long int CHAIN_order(const long long int* dims, long long int count, long long int* split){
+    long long int* cost = malloc(count * count * sizeof(long long int));
+    if (cost == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the chain\n");
+        exit(1);
+    }
+    for (long long int i = 0; i < count; ++i) cost[i * count + i] = 0;
+
+    for (long long int length = 2; length <= count; ++length){
+        for (long long int i = 0; i + length - 1 < count; ++i){
+            long long int j = i + length - 1;
+            cost[i * count + j] = -1;
+            for (long long int k = i; k < j; ++k){
+                long long int candidate = cost[i * count + k] + cost[(k + 1) * count + j] + dims[i] * dims[k + 1] * dims[j + 1];
+                if (cost[i * count + j] < 0 || candidate < cost[i * count + j]){
+                    cost[i * count + j] = candidate;
+                    split[i * count + j] = k;
+                }
+            }
+        }
+    }
+
+    long long int total = cost[count - 1];
+    free(cost);
+    return total;
+}
+
+/**
+ * Gets the multiply-adds a chain takes when multiplied left to right ((A1 * A2) * A3 ...), for comparison
+*/
+long long int CHAIN_left_to_right_cost(const long long int* dims, long long int count){
+    long long int total = 0;
+    for (long long int i = 1; i < count; ++i) total += dims[0] * dims[i] * dims[i + 1];
+    return total;
+}
+
+/**
+ * Initializes an empty graph
+*/
+void CHAIN_init(struct CHAIN_Graph* graph){
+    graph->nodes = NULL;
+    graph->count = 0;
+    graph->capacity = 0;
+    graph->root = -1;
+    graph->cost = 0;
+}
+
+/**
+ * Frees the nodes of a graph (not the matrices, those belong to whoever gave them or to the CHAIN_Buffers)
+*/
+void CHAIN_free(struct CHAIN_Graph* graph){
+    free(graph->nodes);
+    CHAIN_init(graph);
+}
+
+/**
+ * Adds a node to the graph, returns its index
+ * RAISES: Exits if could not allocate memory
+*/
+long long int _CHAIN_add(struct CHAIN_Graph* graph, struct CHAIN_Node node){
+    if (graph->count == graph->capacity){
+        graph->capacity = (graph->capacity > 0)? 2 * graph->capacity : 16;
+        graph->nodes = realloc(graph->nodes, graph->capacity * sizeof(struct CHAIN_Node));
+        if (graph->nodes == NULL){
+            fprintf(stderr, "ERROR! Could not allocate memory for the chain\n");
+            exit(1);
+        }
+    }
+    graph->nodes[graph->count] = node;
+    graph->root = graph->count; // The last node added is the result unless something else uses it
+    return graph->count++;
+}
+
+/**
+ * Adds one of the given operands to the graph, returns its node
+*/
+long long int CHAIN_add_leaf(struct CHAIN_Graph* graph, struct Matrix* matrix){
+    struct CHAIN_Node node = {.left = -1, .right = -1, .rows = matrix->rows, .cols = matrix->cols, .uses = 0, .done = true, .matrix = matrix};
+    return _CHAIN_add(graph, node);
+}
+
+/**
+ * Adds the product of two nodes to the graph, returns its node
+ * RAISES: Exits if the nodes can't be multiplied
+*/
+long long int CHAIN_add_product(struct CHAIN_Graph* graph, long long int left, long long int right){
+    if (graph->nodes[left].cols != graph->nodes[right].rows){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    struct CHAIN_Node node = {
+        .left = left,
+        .right = right,
+        .rows = graph->nodes[left].rows,
+        .cols = graph->nodes[right].cols,
+        .uses = 0,
+        .done = false,
+        .matrix = NULL,
+    };
+    ++graph->nodes[left].uses;
+    ++graph->nodes[right].uses;
+    graph->cost += graph->nodes[left].rows * graph->nodes[left].cols * graph->nodes[right].cols;
+    return _CHAIN_add(graph, node);
+}
+
+/**
+ * Adds the products of the sub chain first..last (split as CHAIN_order says), returns the node of its product
+*/
+long long int _CHAIN_build_range(struct CHAIN_Graph* graph, long long int* leaves, const long long int* split, long long int count, long long int first, long long int last){
+    if (first == last) return leaves[first];
+    long long int k = split[first * count + last];
+    long long int left = _CHAIN_build_range(graph, leaves, split, count, first, k);
+    long long int right = _CHAIN_build_range(graph, leaves, split, count, k + 1, last);
+    return CHAIN_add_product(graph, left, right);
+}
+
+/**
+ * Builds the graph of operands[0] * operands[1] * ... * operands[count - 1], parenthesized by CHAIN_order
+ * RAISES: Exits if the operands can't be multiplied or if could not allocate memory
+*/
+void CHAIN_build_chain(struct CHAIN_Graph* graph, struct Matrix** operands, long long int count){
+    long long int* dims = malloc((count + 1) * sizeof(long long int));
+    long long int* split = malloc(count * count * sizeof(long long int));
+    long long int* leaves = malloc(count * sizeof(long long int));
+    if (dims == NULL || split == NULL || leaves == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the chain\n");
+        exit(1);
+    }
+    dims[0] = operands[0]->rows;
+    for (long long int i = 0; i < count; ++i){
+        dims[i + 1] = operands[i]->cols;
+        leaves[i] = CHAIN_add_leaf(graph, operands[i]);
+    }
+
+    CHAIN_order(dims, count, split);
+    graph->root = _CHAIN_build_range(graph, leaves, split, count, 0, count - 1);
+
+    free(dims);
+    free(split);
+    free(leaves);
+}
+
+/**
+ * Builds the graph of operand^power by repeated squaring
+ * The squares and the running product don't depend on each other, so they end up in the same waves (see CHAIN_evaluate)
+ * RAISES: Exits if the operand isn't square, if power < 1 or if could not allocate memory
+*/
+void CHAIN_build_power(struct CHAIN_Graph* graph, struct Matrix* operand, long long int power){
+    if (operand->rows != operand->cols || power < 1){
+        fprintf(stderr, "ERROR! Can only raise a square matrix to a power >= 1\n");
+        exit(1);
+    }
+    long long int square = CHAIN_add_leaf(graph, operand); // operand^(2^bit)
+    long long int result = -1;
+    for (long long int bit = 0; (power >> bit) != 0; ++bit){
+        if ((power >> bit) & 1) result = (result < 0)? square : CHAIN_add_product(graph, result, square);
+        if ((power >> (bit + 1)) != 0) square = CHAIN_add_product(graph, square, square);
+    }
+    graph->root = result;
+}
+
+/**
+ * Lets go of a node's matrix once nothing reads it any more (intermediates go back to the buffers, operands stay)
+*/
+void _CHAIN_release(struct CHAIN_Graph* graph, struct CHAIN_Buffers* buffers, long long int index){
+    struct CHAIN_Node* node = &graph->nodes[index];
+    if (--node->uses > 0 || node->left < 0 || index == graph->root) return;
+    CHAIN_buffers_release(buffers, node->matrix);
+    node->matrix = NULL;
+}
+
+/**
+ * Computes every product in the graph on the worker pool, returns the matrix of the root
+ * Runs in waves: every product whose inputs are done is requested at once (request_multiplications_to, all counted in one
+ * latch), and once the wave is done every input that nothing else needs goes back into buffers
+ * With options->verify every product gets that many rounds of Freivalds' check right after its wave
+ * NOTE: The result belongs to buffers (or is one of the operands, for a graph without products), so it lives till
+ *       CHAIN_buffers_free. The operands must live till this returns
+ * RAISES: Exits if any product fails verification or if could not allocate memory
+*/
+struct Matrix* CHAIN_evaluate(struct CHAIN_Graph* graph, struct CHAIN_Buffers* buffers, struct WorkerPool* worker_pool, struct Options* options){
+    long long int* wave = malloc(graph->count * sizeof(long long int));
+    if (wave == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the chain\n");
+        exit(1);
+    }
+    struct WP_Latch latch;
+    WP_latch_init(&latch);
+
+    while (!graph->nodes[graph->root].done){
+        long long int wave_size = 0;
+        for (long long int i = 0; i < graph->count; ++i){
+            struct CHAIN_Node* node = &graph->nodes[i];
+            if (node->done || node->matrix != NULL || !graph->nodes[node->left].done || !graph->nodes[node->right].done) continue;
+
+            node->matrix = CHAIN_buffers_acquire(buffers, node->rows, node->cols, graph->nodes[node->left].matrix->dtype);
+            request_multiplications_to(&graph->nodes[node->left].matrix, &graph->nodes[node->right].matrix, &node->matrix, 1, worker_pool, options, &latch);
+            wave[wave_size++] = i;
+        }
+        WP_latch_wait(&latch);
+
+        for (long long int w = 0; w < wave_size; ++w){
+            struct CHAIN_Node* node = &graph->nodes[wave[w]];
+            for (long long int round = 0; round < options->verify; ++round){
+                if (!VERIFY_product(graph->nodes[node->left].matrix, graph->nodes[node->right].matrix, node->matrix, verify_seed(options->seed, round, wave[w]))){
+                    fprintf(stderr, "ERROR! Product of chain node %lld failed verification\n", wave[w]);
+                    exit(1);
+                }
+            }
+            node->done = true;
+        }
+        for (long long int w = 0; w < wave_size; ++w){
+            struct CHAIN_Node* node = &graph->nodes[wave[w]];
+            _CHAIN_release(graph, buffers, node->left);
+            _CHAIN_release(graph, buffers, node->right);
+        }
+    }
+
+    WP_latch_destroy(&latch);
+    free(wave);
+    return graph->nodes[graph->root].matrix;
+}
+
+/**
+ * Initializes an empty pool of buffers
+*/
+void CHAIN_buffers_init(struct CHAIN_Buffers* buffers){
+    buffers->matrices = NULL;
+    buffers->capacities = NULL;
+    buffers->used = NULL;
+    buffers->count = 0;
+    buffers->capacity = 0;
+}
+
+/**
+ * Hands out a rows x cols matrix: the smallest free buffer that is big enough (reshaped), or a new one if none is
+ * RAISES: Exits if could not allocate memory
+*/
+struct Matrix* CHAIN_buffers_acquire(struct CHAIN_Buffers* buffers, long long int rows, long long int cols, enum MATRIX_DType dtype){
+    long long int best = -1;
+    for (long long int i = 0; i < buffers->count; ++i){
+        if (buffers->used[i] || buffers->matrices[i]->dtype != dtype || buffers->capacities[i] < rows * cols) continue;
+        if (best < 0 || buffers->capacities[i] < buffers->capacities[best]) best = i;
+    }
+    if (best >= 0){
+        buffers->used[best] = true;
+        buffers->matrices[best]->rows = rows;
+        buffers->matrices[best]->cols = cols;
+        return buffers->matrices[best];
+    }
+
+    if (buffers->count == buffers->capacity){
+        buffers->capacity = (buffers->capacity > 0)? 2 * buffers->capacity : 8;
+        buffers->matrices = realloc(buffers->matrices, buffers->capacity * sizeof(struct Matrix*));
+        buffers->capacities = realloc(buffers->capacities, buffers->capacity * sizeof(long long int));
+        buffers->used = realloc(buffers->used, buffers->capacity * sizeof(bool));
+        if (buffers->matrices == NULL || buffers->capacities == NULL || buffers->used == NULL){
+            fprintf(stderr, "ERROR! Could not allocate memory for the chain buffers\n");
+            exit(1);
+        }
+    }
+    buffers->matrices[buffers->count] = MATRIX_create(rows, cols, dtype);
+    buffers->capacities[buffers->count] = rows * cols;
+    buffers->used[buffers->count] = true;
+    return buffers->matrices[buffers->count++];
+}
+
+/**
+ * Gives a matrix (from CHAIN_buffers_acquire) back to the pool
+ * RAISES: Exits if the matrix didn't come from this pool
+*/
+void CHAIN_buffers_release(struct CHAIN_Buffers* buffers, struct Matrix* matrix){
+    for (long long int i = 0; i < buffers->count; ++i){
+        if (buffers->matrices[i] != matrix) continue;
+        buffers->used[i] = false;
+        return;
+    }
+    fprintf(stderr, "UNREACHABLE! Released a matrix that is not a chain buffer\n");
+    exit(1);
+}
+
+/**
+ * Frees every buffer (handed out or not) and the pool itself
+*/
+void CHAIN_buffers_free(struct CHAIN_Buffers* buffers){
+    for (long long int i = 0; i < buffers->count; ++i) MATRIX_free(buffers->matrices[i]);
+    free(buffers->matrices);
+    free(buffers->capacities);
+    free(buffers->used);
+    CHAIN_buffers_init(buffers);
+}
@@ -0,0 +1,72 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Provides chain products (A1 * A2 * ... * An of rectangular matrices) and matrix powers (A^k) on the worker pool
+ *
+ * Both get turned into a graph of products (CHAIN_Graph) first:
+ *  - Chains are parenthesized by the classic dynamic program (the split of every sub chain that needs the fewest multiply-adds,
+ *    which can be orders of magnitude fewer than going left to right)
+ *  - Powers use repeated squaring (A, A^2, A^4, ... and the ones matching the set bits of k multiplied together)
+ * and CHAIN_evaluate then runs the graph in waves: every product whose inputs are ready gets handed to the pool at once (so
+ * independent sub products run concurrently), and intermediates go back into a CHAIN_Buffers pool as soon as the last product
+ * reading them is done (so later products of a similar size reuse them instead of allocating)
+ *
+*/
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "options.h"
+#include "common.h"
+#include "worker_pool.h"
+#include "verify.h"
+#include "tasks.h"
+
+struct CHAIN_Node{
+    long long int left; // The node holding the premultiplicand (-1 for a leaf, which is one of the given operands)
+    long long int right; // The node holding the postmultiplicand (-1 for a leaf)
+    long long int rows; // The number of rows of the node's matrix
+    long long int cols; // The number of columns of the node's matrix
+    long long int uses; // Products (not yet done) that read this node's matrix (a node read twice, like in a square, counts twice)
+    bool done; // Set once the matrix is there (right away for leaves)
+    struct Matrix* matrix; // The operand (leaves) or the product (once computing it has started)
+};
+
+struct CHAIN_Graph{
+    struct CHAIN_Node* nodes; // Every node, children always come before their parents
+    long long int count; // Nodes in use
+    long long int capacity; // Nodes allocated
+    long long int root; // The node whose matrix is the result
+    long long int cost; // Multiply-adds of every product in the graph
+};
+
+struct CHAIN_Buffers{
+    struct Matrix** matrices; // Every matrix handed out so far
+    long long int* capacities; // How many elements each one can hold (its rows/cols get changed to whatever it is reused as)
+    bool* used; // Whether each one is currently handed out
+    long long int count; // Matrices in the pool
+    long long int capacity; // Slots allocated
+};
+
+long long int* CHAIN_parse_dims(const char* text, long long int* count);
+long long int CHAIN_order(const long long int* dims, long long int count, long long int* split);
+long long int CHAIN_left_to_right_cost(const long long int* dims, long long int count);
+void CHAIN_init(struct CHAIN_Graph* graph);
+void CHAIN_free(struct CHAIN_Graph* graph);
+long long int CHAIN_add_leaf(struct CHAIN_Graph* graph, struct Matrix* matrix);
+long long int CHAIN_add_product(struct CHAIN_Graph* graph, long long int left, long long int right);
+void CHAIN_build_chain(struct CHAIN_Graph* graph, struct Matrix** operands, long long int count);
+void CHAIN_build_power(struct CHAIN_Graph* graph, struct Matrix* operand, long long int power);
+struct Matrix* CHAIN_evaluate(struct CHAIN_Graph* graph, struct CHAIN_Buffers* buffers, struct WorkerPool* worker_pool, struct Options* options);
+void CHAIN_buffers_init(struct CHAIN_Buffers* buffers);
+struct Matrix* CHAIN_buffers_acquire(struct CHAIN_Buffers* buffers, long long int rows, long long int cols, enum MATRIX_DType dtype);
+void CHAIN_buffers_release(struct CHAIN_Buffers* buffers, struct Matrix* matrix);
+void CHAIN_buffers_free(struct CHAIN_Buffers* buffers);
+long long int _CHAIN_add(struct CHAIN_Graph* graph, struct CHAIN_Node node);
+long long int _CHAIN_build_range(struct CHAIN_Graph* graph, long long int* leaves, const long long int* split, long long int count, long long int first, long long int last);
+void _CHAIN_release(struct CHAIN_Graph* graph, struct CHAIN_Buffers* buffers, long long int index);
+
+#include "chain.c"
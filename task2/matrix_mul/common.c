@@ -12,39 +12,154 @@ long long time_ms(void) {
 }
 
 /**
- * Generates a smallish random number lamo
+ * Gets current time in us (for timing things that are too quick for time_ms)
 */
-int random_number(){
-    return (rand()%11) - 5;
+long long time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
 }
 
 /**
- * Sets random values for the operand matrix array
+ * Gets current time in ns (monotonic, so unlike time_ms it never jumps when the wall clock is adjusted)
+ * NOTE: Only meaningful as a difference of two readings
 */
-void init_operand(struct Matrix** operand_array, long long int size){
-    for (long long int i = 0; i < size; ++i){
-        for (long long int idx = 0; idx < operand_array[i]->cols * operand_array[i]->rows; ++idx){
-            operand_array[i]->data[idx] = random_number();
+long long time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((long long)ts.tv_sec)*1000000000)+ts.tv_nsec;
+}
+
+/**
+ * Generates a smallish random number lamo (the counter-th one of the stream seed)
+*/
+int random_number(uint64_t seed, uint64_t counter){
+    return (int)(RNG_at(seed, counter) % 11) - 5;
+}
+
+/**
+ * Sets random values for elements [start, end) of the operand matrix array
+ * The elements of the array are numbered as if the matrices were laid out back to back (so element e is element
+ * e % (rows * cols) of matrix e / (rows * cols)) and element e gets random_number(seed, offset + e)
+ * NOTE: Since every element only depends on its own number, the array can be split up among threads any which way
+ * NOTE: offset is the number of the array's first element among all the operands (so a streamed chunk gets the same values
+ *       it would have gotten as part of one big array), 0 for a whole array
+ * With density < 1 every element is then zeroed unless RNG_at(RNG_stream(seed, DENSITY_STREAM), offset + e) falls in the
+ * first density of the range (so about that fraction of the elements are kept, again only depending on the element's number)
+ * NOTE: Every matrix in the array is expected to have the same shape (as create_matrix_array makes them)
+*/
+void fill_operands(struct Matrix** operand_array, long long int offset, long long int start, long long int end, uint64_t seed, double density){
+    long long int elements = operand_array[0]->rows * operand_array[0]->cols;
+    uint64_t mask_seed = RNG_stream(seed, DENSITY_STREAM);
+    uint64_t threshold = (density < 1)? (uint64_t)(density * 18446744073709551616.0) : UINT64_MAX; // density * 2^64
+    while (start < end){
+        struct Matrix* matrix = operand_array[start / elements];
+        long long int first = start % elements;
+        long long int last = (end - (start - first) < elements)? end - (start - first) : elements;
+
+        switch (matrix->dtype){
+#define _COMMON_FILL_CASE(tag, type, suffix, fmt, name) \
+        case tag: \
+            for (long long int idx = first; idx < last; ++idx) ((type*)matrix->data)[idx] = (type)random_number(seed, offset + start - first + idx); \
+            if (density < 1) for (long long int idx = first; idx < last; ++idx){ \
+                if (RNG_at(mask_seed, offset + start - first + idx) >= threshold) ((type*)matrix->data)[idx] = 0; \
+            } \
+            break;
+            MATRIX_DTYPES(_COMMON_FILL_CASE)
+        default: break;
         }
+        start += last - first;
     }
 }
 
+/**
+ * Sets random values for the operand matrix array (reproducible from seed, with about density of them nonzero, see fill_operands)
+*/
+void init_operand(struct Matrix** operand_array, long long int size, uint64_t seed, double density){
+    fill_operands(operand_array, 0, 0, size * operand_array[0]->rows * operand_array[0]->cols, seed, density);
+}
+
+
+/**
+ * Gets the seed of the random vector used to verify a product in a given round (see verify.h)
+*/
+uint64_t verify_seed(uint64_t seed, long long int round, long long int product){
+    return RNG_stream(RNG_stream(RNG_stream(seed, VERIFY_STREAM), round), product);
+}
+
+/**
+ * Gets a checksum of a product that doesn't depend on the order products are checksummed in (so the checksums of every
+ * product can just be added up, wrapping, whichever thread finishes first)
+ * Every element's bits are hashed in order (FNV-1a style, one element at a time) and the hash is then mixed with operation
+*/
+uint64_t checksum_matrix(struct Matrix* matrix, long long int operation){
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    long long int elements = matrix->rows * matrix->cols;
+    switch (matrix->dtype){
+#define _COMMON_CHECKSUM_CASE(tag, type, suffix, fmt, name) \
+    case tag: \
+        for (long long int idx = 0; idx < elements; ++idx){ \
+            uint64_t bits = 0; \
+            memcpy(&bits, (type*)matrix->data + idx, sizeof(type)); \
+            hash = (hash ^ bits) * 0x100000001B3ULL; \
+        } \
+        break;
+        MATRIX_DTYPES(_COMMON_CHECKSUM_CASE)
+    default: break;
+    }
+    return RNG_stream(RNG_mix(hash), operation);
+}
 
 /**
  * Initializes an array of matrices
+ * The array, the Matrix structs and all their data come from a single arena (one aligned allocation for the whole batch)
  * NOTE: This will not set values in the matrices
  * RAISES: Exits if could not allocate memory
 */
-struct Matrix** create_matrix_array(long long int size, long long int rows, long long int cols){
+struct Matrix** create_matrix_array(long long int size, long long int rows, long long int cols, enum MATRIX_DType dtype){
+    struct Arena* arena = ARENA_create(ARENA_round(size * sizeof(struct Matrix*)) + size * MATRIX_bytes(rows, cols, dtype));
+    struct Matrix** array = ARENA_alloc(arena, size * sizeof(struct Matrix*));
+    
+    for (long long int i = 0; i < size; ++i){
+        array[i] = MATRIX_create_in(arena, rows, cols, dtype);
+    }
+    return array;
+}
+
+/**
+ * Initializes an array of matrices that live in files (`directory/name_i.mat` for the i'th, see MATRIX_create_mapped)
+ * instead of in memory, for matrices that don't fit in it (a NULL directory gives a plain create_matrix_array one)
+ * NOTE: This will not set values in the matrices (fresh files are all zeros), the files are left behind by free_matrix_array
+ * RAISES: Exits if a file could not be created or if could not allocate memory
+*/
+struct Matrix** create_mapped_matrix_array(const char* directory, const char* name, long long int size, long long int rows, long long int cols, enum MATRIX_DType dtype){
+    if (directory == NULL) return create_matrix_array(size, rows, cols, dtype);
     struct Matrix** array = malloc(size * sizeof(struct Matrix*));
-    if (array == NULL){
-        fprintf(stderr, "ERROR! Could not allocated memory for the matrices :(\n");
+    char* path = malloc(strlen(directory) + strlen(name) + 32);
+    if (array == NULL || path == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for matrix array\n");
         exit(1);
     }
-    
     for (long long int i = 0; i < size; ++i){
-        array[i] = MATRIX_create(rows, cols);
+        sprintf(path, "%s/%s_%lld.mat", directory, name, i);
+        array[i] = MATRIX_create_mapped(path, rows, cols, dtype);
     }
+    free(path);
+    return array;
+}
+
+/**
+ * Makes an array of size pointers that all point at the same matrix (for when every operation shares an operand)
+ * NOTE: free() the array, not free_matrix_array (the matrix belongs to whoever made it)
+ * RAISES: Exits if could not allocate memory
+*/
+struct Matrix** repeat_matrix(struct Matrix* matrix, long long int size){
+    struct Matrix** array = malloc(size * sizeof(struct Matrix*));
+    if (array == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for matrix array\n");
+        exit(1);
+    }
+    for (long long int i = 0; i < size; ++i) array[i] = matrix;
     return array;
 }
 
@@ -52,8 +167,10 @@ struct Matrix** create_matrix_array(long long int size, long long int rows, long
  * Frees all memory associated with the matrix array
 */
 void free_matrix_array(struct Matrix** array, long long int size){
-    for (long long int i = 0; i < size; ++i){
-        MATRIX_free(array[i]);
+    if (array[0]->mapping != NULL){ // See create_mapped_matrix_array
+        for (long long int i = 0; i < size; ++i) MATRIX_free(array[i]);
+        free(array);
+        return;
     }
-    free(array);
-}
\ No newline at end of file
+    ARENA_free(array[0]->arena); // NOTE: The array itself lives in the arena too
+}
@@ -10,12 +10,31 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+#include <string.h>
 #include "matrix.h"
+#include "rng.h"
+
+// Streams of the user's seed that the operands are generated from (see RNG_stream)
+#define OPERAND_A_STREAM 0
+#define OPERAND_B_STREAM 1
+#define VERIFY_STREAM 2
+#define CHAIN_STREAM 3
+// Stream of an operand array's own seed that picks which of its elements are zeroed (see fill_operands)
+#define DENSITY_STREAM 0
 
 long long int time_ms();
-int random_number();
-struct Matrix** create_matrix_array(long long int size, long long int rows, long long int cols);
+long long int time_us();
+long long int time_ns();
+int random_number(uint64_t seed, uint64_t counter);
+void fill_operands(struct Matrix** operand_array, long long int offset, long long int start, long long int end, uint64_t seed, double density);
+struct Matrix** create_matrix_array(long long int size, long long int rows, long long int cols, enum MATRIX_DType dtype);
+struct Matrix** create_mapped_matrix_array(const char* directory, const char* name, long long int size, long long int rows, long long int cols, enum MATRIX_DType dtype);
+struct Matrix** repeat_matrix(struct Matrix* matrix, long long int size);
 void free_matrix_array(struct Matrix** array, long long int size);
-void init_operand(struct Matrix** operand_array, long long int size);
+void init_operand(struct Matrix** operand_array, long long int size, uint64_t seed, double density);
+uint64_t verify_seed(uint64_t seed, long long int round, long long int product);
+uint64_t checksum_matrix(struct Matrix* matrix, long long int operation);
 
 #include "common.c"
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "deque.h"
+
+/**
+ * Sets up an empty deque of `item_size` byte items
+ * RAISES: Exits if could not allocate memory
+*/
+void DEQUE_init(struct Deque* deque, size_t item_size){
+    deque->item_size = item_size;
+    deque->item_words = (item_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    deque->words = malloc(_DEQUE_CAPACITY * deque->item_words * sizeof(_Atomic(uint64_t)));
+    if (deque->words == NULL){
+        fprintf(stderr, "ERROR! Could not allocate enough memory for Deque\n");
+        exit(1);
+    }
+    deque->mask = _DEQUE_CAPACITY - 1;
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+}
+
+/**
+ * Frees the buffer of the deque
+*/
+void DEQUE_destroy(struct Deque* deque){
+    free(deque->words);
+}
+
+/**
+ * Copies an item into slot idx
+*/
+void _DEQUE_store(struct Deque* deque, long long int idx, const void* item){
+    _Atomic(uint64_t)* slot = deque->words + (idx & deque->mask) * deque->item_words;
+    uint64_t words[deque->item_words];
+    words[deque->item_words - 1] = 0; // Padding bytes of the last word
+    memcpy(words, item, deque->item_size);
+    for (size_t i = 0; i < deque->item_words; ++i) atomic_store_explicit(&slot[i], words[i], memory_order_relaxed);
+}
+
+/**
+ * Copies the item in slot idx out
+*/
+void _DEQUE_load(struct Deque* deque, long long int idx, void* item){
+    _Atomic(uint64_t)* slot = deque->words + (idx & deque->mask) * deque->item_words;
+    uint64_t words[deque->item_words];
+    for (size_t i = 0; i < deque->item_words; ++i) words[i] = atomic_load_explicit(&slot[i], memory_order_relaxed);
+    memcpy(item, words, deque->item_size);
+}
+
+/**
+ * Pushes an item onto the bottom of the deque, returns false if the deque is full
+ * NOTE: Only the owner may call this
+*/
+bool DEQUE_push(struct Deque* deque, const void* item){
+    long long int bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long long int top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top > deque->mask) return false;
+
+    _DEQUE_store(deque, bottom, item);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Pops the most recently pushed item into *item, returns false if the deque is empty
+ * NOTE: Only the owner may call this
+*/
+bool DEQUE_pop(struct Deque* deque, void* item){
+    long long int bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long int top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom){ // Empty, undo the reservation
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+
+    _DEQUE_load(deque, bottom, item);
+    if (top == bottom){ // Last item, race the thieves for it
+        bool won = atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+/**
+ * Tries to steal the oldest item in the deque into *item
+ * NOTE: Any thread may call this
+*/
+enum DEQUE_StealResult DEQUE_steal(struct Deque* deque, void* item){
+    long long int top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long int bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) return DEQUE_EMPTY;
+
+    _DEQUE_load(deque, top, item); // NOTE: Might be garbage if we are racing, but then the CAS below fails
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)){
+        return DEQUE_ABORT;
+    }
+    return DEQUE_STOLEN;
+}
+
+/**
+ * Gets the number of items in the deque
+ * NOTE: This is only a snapshot if other threads are still using the deque
+*/
+long long int DEQUE_size(struct Deque* deque){
+    long long int size = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - atomic_load_explicit(&deque->top, memory_order_relaxed);
+    return (size < 0)? 0 : size;
+}
@@ -0,0 +1,52 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides definitions for a Chase-Lev work stealing deque
+ * The owner thread pushes and pops at the bottom (LIFO, so it keeps working on whatever is hot in its cache),
+ * every other thread can steal from the top (FIFO, so thieves take the oldest and usually biggest chunk of work)
+ * 
+ * Memory orderings follow "Correct and Efficient Work-Stealing for Weak Memory Models" (Le, Pop, Cohen, Zappa Nardelli 2013)
+ * Items are fixed size and copied in and out (as relaxed atomic words, since a thief may read a slot the owner is reusing, it just loses the CAS after)
+ * NOTE: The buffer is fixed size (no resizing), DEQUE_push just says no when it is full
+ * 
+*/ 
+
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The max number of items a single deque can hold (must be a power of 2)
+*/
+#define _DEQUE_CAPACITY (1 << 12)
+
+enum DEQUE_StealResult{
+    DEQUE_STOLEN, // Got an item
+    DEQUE_EMPTY, // There was nothing to steal
+    DEQUE_ABORT, // Lost a race with the owner or another thief (worth trying again)
+};
+
+struct Deque{
+    _Alignas(64) atomic_llong top; // Next index thieves steal from
+    _Alignas(64) atomic_llong bottom; // Next index the owner pushes to
+    _Atomic(uint64_t)* words; // The circular buffer (item_words words per item)
+    size_t item_size; // Size of an item in bytes
+    size_t item_words; // Size of an item in words (rounded up)
+    long long int mask; // capacity - 1
+};
+
+void DEQUE_init(struct Deque* deque, size_t item_size);
+void DEQUE_destroy(struct Deque* deque);
+bool DEQUE_push(struct Deque* deque, const void* item);
+bool DEQUE_pop(struct Deque* deque, void* item);
+enum DEQUE_StealResult DEQUE_steal(struct Deque* deque, void* item);
+long long int DEQUE_size(struct Deque* deque);
+void _DEQUE_store(struct Deque* deque, long long int idx, const void* item);
+void _DEQUE_load(struct Deque* deque, long long int idx, void* item);
+
+#include "deque.c"
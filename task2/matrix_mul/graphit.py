@@ -1,4 +1,3 @@
-import sys
 from pathlib import Path
 import subprocess
 import json
@@ -7,7 +6,8 @@ from scipy.interpolate import interp1d
 import numpy as np
 import matplotlib.pyplot as plt
 
-# parallelX_Y.exe: X -> QUEUE_CHUNK_SIZE, Y -> MAX_LIVE_CHUNKS
+# Results (<executable>.json) of the old timing runs, only plotted if bench hasn't been run (parallelX_Y.exe were builds with
+# the compile time queue sizes, which are runtime options now, see --queue_capacity and --stream)
 
 STORE_DATA = False
 PLOT_DATA = True
@@ -21,88 +21,26 @@ EXECUTABLES = [
     "sequential.exe",
 ]
 
-CUTOFF_P = 0.1
-
-NTEST_LIST = [
-    (10, 1000, 100),
-    (15, 1000, 100),
-    (20, 1000, 100),
-    (25, 1000, 100),
-    (30, 1000, 100),
-    (50, 1000, 100),
-    (60, 1000, 100),
-    (70, 1000, 100),
-    (80, 1000, 100),
-    (90, 1000, 100),
-    (100, 100, 100),
-    (125, 80, 100),
-    (150, 50, 100),
-    (175, 10, 100),
-    (200, 5, 10),
-    (300, 5, 10),
-    (400, 5, 10),
-    (500, 5, 10),
-    (600, 5, 10),
-    (750, 5, 5),
-    (900, 5, 5),
-    (1000, 5, 5),
-    (1500, 2, 5),
-    (2000, 1, 5),
-    (2500, 1, 5),
-]
+# The timing itself is done in process by bench (see bench.c), which writes one json per kernel and pool configuration
+BENCH = "./bench"
+BENCH_ARGS = ["--max_order=2500"]
 
 
-def test(path, N, operations, NUM_ITER):
-    
-    times = []
-    CUTOFF = int(NUM_ITER * CUTOFF_P)
-    for i in range(NUM_ITER):
-        xs = subprocess.run((path, str(N), str(operations)), text=True, capture_output=True, creationflags=subprocess.HIGH_PRIORITY_CLASS)
-        times.append(int(xs.stdout.split(": ")[1].split("ms")[0]))
-
-    decent = sorted(times)[CUTOFF:NUM_ITER-CUTOFF]
-    
-    return {
-        'iterc': NUM_ITER,
-        'ops': operations,
-        'avg': (sum(decent) / (NUM_ITER - 2*CUTOFF)) / operations
-    }
-
-
-
-def main(path):
-    if (not Path(path).is_file()):
-        print("ERROR! Expected valid executable path as argument", file=sys.stderr)
-        return 1
-    
-    results = {}
-    print("TESTING", path, "!")
-
-    for N in NTEST_LIST:
-        results[N[0]] = test(path, *N)
-        print(f"TESTED {N}!", results[N[0]])
-
-    # input("Pres ENTER to dump")
-    with open(path + ".json", 'w') as f:
-        
-        json.dump(results, f)
-    # input("Pres ENTER to finish")
-
-    return 0
-    
 if __name__ == '__main__':
     if STORE_DATA:
-        for path in EXECUTABLES:
-            main(path)
+        subprocess.run([BENCH, *BENCH_ARGS], check=True)
 
     if PLOT_DATA:
+        # Falls back to the old per executable results if bench hasn't been run
+        paths = sorted(str(p) for p in Path(".").glob("bench_*.json")) or [path + ".json" for path in EXECUTABLES]
+
         avgs = {}
-        for path in EXECUTABLES:
-            with open(path + ".json") as f:
+        for path in paths:
+            with open(path) as f:
                 xs = json.load(f)
                 avgs[path] = ([i for i in xs], [xs[i]['avg'] for i in xs])
 
-        for path in EXECUTABLES:
+        for path in paths:
             x = np.array(avgs[path][0])
             n = np.arange(x.shape[0]) 
             y = np.array(avgs[path][1])
@@ -0,0 +1,275 @@
+#include "kernel.h"
+
+// Per thread packing buffers (every worker needs its own, and we don't want to malloc these per tile)
+// NOTE: These are never freed, they live as long as the thread (and get reused by every tile the thread computes)
+static _Thread_local void* _KERNEL_packed_a = NULL;
+static _Thread_local void* _KERNEL_packed_b = NULL;
+
+#pragma region Per dtype kernels
+#define KERNEL_T int
+#define KERNEL_SUFFIX i32
+#define KERNEL_DTYPE MATRIX_INT32
+#include "kernel_impl.c"
+#undef KERNEL_T
+#undef KERNEL_SUFFIX
+#undef KERNEL_DTYPE
+
+#define KERNEL_T long long int
+#define KERNEL_SUFFIX i64
+#define KERNEL_DTYPE MATRIX_INT64
+#include "kernel_impl.c"
+#undef KERNEL_T
+#undef KERNEL_SUFFIX
+#undef KERNEL_DTYPE
+
+#define KERNEL_T float
+#define KERNEL_SUFFIX f32
+#define KERNEL_DTYPE MATRIX_FLOAT
+#include "kernel_impl.c"
+#undef KERNEL_T
+#undef KERNEL_SUFFIX
+#undef KERNEL_DTYPE
+
+#define KERNEL_T double
+#define KERNEL_SUFFIX f64
+#define KERNEL_DTYPE MATRIX_DOUBLE
+#include "kernel_impl.c"
+#undef KERNEL_T
+#undef KERNEL_SUFFIX
+#undef KERNEL_DTYPE
+#pragma endregion
+
+#define _KERNEL_SCALAR_ENTRY(tag, type, suffix, fmt, name) [tag] = _KERNEL_PASTE(_KERNEL_micro_kernel_scalar_, suffix),
+#define _KERNEL_SCALAR_NAME(tag, type, suffix, fmt, name) [tag] = "scalar",
+static const KERNEL_MicroKernel _KERNEL_scalar_micro_kernels[MATRIX_DTYPE_COUNT] = { MATRIX_DTYPES(_KERNEL_SCALAR_ENTRY) };
+KERNEL_MicroKernel KERNEL_micro_kernels[MATRIX_DTYPE_COUNT] = { MATRIX_DTYPES(_KERNEL_SCALAR_ENTRY) };
+const char* KERNEL_isa[MATRIX_DTYPE_COUNT] = { MATRIX_DTYPES(_KERNEL_SCALAR_NAME) };
+
+/**
+ * Picks the best micro kernel (for every dtype) that the cpu we are running on supports
+ * NOTE: Call this once at startup (before any threads are spawned). Without it everything still works, just with the scalar kernels
+*/
+void KERNEL_init(){
+    KERNEL_init_max(KERNEL_ISA_AVX512);
+}
+
+/**
+ * Same as KERNEL_init, but never picks a micro kernel for an instruction set above max_isa (so that the older kernels can be benchmarked)
+ * NOTE: Can be called again later, but only while no multiplication is running (check KERNEL_isa for what actually got picked)
+ * NOTE: The 32 bit types stop at AVX2 since 8 lanes is exactly KERNEL_NR (AVX-512 would need a wider micro tile)
+*/
+void KERNEL_init_max(enum KERNEL_Isa max_isa){
+    for (int dtype = 0; dtype < MATRIX_DTYPE_COUNT; ++dtype){
+        KERNEL_micro_kernels[dtype] = _KERNEL_scalar_micro_kernels[dtype];
+        KERNEL_isa[dtype] = "scalar";
+    }
+
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+    bool sse42 = max_isa >= KERNEL_ISA_SSE42 && __builtin_cpu_supports("sse4.2");
+    bool avx2 = max_isa >= KERNEL_ISA_AVX2 && __builtin_cpu_supports("avx2");
+    bool avx2_fma = avx2 && __builtin_cpu_supports("fma");
+    bool avx512 = max_isa >= KERNEL_ISA_AVX512 && __builtin_cpu_supports("avx512f");
+    bool avx512_dq = avx512 && __builtin_cpu_supports("avx512dq");
+
+    if (avx512_dq){ KERNEL_micro_kernels[MATRIX_INT64] = _KERNEL_micro_kernel_avx512_i64; KERNEL_isa[MATRIX_INT64] = "avx512"; }
+    else if (avx2){ KERNEL_micro_kernels[MATRIX_INT64] = _KERNEL_micro_kernel_avx2_i64; KERNEL_isa[MATRIX_INT64] = "avx2"; }
+    else if (sse42){ KERNEL_micro_kernels[MATRIX_INT64] = _KERNEL_micro_kernel_sse42_i64; KERNEL_isa[MATRIX_INT64] = "sse4.2"; }
+
+    if (avx2){ KERNEL_micro_kernels[MATRIX_INT32] = _KERNEL_micro_kernel_avx2_i32; KERNEL_isa[MATRIX_INT32] = "avx2"; }
+    else if (sse42){ KERNEL_micro_kernels[MATRIX_INT32] = _KERNEL_micro_kernel_sse42_i32; KERNEL_isa[MATRIX_INT32] = "sse4.2"; }
+
+    if (avx2_fma){ KERNEL_micro_kernels[MATRIX_FLOAT] = _KERNEL_micro_kernel_avx2_f32; KERNEL_isa[MATRIX_FLOAT] = "avx2"; }
+    else if (sse42){ KERNEL_micro_kernels[MATRIX_FLOAT] = _KERNEL_micro_kernel_sse42_f32; KERNEL_isa[MATRIX_FLOAT] = "sse4.2"; }
+
+    if (avx512){ KERNEL_micro_kernels[MATRIX_DOUBLE] = _KERNEL_micro_kernel_avx512_f64; KERNEL_isa[MATRIX_DOUBLE] = "avx512"; }
+    else if (avx2_fma){ KERNEL_micro_kernels[MATRIX_DOUBLE] = _KERNEL_micro_kernel_avx2_f64; KERNEL_isa[MATRIX_DOUBLE] = "avx2"; }
+    else if (sse42){ KERNEL_micro_kernels[MATRIX_DOUBLE] = _KERNEL_micro_kernel_sse42_f64; KERNEL_isa[MATRIX_DOUBLE] = "sse4.2"; }
+#endif
+}
+
+/**
+ * Lazily allocates a 64 byte aligned scratch buffer of `bytes` bytes for the calling thread
+ * NOTE: bytes must be a multiple of 64 (aligned_alloc wants the size to be a multiple of the alignment)
+ * RAISES: Exits if could not allocate memory
+*/
+void* _KERNEL_scratch(void** buffer, size_t bytes){
+    if (*buffer == NULL){
+        *buffer = aligned_alloc(64, bytes);
+        if (*buffer == NULL){
+            fprintf(stderr, "ERROR! Could not allocate memory for packing buffers :(\n");
+            exit(1);
+        }
+    }
+    return *buffer;
+}
+
+/**
+ * Checks that product = operand_a * operand_b makes sense (dimensions line up and all have the same dtype)
+*/
+bool KERNEL_can_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product){
+    return operand_a->cols == operand_b->rows && operand_a->rows == product->rows && operand_b->cols == product->cols
+        && operand_a->dtype == product->dtype && operand_b->dtype == product->dtype;
+}
+
+/**
+ * Multiplies 2 matrices and stores the result in product matrix
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void KERNEL_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product){
+    if (!KERNEL_can_multiply(operand_a, operand_b, product)){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    KERNEL_multiply_tile(operand_a, operand_b, product, 0, product->rows, 0, product->cols);
+}
+
+/**
+ * Computes product[row_start:row_end, col_start:col_end] = operand_a[row_start:row_end, :] * operand_b[:, col_start:col_end]
+ * NOTE: Does not check dimensions (The caller is expected to have done that)
+ * NOTE: This is thread safe as long as different threads write to disjoint tiles :)
+*/
+void KERNEL_multiply_tile(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end){
+    struct MATRIX_View a = MATRIX_view(operand_a), b = MATRIX_view(operand_b), c = MATRIX_view(product);
+    KERNEL_gemm_tile(1, &a, &b, 0, &c, row_start, row_end, col_start, col_end);
+}
+
+/**
+ * Checks that product = alpha * operand_a * operand_b + beta * product makes sense (dimensions line up and all have the same dtype)
+*/
+bool KERNEL_can_gemm(const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, const struct MATRIX_View* product){
+    return operand_a->cols == operand_b->rows && operand_a->rows == product->rows && operand_b->cols == product->cols
+        && operand_a->dtype == product->dtype && operand_b->dtype == product->dtype;
+}
+
+/**
+ * Computes product = alpha * operand_a * operand_b + beta * product, on views (so any of them can be a block, a transpose or
+ * live inside someone else's buffer, see MATRIX_View) without copying anything but the usual packed panels
+ * If beta is 0 the product is never read (so it may start out as garbage)
+ * NOTE: alpha and beta are converted to the dtype of the views (so integer dtypes only take whole numbers)
+ * NOTE: The product must not overlap either operand
+ * RAISES: Exits if the views provided are not of correct dimensions
+*/
+void KERNEL_gemm(double alpha, const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, double beta, const struct MATRIX_View* product){
+    if (!KERNEL_can_gemm(operand_a, operand_b, product)){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    if (product->transposed){ // (A * B)^T = B^T * A^T, so write the transposed product row wise instead
+        struct MATRIX_View a = MATRIX_view_transpose(*operand_b), b = MATRIX_view_transpose(*operand_a), c = MATRIX_view_transpose(*product);
+        KERNEL_gemm_tile(alpha, &a, &b, beta, &c, 0, c.rows, 0, c.cols);
+        return;
+    }
+    KERNEL_gemm_tile(alpha, operand_a, operand_b, beta, product, 0, product->rows, 0, product->cols);
+}
+
+/**
+ * Same as KERNEL_gemm, but only for product[row_start:row_end, col_start:col_end] (which only needs the matching rows of
+ * operand_a and columns of operand_b)
+ * NOTE: Does not check dimensions (The caller is expected to have done that), and the product must not be transposed
+ * NOTE: This is thread safe as long as different threads write to disjoint tiles :)
+*/
+void KERNEL_gemm_tile(double alpha, const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, double beta, const struct MATRIX_View* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end){
+    switch (product->dtype){
+#define _KERNEL_TILE_CASE(tag, type, suffix, fmt, name) \
+    case tag: _KERNEL_PASTE(_KERNEL_gemm_tile_, suffix)((type)alpha, operand_a, NULL, operand_b, (type)beta, product, row_start, row_end, col_start, col_end); break;
+        MATRIX_DTYPES(_KERNEL_TILE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", product->dtype);
+        exit(1);
+    }
+}
+
+/**
+ * Packs all of operand_a into the panels the blocked kernel multiplies from (KERNEL_MC x KERNEL_KC each, in the micro kernel's
+ * sliver layout), so that any number of products with it as the premultiplicand can skip packing A (see KERNEL_gemm_packed_tile)
+ * NOTE: The view (not the data) is copied, so operand_a's data must outlive the packed copy (thin products still read it directly)
+ * RAISES: Exits if could not allocate memory
+*/
+struct KERNEL_PackedA* KERNEL_pack_a(const struct MATRIX_View* operand_a){
+    struct KERNEL_PackedA* packed = malloc(sizeof(struct KERNEL_PackedA));
+    if (packed == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for packing buffers :(\n");
+        exit(1);
+    }
+    packed->source = *operand_a;
+    packed->row_blocks = (operand_a->rows + KERNEL_MC - 1) / KERNEL_MC;
+    long long int depth_blocks = (operand_a->cols + KERNEL_KC - 1) / KERNEL_KC;
+    packed->data = aligned_alloc(64, packed->row_blocks * depth_blocks * KERNEL_MC * KERNEL_KC * MATRIX_dtype_size(operand_a->dtype));
+    if (packed->data == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for packing buffers :(\n");
+        exit(1);
+    }
+
+    switch (operand_a->dtype){
+#define _KERNEL_PACK_CASE(tag, type, suffix, fmt, name) \
+    case tag: _KERNEL_PASTE(_KERNEL_pack_a_whole_, suffix)(packed); break;
+        MATRIX_DTYPES(_KERNEL_PACK_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", operand_a->dtype);
+        exit(1);
+    }
+    return packed;
+}
+
+/**
+ * Frees what KERNEL_pack_a allocated
+*/
+void KERNEL_free_packed_a(struct KERNEL_PackedA* packed){
+    free(packed->data);
+    free(packed);
+}
+
+/**
+ * Gets where (in elements, from packed->data) the panel holding rows [row, row + KERNEL_MC) and depth [k, k + KERNEL_KC) starts
+ * NOTE: row and k must be multiples of KERNEL_MC and KERNEL_KC
+*/
+long long int KERNEL_packed_panel(const struct KERNEL_PackedA* packed, long long int row, long long int k){
+    return ((k / KERNEL_KC) * packed->row_blocks + row / KERNEL_MC) * KERNEL_MC * KERNEL_KC;
+}
+
+/**
+ * Same as KERNEL_gemm_tile, but with the premultiplicand already packed (see KERNEL_pack_a)
+ * NOTE: row_start has to be a multiple of KERNEL_MC (so that tiles line up with the packed panels)
+ * NOTE: Does not check dimensions (The caller is expected to have done that), and the product must not be transposed
+ * RAISES: Exits if row_start does not line up with the panels
+*/
+void KERNEL_gemm_packed_tile(double alpha, const struct KERNEL_PackedA* operand_a, const struct MATRIX_View* operand_b, double beta, const struct MATRIX_View* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end){
+    if (row_start % KERNEL_MC != 0){
+        fprintf(stderr, "ERROR! Tiles of a packed operand have to start at a multiple of KERNEL_MC rows (not %lld)\n", row_start);
+        exit(1);
+    }
+    switch (product->dtype){
+#define _KERNEL_PACKED_TILE_CASE(tag, type, suffix, fmt, name) \
+    case tag: _KERNEL_PASTE(_KERNEL_gemm_tile_, suffix)((type)alpha, &operand_a->source, operand_a, operand_b, (type)beta, product, row_start, row_end, col_start, col_end); break;
+        MATRIX_DTYPES(_KERNEL_PACKED_TILE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", product->dtype);
+        exit(1);
+    }
+}
+
+/**
+ * Multiplies a batch of small matrices back to back (products[i] = operand_as[i] * operand_bs[i])
+ * Meant for matrices up to KERNEL_BATCH_MAX_ORDER, where a product is too small to be worth tiling
+ * NOTE: Every matrix in the batch must have the same shape and dtype
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void KERNEL_multiply_batch(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count){
+    for (long long int i = 0; i < count; ++i){
+        if (!KERNEL_can_multiply(operand_as[i], operand_bs[i], products[i]) || operand_as[i]->rows != operand_as[0]->rows
+            || operand_as[i]->cols != operand_as[0]->cols || operand_bs[i]->cols != operand_bs[0]->cols || products[i]->dtype != products[0]->dtype){
+            fprintf(stderr, "ERROR! Invalid matrix dimension for batched multiplication\n");
+            exit(1);
+        }
+    }
+
+    switch (products[0]->dtype){
+#define _KERNEL_BATCH_CASE(tag, type, suffix, fmt, name) \
+    case tag: _KERNEL_PASTE(_KERNEL_multiply_batch_, suffix)(operand_as, operand_bs, products, count); break;
+        MATRIX_DTYPES(_KERNEL_BATCH_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", products[0]->dtype);
+        exit(1);
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides a cache blocked (tiled) matrix multiplication kernel
+ * Used by both sequential.c and parallel.c so that they do the same arithmetic (just split differently)
+ * 
+ * The loops are arranged the usual GotoBLAS way:
+ *  - B is packed in KC x NC panels (should sit in L3/L2)
+ *  - A is packed in MC x KC panels (should sit in L2)
+ *  - A micro kernel computes a MR x NR block of the product entirely in registers
+ * 
+ * The micro kernel is picked at runtime (KERNEL_init) based on what the cpu supports (scalar / SSE4.2 / AVX2 / AVX-512)
+ * since the machine we build on is not necessarily the one we run on
+ * 
+ * Every element type in MATRIX_DTYPES gets its own copy of the kernel (kernel_impl.c is included once per type)
+ * 
+ * Everything underneath works on views (see MATRIX_View), KERNEL_gemm is the general entry point (C = alpha A B + beta C on
+ * blocks / transposes / foreign buffers), the Matrix functions are just the alpha = 1, beta = 0 case on whole matrices
+ * 
+*/ 
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// Rows (of A) and columns (of B) handled by a single call to the micro kernel
+#define KERNEL_MR 4
+#define KERNEL_NR 8
+
+// Rows of A that are packed at once (MC * KC elements should fit in L2)
+#define KERNEL_MC 64
+// Depth of each packed panel (KC * NR elements of B should fit in L1)
+#define KERNEL_KC 256
+// Columns of B that are packed at once (KC * NC elements should fit in the last level cache)
+#define KERNEL_NC 1024
+
+// Tiles with fewer rows than this are not worth packing B for (the packed panel would barely get reused)
+#define KERNEL_PACK_MIN_ROWS (2 * KERNEL_MR)
+
+// Products up to this order are small enough that whole multiplications should be scheduled as a unit (see KERNEL_multiply_batch)
+#define KERNEL_BATCH_MAX_ORDER 100
+// Batched products up to this order skip packing altogether (measured crossover with the packed path on AVX-512 int64)
+#define KERNEL_BATCH_SMALL_ORDER 12
+
+// Largest element size of any dtype (the packing buffers are sized for this so that every dtype can share them)
+#define KERNEL_MAX_ELEMENT_SIZE 8
+
+#define _KERNEL_PASTE2(a, b) a##b
+#define _KERNEL_PASTE(a, b) _KERNEL_PASTE2(a, b)
+
+/**
+ * Instruction sets there are micro kernels for (in order, each one is assumed to be better than the ones before it)
+*/
+enum KERNEL_Isa{
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_SSE42,
+    KERNEL_ISA_AVX2,
+    KERNEL_ISA_AVX512,
+    KERNEL_ISA_COUNT
+};
+
+/**
+ * A premultiplicand packed once up front (see KERNEL_pack_a), for when one A gets multiplied by a whole bunch of Bs
+*/
+struct KERNEL_PackedA{
+    struct MATRIX_View source; // What got packed (its data must outlive the packed copy)
+    long long int row_blocks; // Panels down the rows (rows / KERNEL_MC rounded up)
+    void* data; // Every KERNEL_MC x KERNEL_KC panel (padded to full size), see KERNEL_packed_panel for where each one is
+};
+
+/**
+ * Computes a full KERNEL_MR x KERNEL_NR block from packed slivers (`depth` steps) and stores it row major in `acc`
+ * NOTE: The pointers actually point to elements of whatever dtype the kernel was written for
+*/
+typedef void (*KERNEL_MicroKernel)(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+
+extern KERNEL_MicroKernel KERNEL_micro_kernels[MATRIX_DTYPE_COUNT]; // The micro kernel in use for each dtype (set by KERNEL_init)
+extern const char* KERNEL_isa[MATRIX_DTYPE_COUNT]; // Name of the instruction set the micro kernel in use (for each dtype) was written for
+
+void KERNEL_init();
+void KERNEL_init_max(enum KERNEL_Isa max_isa);
+bool KERNEL_can_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product);
+void KERNEL_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product);
+void KERNEL_multiply_tile(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end);
+bool KERNEL_can_gemm(const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, const struct MATRIX_View* product);
+void KERNEL_gemm(double alpha, const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, double beta, const struct MATRIX_View* product);
+void KERNEL_gemm_tile(double alpha, const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, double beta, const struct MATRIX_View* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end);
+struct KERNEL_PackedA* KERNEL_pack_a(const struct MATRIX_View* operand_a);
+void KERNEL_free_packed_a(struct KERNEL_PackedA* packed);
+long long int KERNEL_packed_panel(const struct KERNEL_PackedA* packed, long long int row, long long int k);
+void KERNEL_gemm_packed_tile(double alpha, const struct KERNEL_PackedA* operand_a, const struct MATRIX_View* operand_b, double beta, const struct MATRIX_View* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end);
+void KERNEL_multiply_batch(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count);
+void* _KERNEL_scratch(void** buffer, size_t bytes);
+
+#include "kernel_simd.h"
+#include "kernel.c"
@@ -0,0 +1,216 @@
+/**
+ * The per element type half of the blocked kernel (see kernel.h)
+ * NOTE: This file is basically a template, kernel.c includes it once per dtype with the following defined:
+ *  KERNEL_T: The element type
+ *  KERNEL_SUFFIX: Appended to every function name (i32, i64, ...)
+ *  KERNEL_DTYPE: The MATRIX_DType tag of KERNEL_T
+*/
+
+#define _KERNEL_FN(name) _KERNEL_PASTE(name, KERNEL_SUFFIX)
+
+/**
+ * Copies operand_a[row_start:row_start+rows, k_start:k_start+depth] into slivers of KERNEL_MR rows
+ * Each sliver is stored column by column so the micro kernel reads it sequentially
+ * NOTE: The last sliver is padded with zeros
+*/
+void _KERNEL_FN(_KERNEL_pack_a_)(const struct MATRIX_View* operand_a, long long int row_start, long long int rows, long long int k_start, long long int depth, KERNEL_T* packed){
+    const KERNEL_T* data = operand_a->data;
+    long long int row_stride = MATRIX_view_row_stride(operand_a), col_stride = MATRIX_view_col_stride(operand_a);
+    for (long long int ir = 0; ir < rows; ir += KERNEL_MR){
+        for (long long int k = 0; k < depth; ++k){
+            const KERNEL_T* a = data + (row_start + ir) * row_stride + (k_start + k) * col_stride;
+            for (long long int i = 0; i < KERNEL_MR; ++i){
+                *packed++ = (ir + i < rows)? a[i * row_stride] : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Copies operand_b[k_start:k_start+depth, col_start:col_start+cols] into slivers of KERNEL_NR columns
+ * Each sliver is stored row by row so the micro kernel reads it sequentially
+ * NOTE: The last sliver is padded with zeros
+*/
+void _KERNEL_FN(_KERNEL_pack_b_)(const struct MATRIX_View* operand_b, long long int k_start, long long int depth, long long int col_start, long long int cols, KERNEL_T* packed){
+    const KERNEL_T* data = operand_b->data;
+    long long int row_stride = MATRIX_view_row_stride(operand_b), col_stride = MATRIX_view_col_stride(operand_b);
+    for (long long int jr = 0; jr < cols; jr += KERNEL_NR){
+        for (long long int k = 0; k < depth; ++k){
+            const KERNEL_T* b = data + (k_start + k) * row_stride + (col_start + jr) * col_stride;
+            if (col_stride == 1 && jr + KERNEL_NR <= cols){ // The usual case, a whole contiguous row of the sliver
+                for (long long int j = 0; j < KERNEL_NR; ++j) *packed++ = b[j];
+                continue;
+            }
+            for (long long int j = 0; j < KERNEL_NR; ++j){
+                *packed++ = (jr + j < cols)? b[j * col_stride] : 0;
+            }
+        }
+    }
+}
+
+/**
+ * See KERNEL_pack_a (fills in every panel of packed->data)
+*/
+void _KERNEL_FN(_KERNEL_pack_a_whole_)(struct KERNEL_PackedA* packed){
+    for (long long int pc = 0; pc < packed->source.cols; pc += KERNEL_KC){
+        long long int kc = (packed->source.cols - pc < KERNEL_KC)? (packed->source.cols - pc) : KERNEL_KC;
+        for (long long int ic = 0; ic < packed->source.rows; ic += KERNEL_MC){
+            long long int mc = (packed->source.rows - ic < KERNEL_MC)? (packed->source.rows - ic) : KERNEL_MC;
+            _KERNEL_FN(_KERNEL_pack_a_)(&packed->source, ic, mc, pc, kc, (KERNEL_T*)packed->data + KERNEL_packed_panel(packed, ic, pc));
+        }
+    }
+}
+
+/**
+ * Plain C micro kernel (works everywhere)
+*/
+void _KERNEL_FN(_KERNEL_micro_kernel_scalar_)(long long int depth, const void* vpacked_a, const void* vpacked_b, void* vacc){
+    const KERNEL_T* packed_a = vpacked_a;
+    const KERNEL_T* packed_b = vpacked_b;
+    KERNEL_T* acc = vacc;
+    KERNEL_T sum[KERNEL_MR][KERNEL_NR] = {0};
+
+    for (long long int k = 0; k < depth; ++k){
+        for (int i = 0; i < KERNEL_MR; ++i){
+            for (int j = 0; j < KERNEL_NR; ++j){
+                sum[i][j] += packed_a[i] * packed_b[j];
+            }
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR; ++j){
+            acc[i * KERNEL_NR + j] = sum[i][j];
+        }
+    }
+}
+
+/**
+ * Computes a KERNEL_MR x KERNEL_NR block of the product from packed slivers of A and B (using whichever micro kernel KERNEL_init picked)
+ * Only the top left `rows` x `cols` of the block is written back (for the ragged edges)
+ * The first panel of the depth (first set) stores alpha * block + beta * c (c isn't even read if beta is 0), the rest add alpha * block onto c
+*/
+void _KERNEL_FN(_KERNEL_micro_tile_)(long long int depth, const KERNEL_T* packed_a, const KERNEL_T* packed_b, KERNEL_T* c, long long int ldc, long long int rows, long long int cols, KERNEL_T alpha, KERNEL_T beta, bool first){
+    _Alignas(64) KERNEL_T acc[KERNEL_MR * KERNEL_NR];
+    KERNEL_micro_kernels[KERNEL_DTYPE](depth, packed_a, packed_b, acc);
+
+    for (long long int i = 0; i < rows; ++i){
+        for (long long int j = 0; j < cols; ++j){
+            if (!first) c[i * ldc + j] += alpha * acc[i * KERNEL_NR + j];
+            else if (beta == 0) c[i * ldc + j] = alpha * acc[i * KERNEL_NR + j];
+            else c[i * ldc + j] = beta * c[i * ldc + j] + alpha * acc[i * KERNEL_NR + j];
+        }
+    }
+}
+
+/**
+ * Handles tiles that are too thin to be worth packing (row-k-col order so that B is still read row wise)
+*/
+void _KERNEL_FN(_KERNEL_gemm_unpacked_)(KERNEL_T alpha, const struct MATRIX_View* operand_a, const struct MATRIX_View* operand_b, KERNEL_T beta, const struct MATRIX_View* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end){
+    const KERNEL_T* a_data = operand_a->data;
+    const KERNEL_T* b_data = operand_b->data;
+    KERNEL_T* res_data = product->data;
+    long long int a_row_stride = MATRIX_view_row_stride(operand_a), a_col_stride = MATRIX_view_col_stride(operand_a);
+    long long int b_row_stride = MATRIX_view_row_stride(operand_b), b_col_stride = MATRIX_view_col_stride(operand_b);
+
+    for (long long int row = row_start; row < row_end; ++row){
+        KERNEL_T* res = res_data + row * product->ld;
+        for (long long int col = col_start; col < col_end; ++col) res[col] = (beta == 0)? 0 : beta * res[col];
+
+        for (long long int k = 0; k < operand_a->cols; ++k){
+            KERNEL_T a = alpha * a_data[row * a_row_stride + k * a_col_stride];
+            const KERNEL_T* b = b_data + k * b_row_stride;
+            if (b_col_stride == 1){
+                for (long long int col = col_start; col < col_end; ++col) res[col] += a * b[col];
+            } else{
+                for (long long int col = col_start; col < col_end; ++col) res[col] += a * b[col * b_col_stride];
+            }
+        }
+    }
+}
+
+/**
+ * See KERNEL_gemm_tile (and KERNEL_gemm_packed_tile, which passes the panels of operand_a as prepacked instead of NULL)
+*/
+void _KERNEL_FN(_KERNEL_gemm_tile_)(KERNEL_T alpha, const struct MATRIX_View* operand_a, const struct KERNEL_PackedA* prepacked, const struct MATRIX_View* operand_b, KERNEL_T beta, const struct MATRIX_View* product, long long int row_start, long long int row_end, long long int col_start, long long int col_end){
+    if (row_end - row_start < KERNEL_PACK_MIN_ROWS){
+        _KERNEL_FN(_KERNEL_gemm_unpacked_)(alpha, operand_a, operand_b, beta, product, row_start, row_end, col_start, col_end);
+        return;
+    }
+
+    KERNEL_T* packed_a = (prepacked != NULL)? NULL : _KERNEL_scratch(&_KERNEL_packed_a, KERNEL_MC * KERNEL_KC * KERNEL_MAX_ELEMENT_SIZE);
+    KERNEL_T* packed_b = _KERNEL_scratch(&_KERNEL_packed_b, KERNEL_KC * KERNEL_NC * KERNEL_MAX_ELEMENT_SIZE);
+    KERNEL_T* res = product->data;
+    long long int depth_total = operand_a->cols;
+
+    for (long long int jc = col_start; jc < col_end; jc += KERNEL_NC){
+        long long int nc = (col_end - jc < KERNEL_NC)? (col_end - jc) : KERNEL_NC;
+
+        for (long long int pc = 0; pc < depth_total; pc += KERNEL_KC){
+            long long int kc = (depth_total - pc < KERNEL_KC)? (depth_total - pc) : KERNEL_KC;
+            _KERNEL_FN(_KERNEL_pack_b_)(operand_b, pc, kc, jc, nc, packed_b);
+
+            for (long long int ic = row_start; ic < row_end; ic += KERNEL_MC){
+                long long int mc = (row_end - ic < KERNEL_MC)? (row_end - ic) : KERNEL_MC;
+                const KERNEL_T* panel_a = packed_a;
+                if (prepacked != NULL) panel_a = (const KERNEL_T*)prepacked->data + KERNEL_packed_panel(prepacked, ic, pc);
+                else _KERNEL_FN(_KERNEL_pack_a_)(operand_a, ic, mc, pc, kc, packed_a);
+
+                for (long long int jr = 0; jr < nc; jr += KERNEL_NR){
+                    for (long long int ir = 0; ir < mc; ir += KERNEL_MR){
+                        _KERNEL_FN(_KERNEL_micro_tile_)(
+                            kc, panel_a + ir * kc, packed_b + jr * kc,
+                            res + (ic + ir) * product->ld + jc + jr, product->ld,
+                            (mc - ir < KERNEL_MR)? (mc - ir) : KERNEL_MR,
+                            (nc - jr < KERNEL_NR)? (nc - jr) : KERNEL_NR,
+                            alpha, beta,
+                            pc == 0 // The first panel takes care of beta, the rest add onto it
+                        );
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Whole product of tiny, densely packed matrices (a is rows x depth, b is depth x cols)
+ * Everything fits in L1 at these sizes so packing costs more than it saves, we just want a tight row-k-col loop
+*/
+void _KERNEL_FN(_KERNEL_multiply_small_)(const KERNEL_T* restrict a, const KERNEL_T* restrict b, KERNEL_T* restrict res, long long int rows, long long int depth, long long int cols){
+    for (long long int row = 0; row < rows; ++row){
+        KERNEL_T* res_row = res + row * cols;
+        for (long long int col = 0; col < cols; ++col) res_row[col] = 0;
+
+        for (long long int k = 0; k < depth; ++k){
+            KERNEL_T a_val = a[row * depth + k];
+            const KERNEL_T* b_row = b + k * cols;
+            for (long long int col = 0; col < cols; ++col){
+                res_row[col] += a_val * b_row[col];
+            }
+        }
+    }
+}
+
+/**
+ * See KERNEL_multiply_batch
+*/
+void _KERNEL_FN(_KERNEL_multiply_batch_)(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count){
+    long long int rows = products[0]->rows, depth = operand_as[0]->cols, cols = products[0]->cols;
+    for (long long int i = 0; i < count; ++i){
+        if (i + 1 < count){ // Get the next pair of operands on its way while we work on this one
+            __builtin_prefetch(operand_as[i + 1]->data);
+            __builtin_prefetch(operand_bs[i + 1]->data);
+        }
+        if (rows <= KERNEL_BATCH_SMALL_ORDER && cols <= KERNEL_BATCH_SMALL_ORDER){
+            _KERNEL_FN(_KERNEL_multiply_small_)(operand_as[i]->data, operand_bs[i]->data, products[i]->data, rows, depth, cols);
+        } else{
+            struct MATRIX_View a = MATRIX_view(operand_as[i]), b = MATRIX_view(operand_bs[i]), c = MATRIX_view(products[i]);
+            _KERNEL_FN(_KERNEL_gemm_tile_)(1, &a, NULL, &b, 0, &c, 0, rows, 0, cols);
+        }
+    }
+}
+
+#undef _KERNEL_FN
@@ -0,0 +1,290 @@
+#include "kernel_simd.h"
+
+#pragma region int32
+/**
+ * SSE4.2 int32 micro kernel (4 lanes per register, so each row of the block is 2 registers)
+*/
+__attribute__((target("sse4.2")))
+void _KERNEL_micro_kernel_sse42_i32(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const int* packed_a = vpacked_a;
+    const int* packed_b = vpacked_b;
+    __m128i sum[KERNEL_MR][KERNEL_NR / 4];
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm_setzero_si128();
+    }
+
+    for (long long int k = 0; k < depth; ++k){
+        __m128i b[KERNEL_NR / 4];
+        for (int j = 0; j < KERNEL_NR / 4; ++j) b[j] = _mm_load_si128((const __m128i*)(packed_b + 4 * j));
+        for (int i = 0; i < KERNEL_MR; ++i){
+            __m128i a = _mm_set1_epi32(packed_a[i]);
+            for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm_add_epi32(sum[i][j], _mm_mullo_epi32(a, b[j]));
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) _mm_store_si128((__m128i*)((int*)acc + i * KERNEL_NR + 4 * j), sum[i][j]);
+    }
+}
+
+/**
+ * AVX2 int32 micro kernel (8 lanes, so each row of the block is a single register)
+*/
+__attribute__((target("avx2")))
+void _KERNEL_micro_kernel_avx2_i32(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const int* packed_a = vpacked_a;
+    const int* packed_b = vpacked_b;
+    __m256i sum[KERNEL_MR];
+    for (int i = 0; i < KERNEL_MR; ++i) sum[i] = _mm256_setzero_si256();
+
+    for (long long int k = 0; k < depth; ++k){
+        __m256i b = _mm256_load_si256((const __m256i*)packed_b);
+        for (int i = 0; i < KERNEL_MR; ++i){
+            sum[i] = _mm256_add_epi32(sum[i], _mm256_mullo_epi32(_mm256_set1_epi32(packed_a[i]), b));
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i) _mm256_store_si256((__m256i*)((int*)acc + i * KERNEL_NR), sum[i]);
+}
+#pragma endregion
+
+#pragma region int64
+/**
+ * SSE and AVX2 have no 64 bit multiply, so it is built out of 32 bit ones:
+ *  a * b = lo(a) * lo(b) + ((hi(a) * lo(b) + lo(a) * hi(b)) << 32)   (mod 2^64, so this is fine for signed values too)
+ * hi(b) is computed once per row of the B sliver and reused for all KERNEL_MR rows of A
+*/
+__attribute__((target("sse4.2")))
+static inline __m128i _KERNEL_mul_epi64_sse(__m128i a, __m128i a_hi, __m128i b, __m128i b_hi){
+    __m128i cross = _mm_add_epi64(_mm_mul_epu32(a_hi, b), _mm_mul_epu32(a, b_hi));
+    return _mm_add_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _KERNEL_mul_epi64_avx2(__m256i a, __m256i a_hi, __m256i b, __m256i b_hi){
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(a_hi, b), _mm256_mul_epu32(a, b_hi));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+/**
+ * SSE4.2 int64 micro kernel (2 lanes per register, so each row of the block is 4 registers)
+*/
+__attribute__((target("sse4.2")))
+void _KERNEL_micro_kernel_sse42_i64(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const long long int* packed_a = vpacked_a;
+    const long long int* packed_b = vpacked_b;
+    __m128i sum[KERNEL_MR][KERNEL_NR / 2];
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 2; ++j) sum[i][j] = _mm_setzero_si128();
+    }
+
+    for (long long int k = 0; k < depth; ++k){
+        __m128i b[KERNEL_NR / 2], b_hi[KERNEL_NR / 2];
+        for (int j = 0; j < KERNEL_NR / 2; ++j){
+            b[j] = _mm_load_si128((const __m128i*)(packed_b + 2 * j));
+            b_hi[j] = _mm_srli_epi64(b[j], 32);
+        }
+        for (int i = 0; i < KERNEL_MR; ++i){
+            __m128i a = _mm_set1_epi64x(packed_a[i]);
+            __m128i a_hi = _mm_srli_epi64(a, 32);
+            for (int j = 0; j < KERNEL_NR / 2; ++j){
+                sum[i][j] = _mm_add_epi64(sum[i][j], _KERNEL_mul_epi64_sse(a, a_hi, b[j], b_hi[j]));
+            }
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 2; ++j) _mm_store_si128((__m128i*)((long long int*)acc + i * KERNEL_NR + 2 * j), sum[i][j]);
+    }
+}
+
+/**
+ * AVX2 int64 micro kernel (4 lanes per register, so each row of the block is 2 registers)
+*/
+__attribute__((target("avx2")))
+void _KERNEL_micro_kernel_avx2_i64(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const long long int* packed_a = vpacked_a;
+    const long long int* packed_b = vpacked_b;
+    __m256i sum[KERNEL_MR][KERNEL_NR / 4];
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm256_setzero_si256();
+    }
+
+    for (long long int k = 0; k < depth; ++k){
+        __m256i b[KERNEL_NR / 4], b_hi[KERNEL_NR / 4];
+        for (int j = 0; j < KERNEL_NR / 4; ++j){
+            b[j] = _mm256_load_si256((const __m256i*)(packed_b + 4 * j));
+            b_hi[j] = _mm256_srli_epi64(b[j], 32);
+        }
+        for (int i = 0; i < KERNEL_MR; ++i){
+            __m256i a = _mm256_set1_epi64x(packed_a[i]);
+            __m256i a_hi = _mm256_srli_epi64(a, 32);
+            for (int j = 0; j < KERNEL_NR / 4; ++j){
+                sum[i][j] = _mm256_add_epi64(sum[i][j], _KERNEL_mul_epi64_avx2(a, a_hi, b[j], b_hi[j]));
+            }
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) _mm256_store_si256((__m256i*)((long long int*)acc + i * KERNEL_NR + 4 * j), sum[i][j]);
+    }
+}
+
+/**
+ * AVX-512 int64 micro kernel (8 lanes, so each row of the block is a single register, and DQ gives us a real 64 bit multiply)
+*/
+__attribute__((target("avx512f,avx512dq")))
+void _KERNEL_micro_kernel_avx512_i64(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const long long int* packed_a = vpacked_a;
+    const long long int* packed_b = vpacked_b;
+    __m512i sum[KERNEL_MR];
+    for (int i = 0; i < KERNEL_MR; ++i) sum[i] = _mm512_setzero_si512();
+
+    for (long long int k = 0; k < depth; ++k){
+        __m512i b = _mm512_load_si512((const void*)packed_b);
+        for (int i = 0; i < KERNEL_MR; ++i){
+            sum[i] = _mm512_add_epi64(sum[i], _mm512_mullo_epi64(_mm512_set1_epi64(packed_a[i]), b));
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i) _mm512_store_si512((void*)((long long int*)acc + i * KERNEL_NR), sum[i]);
+}
+#pragma endregion
+
+#pragma region float
+/**
+ * SSE4.2 float micro kernel (4 lanes per register, so each row of the block is 2 registers)
+*/
+__attribute__((target("sse4.2")))
+void _KERNEL_micro_kernel_sse42_f32(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const float* packed_a = vpacked_a;
+    const float* packed_b = vpacked_b;
+    __m128 sum[KERNEL_MR][KERNEL_NR / 4];
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm_setzero_ps();
+    }
+
+    for (long long int k = 0; k < depth; ++k){
+        __m128 b[KERNEL_NR / 4];
+        for (int j = 0; j < KERNEL_NR / 4; ++j) b[j] = _mm_load_ps(packed_b + 4 * j);
+        for (int i = 0; i < KERNEL_MR; ++i){
+            __m128 a = _mm_set1_ps(packed_a[i]);
+            for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm_add_ps(sum[i][j], _mm_mul_ps(a, b[j]));
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) _mm_store_ps((float*)acc + i * KERNEL_NR + 4 * j, sum[i][j]);
+    }
+}
+
+/**
+ * AVX2 (+FMA) float micro kernel (8 lanes, so each row of the block is a single register)
+*/
+__attribute__((target("avx2,fma")))
+void _KERNEL_micro_kernel_avx2_f32(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const float* packed_a = vpacked_a;
+    const float* packed_b = vpacked_b;
+    __m256 sum[KERNEL_MR];
+    for (int i = 0; i < KERNEL_MR; ++i) sum[i] = _mm256_setzero_ps();
+
+    for (long long int k = 0; k < depth; ++k){
+        __m256 b = _mm256_load_ps(packed_b);
+        for (int i = 0; i < KERNEL_MR; ++i) sum[i] = _mm256_fmadd_ps(_mm256_set1_ps(packed_a[i]), b, sum[i]);
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i) _mm256_store_ps((float*)acc + i * KERNEL_NR, sum[i]);
+}
+#pragma endregion
+
+#pragma region double
+/**
+ * SSE4.2 double micro kernel (2 lanes per register, so each row of the block is 4 registers)
+*/
+__attribute__((target("sse4.2")))
+void _KERNEL_micro_kernel_sse42_f64(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const double* packed_a = vpacked_a;
+    const double* packed_b = vpacked_b;
+    __m128d sum[KERNEL_MR][KERNEL_NR / 2];
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 2; ++j) sum[i][j] = _mm_setzero_pd();
+    }
+
+    for (long long int k = 0; k < depth; ++k){
+        __m128d b[KERNEL_NR / 2];
+        for (int j = 0; j < KERNEL_NR / 2; ++j) b[j] = _mm_load_pd(packed_b + 2 * j);
+        for (int i = 0; i < KERNEL_MR; ++i){
+            __m128d a = _mm_set1_pd(packed_a[i]);
+            for (int j = 0; j < KERNEL_NR / 2; ++j) sum[i][j] = _mm_add_pd(sum[i][j], _mm_mul_pd(a, b[j]));
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 2; ++j) _mm_store_pd((double*)acc + i * KERNEL_NR + 2 * j, sum[i][j]);
+    }
+}
+
+/**
+ * AVX2 (+FMA) double micro kernel (4 lanes per register, so each row of the block is 2 registers)
+*/
+__attribute__((target("avx2,fma")))
+void _KERNEL_micro_kernel_avx2_f64(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const double* packed_a = vpacked_a;
+    const double* packed_b = vpacked_b;
+    __m256d sum[KERNEL_MR][KERNEL_NR / 4];
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm256_setzero_pd();
+    }
+
+    for (long long int k = 0; k < depth; ++k){
+        __m256d b[KERNEL_NR / 4];
+        for (int j = 0; j < KERNEL_NR / 4; ++j) b[j] = _mm256_load_pd(packed_b + 4 * j);
+        for (int i = 0; i < KERNEL_MR; ++i){
+            __m256d a = _mm256_set1_pd(packed_a[i]);
+            for (int j = 0; j < KERNEL_NR / 4; ++j) sum[i][j] = _mm256_fmadd_pd(a, b[j], sum[i][j]);
+        }
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i){
+        for (int j = 0; j < KERNEL_NR / 4; ++j) _mm256_store_pd((double*)acc + i * KERNEL_NR + 4 * j, sum[i][j]);
+    }
+}
+
+/**
+ * AVX-512 double micro kernel (8 lanes, so each row of the block is a single register)
+*/
+__attribute__((target("avx512f")))
+void _KERNEL_micro_kernel_avx512_f64(long long int depth, const void* vpacked_a, const void* vpacked_b, void* acc){
+    const double* packed_a = vpacked_a;
+    const double* packed_b = vpacked_b;
+    __m512d sum[KERNEL_MR];
+    for (int i = 0; i < KERNEL_MR; ++i) sum[i] = _mm512_setzero_pd();
+
+    for (long long int k = 0; k < depth; ++k){
+        __m512d b = _mm512_load_pd(packed_b);
+        for (int i = 0; i < KERNEL_MR; ++i) sum[i] = _mm512_fmadd_pd(_mm512_set1_pd(packed_a[i]), b, sum[i]);
+        packed_a += KERNEL_MR;
+        packed_b += KERNEL_NR;
+    }
+
+    for (int i = 0; i < KERNEL_MR; ++i) _mm512_store_pd((double*)acc + i * KERNEL_NR, sum[i]);
+}
+#pragma endregion
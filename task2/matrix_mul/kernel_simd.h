@@ -0,0 +1,30 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Hand vectorized micro kernels for kernel.h (one per dtype per instruction set)
+ * NOTE: These are compiled with per function target attributes, so they build without any -m flags.
+ *       Never call them directly, KERNEL_init only installs the ones the cpu actually supports
+ * 
+*/ 
+
+#pragma once
+#include "kernel.h"
+
+#ifdef KERNEL_X86
+void _KERNEL_micro_kernel_sse42_i32(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+void _KERNEL_micro_kernel_avx2_i32(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+
+void _KERNEL_micro_kernel_sse42_i64(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+void _KERNEL_micro_kernel_avx2_i64(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+void _KERNEL_micro_kernel_avx512_i64(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+
+void _KERNEL_micro_kernel_sse42_f32(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+void _KERNEL_micro_kernel_avx2_f32(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+
+void _KERNEL_micro_kernel_sse42_f64(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+void _KERNEL_micro_kernel_avx2_f64(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+void _KERNEL_micro_kernel_avx512_f64(long long int depth, const void* packed_a, const void* packed_b, void* acc);
+
+#include "kernel_simd.c"
+#endif
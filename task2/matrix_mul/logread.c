@@ -0,0 +1,169 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Reads back a binary product log (see binlog.h)
+ *
+ * Inputs:
+ *  log_file{path to a .bin written by par or seq}
+ *  --text (optional, dumps the log in the text format instead, which check_answers.py reads)
+ *  --verify=N (optional, rounds of Freivalds' check per product, defaults to 1)
+ *
+ * Outputs:
+ *  stdout:
+ *      SUCCESS (once every product checks out), or the text dump if --text was given
+ *  stderr:
+ *      ERROR! ... (and exits with 1) if the log is malformed or any product is wrong
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix.h"
+#include "common.h"
+#include "verify.h"
+#include "binlog.h"
+
+// Seed for the random vectors used by Freivalds' check (any value works, the log doesn't store the run's seed)
+#define LOGREAD_VERIFY_SEED 0x10C5EEDULL
+
+#pragma region Business Logix
+char* map_log(const char* path, size_t* size);
+void unmap_log(char* base, size_t size);
+struct Matrix view_record(char* base, size_t size, size_t offset);
+#pragma endregion
+
+int main(int argc, char* argv[]){
+    const char* path = NULL;
+    bool text = false;
+    long long int rounds = 1;
+    for (int i = 1; i < argc; ++i){
+        if (strcmp(argv[i], "--text") == 0) text = true;
+        else if (strncmp(argv[i], "--verify=", 9) == 0) rounds = atoll(argv[i] + 9);
+        else if (path == NULL) path = argv[i];
+        else path = NULL, i = argc; // Too many arguments
+    }
+    if (path == NULL || rounds < 0){
+        fprintf(stderr, "ERROR! Usage: logread {log_file} [--text] [--verify=N]\n");
+        exit(1);
+    }
+
+    size_t size;
+    char* base = map_log(path, &size);
+
+    struct BINLOG_FileHeader header;
+    if (size < sizeof(header)){
+        fprintf(stderr, "ERROR! `%s` is too small to be a product log\n", path);
+        exit(1);
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, BINLOG_MAGIC, sizeof(header.magic)) != 0 || header.version != BINLOG_VERSION || header.matrices_per_operation != BINLOG_MATRICES_PER_OPERATION){
+        fprintf(stderr, "ERROR! `%s` is not a version %d product log\n", path, BINLOG_VERSION);
+        exit(1);
+    }
+
+    size_t offset = BINLOG_round(sizeof(header));
+    for (long long int i = 0; i < header.operations; ++i){
+        struct Matrix record[BINLOG_MATRICES_PER_OPERATION];
+        for (int which = 0; which < BINLOG_MATRICES_PER_OPERATION; ++which){
+            record[which] = view_record(base, size, offset);
+            offset += BINLOG_round(sizeof(struct BINLOG_MatrixHeader)) + BINLOG_round(record[which].rows * record[which].cols * MATRIX_dtype_size(record[which].dtype));
+        }
+
+        if (text){
+            printf("Operation %lld:\n", i);
+            for (int which = 0; which < BINLOG_MATRICES_PER_OPERATION; ++which) MATRIX_print(&record[which], stdout);
+            continue;
+        }
+
+        if (record[0].dtype != record[2].dtype || record[1].dtype != record[2].dtype || record[0].cols != record[1].rows || record[0].rows != record[2].rows || record[1].cols != record[2].cols){
+            fprintf(stderr, "ERROR! Operation %lld has mismatched matrices\n", i);
+            exit(1);
+        }
+        for (long long int round = 0; round < rounds; ++round){
+            if (!VERIFY_product(&record[0], &record[1], &record[2], verify_seed(LOGREAD_VERIFY_SEED, round, i))){
+                fprintf(stderr, "ERROR! Product %lld failed verification\n", i);
+                exit(1);
+            }
+        }
+    }
+    if (!text) printf("SUCCESS\n");
+
+    unmap_log(base, size);
+    return 0;
+}
+
+/**
+ * Maps the whole log read only (or reads it into memory where mmap isn't available)
+ * RAISES: Exits if the file could not be read
+*/
+char* map_log(const char* path, size_t* size){
+    FILE* file = fopen(path, "rb");
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0){
+        fprintf(stderr, "ERROR! Could not open product log `%s`\n", path);
+        exit(1);
+    }
+    *size = ftell(file);
+    rewind(file);
+
+#ifdef __linux__
+    void* mapped = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (mapped != MAP_FAILED){
+        madvise(mapped, *size, MADV_SEQUENTIAL); // We go through it once, front to back
+        fclose(file); // NOTE: The mapping keeps the file alive
+        return mapped;
+    }
+#endif
+
+    char* base = malloc(*size);
+    if (base == NULL || fread(base, 1, *size, file) != *size){
+        fprintf(stderr, "ERROR! Could not read product log `%s`\n", path);
+        exit(1);
+    }
+    fclose(file);
+    return base;
+}
+
+/**
+ * Undoes map_log
+*/
+void unmap_log(char* base, size_t size){
+#ifdef __linux__
+    if (munmap(base, size) == 0) return;
+#endif
+    free(base);
+}
+
+/**
+ * Makes a Matrix that points straight at the record at offset (nothing is copied, and it must not be MATRIX_free'd)
+ * RAISES: Exits if the record is malformed or runs past the end of the file
+*/
+struct Matrix view_record(char* base, size_t size, size_t offset){
+    struct BINLOG_MatrixHeader header;
+    size_t data = offset + BINLOG_round(sizeof(header));
+    if (data > size){
+        fprintf(stderr, "ERROR! Product log is truncated\n");
+        exit(1);
+    }
+    memcpy(&header, base + offset, sizeof(header));
+    if (header.dtype < 0 || header.dtype >= MATRIX_DTYPE_COUNT || header.element_size != (int32_t)MATRIX_dtype_size(header.dtype) || header.rows <= 0 || header.cols <= 0){
+        fprintf(stderr, "ERROR! Product log has a malformed matrix header\n");
+        exit(1);
+    }
+    if ((size - data) / header.element_size / header.rows < (size_t)header.cols){
+        fprintf(stderr, "ERROR! Product log is truncated\n");
+        exit(1);
+    }
+
+    struct Matrix matrix = {
+        .rows = header.rows,
+        .cols = header.cols,
+        .dtype = header.dtype,
+        .data = base + data,
+        .arena = NULL,
+        .mapping = NULL,
+    };
+    return matrix;
+}
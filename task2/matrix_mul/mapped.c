@@ -0,0 +1,178 @@
+#include "mapped.h"
+
+/**
+ * Gets floor(sqrt(n)) (Newton's method on integers, so no libm)
+*/
+long long int _MAPPED_isqrt(long long int n){
+    if (n < 2) return (n > 0)? n : 0;
+    long long int x = n, y = (x + 1) / 2;
+    while (y < x){
+        x = y;
+        y = (x + n / x) / 2;
+    }
+    return x;
+}
+
+/**
+ * Sizes the panels of an out-of-core operand_a * operand_b so that about working_set bytes are mapped at once
+ * Half of it goes to the step being computed (the other half being the next step, prefetched), and of that a step with
+ * full depth panels needs panel_rows * depth + depth * panel_cols + panel_rows * panel_cols elements (panels are square,
+ * T = panel_rows = panel_cols, so T * (2 * depth + T) of them), if that leaves T under MAPPED_MIN_PANEL the depth is split
+ * into blocks of T as well (3 * T * T elements)
+ * Column panels narrower than B are rounded down to whole pages of a row (so that neighbouring panels never share a page)
+*/
+void MAPPED_plan(struct Matrix* operand_a, struct Matrix* operand_b, long long int working_set, struct MAPPED_Plan* plan){
+    long long int element_size = MATRIX_dtype_size(operand_a->dtype);
+    long long int rows = operand_a->rows, depth = operand_a->cols, cols = operand_b->cols;
+    long long int budget = working_set / (2 * element_size);
+
+    long long int side = _MAPPED_isqrt(depth * depth + budget) - depth, block_depth = depth;
+    if (side < MAPPED_MIN_PANEL){
+        side = _MAPPED_isqrt(budget / 3);
+        block_depth = (side < depth)? side : depth;
+    }
+    if (side < 1) side = 1;
+    if (block_depth < 1) block_depth = 1;
+
+    long long int page_elements = 4096 / element_size;
+    plan->panel_rows = (side < rows)? side : rows;
+    plan->panel_cols = (side < cols)? side : cols;
+    if (plan->panel_cols < cols && plan->panel_cols > page_elements) plan->panel_cols -= plan->panel_cols % page_elements;
+    plan->panel_depth = block_depth;
+    plan->row_panels = (rows + plan->panel_rows - 1) / plan->panel_rows;
+    plan->col_panels = (cols + plan->panel_cols - 1) / plan->panel_cols;
+    plan->depth_panels = (depth + plan->panel_depth - 1) / plan->panel_depth;
+}
+
+/**
+ * Gets the number of steps in a plan (depth blocks of every tile)
+*/
+long long int MAPPED_steps(const struct MAPPED_Plan* plan){
+    return plan->row_panels * plan->col_panels * plan->depth_panels;
+}
+
+/**
+ * Gets where the blocks of a step are (depth blocks go fastest, then column panels, then row panels)
+*/
+struct MAPPED_Step MAPPED_step(struct Matrix* operand_a, struct Matrix* operand_b, const struct MAPPED_Plan* plan, long long int step){
+    long long int k = step % plan->depth_panels, j = (step / plan->depth_panels) % plan->col_panels, i = step / (plan->depth_panels * plan->col_panels);
+    struct MAPPED_Step result = {
+        .row = i * plan->panel_rows,
+        .col = j * plan->panel_cols,
+        .depth = k * plan->panel_depth,
+        .first = (k == 0),
+        .last = (k == plan->depth_panels - 1),
+    };
+    result.rows = (operand_a->rows - result.row < plan->panel_rows)? operand_a->rows - result.row : plan->panel_rows;
+    result.cols = (operand_b->cols - result.col < plan->panel_cols)? operand_b->cols - result.col : plan->panel_cols;
+    result.depths = (operand_a->cols - result.depth < plan->panel_depth)? operand_a->cols - result.depth : plan->panel_depth;
+    return result;
+}
+
+/**
+ * Asks for a step's blocks of A and B to be read in ahead of time (MADV_WILLNEED)
+*/
+void MAPPED_prefetch(struct Matrix* operand_a, struct Matrix* operand_b, const struct MAPPED_Plan* plan, long long int step){
+#ifdef __linux__
+    struct MAPPED_Step s = MAPPED_step(operand_a, operand_b, plan, step);
+    _MAPPED_advise(operand_a, s.row, s.depth, s.rows, s.depths, MADV_WILLNEED);
+    _MAPPED_advise(operand_b, s.depth, s.col, s.depths, s.cols, MADV_WILLNEED);
+#endif
+}
+
+/**
+ * Computes rows [row_start, row_end) of a step (absolute rows of C, within the step's tile), so that a step can be split up
+ * among threads
+ * NOTE: The steps of a tile have to be done in order (every depth block but the first adds to what the previous ones left in C)
+*/
+void MAPPED_multiply_rows(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, const struct MAPPED_Plan* plan, long long int step, long long int row_start, long long int row_end){
+    struct MAPPED_Step s = MAPPED_step(operand_a, operand_b, plan, step);
+    struct MATRIX_View a = MATRIX_view_block(MATRIX_view(operand_a), row_start, s.depth, row_end - row_start, s.depths);
+    struct MATRIX_View b = MATRIX_view_block(MATRIX_view(operand_b), s.depth, s.col, s.depths, s.cols);
+    struct MATRIX_View c = MATRIX_view_block(MATRIX_view(product), row_start, s.col, row_end - row_start, s.cols);
+    KERNEL_gemm(1, &a, &b, s.first? 0 : 1, &c);
+}
+
+/**
+ * Lets go of what a step used (MADV_DONTNEED) unless the next step uses it too, a finished tile of C is msync'd (written back
+ * in the background) before being let go of
+*/
+void MAPPED_finish(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, const struct MAPPED_Plan* plan, long long int step){
+#ifdef __linux__
+    struct MAPPED_Step s = MAPPED_step(operand_a, operand_b, plan, step);
+    bool more = (step + 1 < MAPPED_steps(plan));
+    struct MAPPED_Step next = more? MAPPED_step(operand_a, operand_b, plan, step + 1) : s;
+
+    if (!more || next.row != s.row || next.depth != s.depth) _MAPPED_advise(operand_a, s.row, s.depth, s.rows, s.depths, MADV_DONTNEED);
+    if (!more || next.col != s.col || next.depth != s.depth) _MAPPED_advise(operand_b, s.depth, s.col, s.depths, s.cols, MADV_DONTNEED);
+    if (s.last){
+        _MAPPED_advise(product, s.row, s.col, s.rows, s.cols, MAPPED_WRITE_BACK);
+        _MAPPED_advise(product, s.row, s.col, s.rows, s.cols, MADV_DONTNEED);
+    }
+#endif
+}
+
+/**
+ * Starts writing back and lets go of a whole mapped matrix (say operands that were just filled in, so that a multiply starts
+ * out with only its working set mapped)
+*/
+void MAPPED_release(struct Matrix* matrix){
+#ifdef __linux__
+    _MAPPED_advise(matrix, 0, 0, matrix->rows, matrix->cols, MAPPED_WRITE_BACK);
+    _MAPPED_advise(matrix, 0, 0, matrix->rows, matrix->cols, MADV_DONTNEED);
+#endif
+}
+
+/**
+ * Multiplies 2 (usually mapped) matrices a step at a time (see MAPPED_plan) and stores the result in product, prefetching
+ * the next step while computing the current one
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void MAPPED_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int working_set){
+    if (!KERNEL_can_multiply(operand_a, operand_b, product)){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    struct MAPPED_Plan plan;
+    MAPPED_plan(operand_a, operand_b, working_set, &plan);
+
+    long long int steps = MAPPED_steps(&plan);
+    MAPPED_release(operand_a);
+    MAPPED_release(operand_b);
+    MAPPED_prefetch(operand_a, operand_b, &plan, 0);
+    for (long long int step = 0; step < steps; ++step){
+        if (step + 1 < steps) MAPPED_prefetch(operand_a, operand_b, &plan, step + 1);
+        struct MAPPED_Step s = MAPPED_step(operand_a, operand_b, &plan, step);
+        MAPPED_multiply_rows(operand_a, operand_b, product, &plan, step, s.row, s.row + s.rows);
+        MAPPED_finish(operand_a, operand_b, product, &plan, step);
+    }
+}
+
+/**
+ * Gives advice (madvise, or msync with MS_ASYNC for MAPPED_WRITE_BACK) about the rows x cols block of a mapped matrix starting at
+ * (row, col), one call for the whole block if it spans full rows and one per row otherwise (widened to whole pages)
+ * MADV_DONTNEED always lets go of the block's whole rows: read faults map in the cached pages around the one faulted (fault
+ * around, 64K by default) so neighbouring panels of a row get mapped too, and those would otherwise pile up
+ * NOTE: Does nothing for matrices that aren't mapped, and failures are ignored (it is only advice)
+*/
+void _MAPPED_advise(struct Matrix* matrix, long long int row, long long int col, long long int rows, long long int cols, int advice){
+#ifdef __linux__
+    if (matrix->mapping == NULL || matrix->mapping->file != NULL || rows <= 0 || cols <= 0) return;
+    if (advice == MADV_DONTNEED){
+        col = 0;
+        cols = matrix->cols;
+    }
+    size_t element_size = MATRIX_dtype_size(matrix->dtype);
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    bool whole_rows = (col == 0 && cols == matrix->cols);
+    long long int ranges = whole_rows? 1 : rows;
+    size_t length = (whole_rows? rows * cols : cols) * element_size;
+
+    for (long long int r = 0; r < ranges; ++r){
+        uintptr_t start = (uintptr_t)((char*)matrix->data + ((row + r) * matrix->cols + col) * element_size);
+        uintptr_t first = start / page * page;
+        if (advice == MAPPED_WRITE_BACK) msync((void*)first, start + length - first, MS_ASYNC);
+        else madvise((void*)first, start + length - first, advice);
+    }
+#endif
+}
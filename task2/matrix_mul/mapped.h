@@ -0,0 +1,68 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Provides an out-of-core multiply for matrices that live in files (see MATRIX_create_mapped) and can be bigger than RAM
+ *
+ * The product is computed one step at a time, a step being one depth block of one tile of C:
+ *  C[rows of row panel i, cols of col panel j] (+)= A[row panel i, depth block k] * B[depth block k, col panel j]
+ * with k going fastest, then j, then i (so a row panel of A is reused across every column panel before moving on)
+ * Panels are sized by MAPPED_plan so that a step's blocks of A, B and C (and the next step's, being prefetched) fit in the
+ * working set, full depth panels if that leaves them wide enough and square blocks otherwise
+ *
+ * Around every step the mappings get told what is coming and what is done with (madvise):
+ *  - before: the next step's blocks are MADV_WILLNEED (the kernel starts reading them in while this step computes)
+ *  - after: blocks the next step doesn't use are MADV_DONTNEED (and finished C tiles are msync'd first), so what the process
+ *    has mapped stays about the working set however big the files are (clean pages stay in the page cache for as long as
+ *    there is room, so dropping a block only costs a disk read if memory really was short)
+ * Matrices that aren't mapped (in memory, or files read into memory where there is no mmap) just skip the advice
+ *
+*/
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "kernel.h"
+
+// Bytes of the operands and product an out-of-core multiply keeps mapped at once by default (can be changed at runtime, see options.h)
+#define MAPPED_WORKING_SET (256LL << 20)
+// Full depth panels are only used if they can be at least this many rows (columns) wide, below that the depth gets split too
+#define MAPPED_MIN_PANEL 256
+// Passed to _MAPPED_advise instead of a madvise advice to msync (MS_ASYNC, so the kernel starts writing it back) a block
+#define MAPPED_WRITE_BACK -1
+
+struct MAPPED_Plan{
+    long long int panel_rows; // Rows of A (and C) per row panel
+    long long int panel_cols; // Columns of B (and C) per column panel
+    long long int panel_depth; // Columns of A (rows of B) per depth block
+    long long int row_panels; // Row panels in the product
+    long long int col_panels; // Column panels in the product
+    long long int depth_panels; // Depth blocks per tile
+};
+
+// Where a step's blocks are (see MAPPED_step)
+struct MAPPED_Step{
+    long long int row; // First row of the tile of C
+    long long int rows; // Rows in the tile
+    long long int col; // First column of the tile of C
+    long long int cols; // Columns in the tile
+    long long int depth; // First column of A (row of B) of the depth block
+    long long int depths; // Columns of A (rows of B) in the depth block
+    bool first; // Whether this is the tile's first depth block (which overwrites C instead of adding to it)
+    bool last; // Whether this is the tile's last depth block (after which the tile is done)
+};
+
+void MAPPED_plan(struct Matrix* operand_a, struct Matrix* operand_b, long long int working_set, struct MAPPED_Plan* plan);
+long long int MAPPED_steps(const struct MAPPED_Plan* plan);
+struct MAPPED_Step MAPPED_step(struct Matrix* operand_a, struct Matrix* operand_b, const struct MAPPED_Plan* plan, long long int step);
+void MAPPED_prefetch(struct Matrix* operand_a, struct Matrix* operand_b, const struct MAPPED_Plan* plan, long long int step);
+void MAPPED_multiply_rows(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, const struct MAPPED_Plan* plan, long long int step, long long int row_start, long long int row_end);
+void MAPPED_finish(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, const struct MAPPED_Plan* plan, long long int step);
+void MAPPED_release(struct Matrix* matrix);
+void MAPPED_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int working_set);
+long long int _MAPPED_isqrt(long long int n);
+void _MAPPED_advise(struct Matrix* matrix, long long int row, long long int col, long long int rows, long long int cols, int advice);
+
+#include "mapped.c"
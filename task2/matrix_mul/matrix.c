@@ -1,21 +1,40 @@
 #include "matrix.h"
 
 /**
- * Allocates the memory required for a matrix
- * RAISES: Exits if could not allocate memory or if given invalid arguments
+ * Makes sure the arguments describe a matrix that can actually exist
+ * RAISES: Exits if given invalid arguments
 */
-struct Matrix* MATRIX_create(long long int rows, long long int cols){
+void _MATRIX_validate(long long int rows, long long int cols, enum MATRIX_DType dtype){
     if (rows <= 0 || cols <= 0){
         fprintf(stderr, "ERROR! Invalid dimensions for matrix (%d, %d)\n", rows, cols);
         exit(1);
     }
+    if (dtype < 0 || dtype >= MATRIX_DTYPE_COUNT){
+        fprintf(stderr, "ERROR! Invalid dtype for matrix (%d)\n", dtype);
+        exit(1);
+    }
+}
+
+/**
+ * Gets the number of bytes MATRIX_create_in takes from an arena for a matrix of this shape
+*/
+size_t MATRIX_bytes(long long int rows, long long int cols, enum MATRIX_DType dtype){
+    return ARENA_round(sizeof(struct Matrix)) + ARENA_round(rows * cols * MATRIX_dtype_size(dtype));
+}
+
+/**
+ * Allocates the memory required for a matrix
+ * RAISES: Exits if could not allocate memory or if given invalid arguments
+*/
+struct Matrix* MATRIX_create(long long int rows, long long int cols, enum MATRIX_DType dtype){
+    _MATRIX_validate(rows, cols, dtype);
     
     struct Matrix* matrix = malloc(sizeof(struct Matrix));
     if (matrix == NULL){
         fprintf(stderr, "ERROR! Could not allocated memory for matrix :(\n");
         exit(1);
     }
-    matrix->data = malloc(rows * cols * sizeof(long long int));
+    matrix->data = aligned_alloc(ARENA_ALIGNMENT, ARENA_round(rows * cols * MATRIX_dtype_size(dtype)));
     if (matrix->data == NULL){
         fprintf(stderr, "ERROR! Could not allocated memory for matrix :(\n");
         exit(1);
@@ -23,16 +42,196 @@ struct Matrix* MATRIX_create(long long int rows, long long int cols){
     
     matrix->cols = cols;
     matrix->rows = rows;
+    matrix->dtype = dtype;
+    matrix->arena = NULL;
+    matrix->mapping = NULL;
+    return matrix;
 }
 
 /**
- * Frees the data allocated for the matrix
+ * Carves a matrix (struct and data) out of an arena
+ * NOTE: Do not MATRIX_free this, it goes away with the arena
+ * RAISES: Exits if the arena is out of space or if given invalid arguments
+*/
+struct Matrix* MATRIX_create_in(struct Arena* arena, long long int rows, long long int cols, enum MATRIX_DType dtype){
+    _MATRIX_validate(rows, cols, dtype);
+
+    struct Matrix* matrix = ARENA_alloc(arena, sizeof(struct Matrix));
+    matrix->data = ARENA_alloc(arena, rows * cols * MATRIX_dtype_size(dtype));
+    matrix->cols = cols;
+    matrix->rows = rows;
+    matrix->dtype = dtype;
+    matrix->arena = arena;
+    matrix->mapping = NULL;
+    return matrix;
+}
+
+/**
+ * Frees the data allocated for the matrix (a mapped one is unmapped, or written back to its file where there is no mmap)
+ * NOTE: Does nothing for matrices that live in an arena
+ * RAISES: Exits if the file of a matrix read into memory (no mmap) could not be written
 */
 void MATRIX_free(struct Matrix* matrix){
-    free(matrix->data);
+    if (matrix->arena != NULL) return;
+    if (matrix->mapping == NULL){
+        free(matrix->data);
+        free(matrix);
+        return;
+    }
+
+    struct MATRIX_Mapping* mapping = matrix->mapping;
+    if (mapping->file != NULL){
+        if (fseek(mapping->file, 0, SEEK_SET) != 0 || fwrite(mapping->base, 1, mapping->size, mapping->file) != mapping->size){
+            fprintf(stderr, "ERROR! Could not write matrix file\n");
+            exit(1);
+        }
+        fclose(mapping->file);
+        free(mapping->base);
+    }
+#ifdef __linux__
+    else{
+        munmap(mapping->base, mapping->size);
+    }
+#endif
+    free(mapping);
     free(matrix);
 }
 
+/**
+ * Creates (or overwrites) a matrix file at path and maps it, so the matrix lives in the file instead of in memory (the kernel
+ * pages it in and writes it back as needed, so it can be way bigger than RAM)
+ * NOTE: Anywhere without mmap the data is in memory after all and gets written out by MATRIX_free
+ * NOTE: This will not set values in the matrix (a fresh file is all zeros), MATRIX_free it to unmap it
+ * RAISES: Exits if the file could not be created or if given invalid arguments
+*/
+struct Matrix* MATRIX_create_mapped(const char* path, long long int rows, long long int cols, enum MATRIX_DType dtype){
+    _MATRIX_validate(rows, cols, dtype);
+    size_t header_size = ARENA_round(sizeof(struct MATRIX_FileHeader));
+    struct Matrix* matrix = _MATRIX_map(path, true, header_size + rows * cols * MATRIX_dtype_size(dtype));
+
+    struct MATRIX_FileHeader header = {
+        .version = MATRIX_FILE_VERSION,
+        .rows = rows,
+        .cols = cols,
+        .dtype = dtype,
+        .element_size = MATRIX_dtype_size(dtype),
+    };
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    memcpy(matrix->mapping->base, &header, sizeof(header));
+
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->dtype = dtype;
+    matrix->data = matrix->mapping->base + header_size;
+    return matrix;
+}
+
+/**
+ * Maps an existing matrix file (as made by MATRIX_create_mapped), changes to the matrix go to the file
+ * RAISES: Exits if the file could not be opened or isn't a valid matrix file
+*/
+struct Matrix* MATRIX_open_mapped(const char* path){
+    struct Matrix* matrix = _MATRIX_map(path, false, 0);
+    size_t header_size = ARENA_round(sizeof(struct MATRIX_FileHeader));
+    struct MATRIX_FileHeader header;
+    if (matrix->mapping->size < header_size){
+        fprintf(stderr, "ERROR! `%s` is not a matrix file\n", path);
+        exit(1);
+    }
+    memcpy(&header, matrix->mapping->base, sizeof(header));
+    if (memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != MATRIX_FILE_VERSION){
+        fprintf(stderr, "ERROR! `%s` is not a matrix file\n", path);
+        exit(1);
+    }
+    _MATRIX_validate(header.rows, header.cols, header.dtype);
+    if ((size_t)header.element_size != MATRIX_dtype_size(header.dtype) || (matrix->mapping->size - header_size) / header.element_size / header.rows < (size_t)header.cols){
+        fprintf(stderr, "ERROR! Matrix file `%s` is truncated\n", path);
+        exit(1);
+    }
+
+    matrix->rows = header.rows;
+    matrix->cols = header.cols;
+    matrix->dtype = header.dtype;
+    matrix->data = matrix->mapping->base + header_size;
+    return matrix;
+}
+
+/**
+ * Maps a file (created with the given size, or as it is) into a Matrix whose shape and data the caller fills in
+ * Anywhere without mmap the file is read into memory instead (and written back by MATRIX_free)
+ * NOTE: On linux a file that can't be mapped is an error, not a reason to read it all into memory (these files are meant to be
+ *       bigger than that)
+ * RAISES: Exits if the file could not be opened, sized or mapped or if could not allocate memory
+*/
+struct Matrix* _MATRIX_map(const char* path, bool create, size_t size){
+    struct Matrix* matrix = malloc(sizeof(struct Matrix));
+    struct MATRIX_Mapping* mapping = malloc(sizeof(struct MATRIX_Mapping));
+    if (matrix == NULL || mapping == NULL){
+        fprintf(stderr, "ERROR! Could not allocated memory for matrix :(\n");
+        exit(1);
+    }
+    mapping->base = NULL;
+    mapping->size = size;
+    mapping->file = NULL;
+
+#ifdef __linux__
+    int fd = open(path, create? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    if (fd < 0){
+        fprintf(stderr, "ERROR! Could not open matrix file `%s` (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    off_t file_size = create? (off_t)size : lseek(fd, 0, SEEK_END);
+    if (file_size <= 0){
+        fprintf(stderr, "ERROR! Matrix file `%s` is empty\n", path);
+        exit(1);
+    }
+    if (create && ftruncate(fd, file_size) != 0){
+        fprintf(stderr, "ERROR! Could not size matrix file `%s` (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    void* base = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED){
+        fprintf(stderr, "ERROR! Could not map matrix file `%s` (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    mapping->base = base;
+    mapping->size = file_size;
+    close(fd); // NOTE: The mapping keeps the file alive
+#else
+    // No mmap, keep it in memory and write it back at the end
+    mapping->file = fopen(path, create? "w+b" : "r+b");
+    if (mapping->file == NULL){
+        fprintf(stderr, "ERROR! Could not open matrix file `%s`\n", path);
+        exit(1);
+    }
+    if (!create){
+        fseek(mapping->file, 0, SEEK_END);
+        mapping->size = ftell(mapping->file);
+        fseek(mapping->file, 0, SEEK_SET);
+    }
+    mapping->base = calloc((mapping->size > 0)? mapping->size : 1, 1);
+    if (mapping->base == NULL || (!create && fread(mapping->base, 1, mapping->size, mapping->file) != mapping->size)){
+        fprintf(stderr, "ERROR! Could not read matrix file `%s`\n", path);
+        exit(1);
+    }
+#endif
+
+    matrix->arena = NULL;
+    matrix->mapping = mapping;
+    return matrix;
+}
+
+/**
+ * Sets an element (converting the value to the element type of the matrix)
+*/
+void MATRIX_set(struct Matrix* matrix, long long int idx, long long int value){
+    switch (matrix->dtype){
+#define _MATRIX_SET_CASE(tag, type, suffix, fmt, name) case tag: ((type*)matrix->data)[idx] = (type)value; break;
+        MATRIX_DTYPES(_MATRIX_SET_CASE)
+    default: break;
+    }
+}
+
 /**
  * Prints the matrix to the given fd
 */
@@ -40,15 +239,128 @@ void MATRIX_print(struct Matrix* matrix, FILE* fd){
     fprintf(fd, "Matrix<%ld, %ld>\n", matrix->rows, matrix->cols);
     for (long long int row = 0; row < matrix->rows; ++row){
         for (long long int col = 0; col < matrix->cols; ++col){
-            fprintf(fd, "%ld ", matrix->data[MATRIX_idx(row, col, matrix)]);
+            long long int idx = MATRIX_idx(row, col, matrix);
+            switch (matrix->dtype){
+#define _MATRIX_PRINT_CASE(tag, type, suffix, fmt, name) case tag: fprintf(fd, fmt, ((type*)matrix->data)[idx]); break;
+                MATRIX_DTYPES(_MATRIX_PRINT_CASE)
+            default: break;
+            }
         }
         fprintf(fd, "\n");
     }
 }
 
+/**
+ * Gets the size (in bytes) of a single element of the given type
+*/
+size_t MATRIX_dtype_size(enum MATRIX_DType dtype){
+    switch (dtype){
+#define _MATRIX_SIZE_CASE(tag, type, suffix, fmt, name) case tag: return sizeof(type);
+        MATRIX_DTYPES(_MATRIX_SIZE_CASE)
+    default: return 0;
+    }
+}
+
+/**
+ * Gets the name of the type (as accepted on the command line)
+*/
+const char* MATRIX_dtype_name(enum MATRIX_DType dtype){
+    switch (dtype){
+#define _MATRIX_NAME_CASE(tag, type, suffix, fmt, name) case tag: return name;
+        MATRIX_DTYPES(_MATRIX_NAME_CASE)
+    default: return "unknown";
+    }
+}
+
+/**
+ * Parses the name of a type, returns false if the name is not a known type
+*/
+bool MATRIX_dtype_parse(const char* name, enum MATRIX_DType* dtype){
+#define _MATRIX_PARSE_CASE(tag, type, suffix, fmt, name_) if (strcmp(name, name_) == 0){ *dtype = tag; return true; }
+    MATRIX_DTYPES(_MATRIX_PARSE_CASE)
+    return false;
+}
+
+/**
+ * Gets a view of a whole matrix
+*/
+struct MATRIX_View MATRIX_view(struct Matrix* matrix){
+    struct MATRIX_View view = {
+        .data = matrix->data,
+        .rows = matrix->rows,
+        .cols = matrix->cols,
+        .ld = matrix->cols,
+        .transposed = false,
+        .dtype = matrix->dtype,
+    };
+    return view;
+}
+
+/**
+ * Gets a view of a rows x cols row major matrix that starts at data, with ld elements between the starts of its rows
+ * (for operands that already live inside some bigger buffer)
+ * RAISES: Exits if given invalid arguments
+*/
+struct MATRIX_View MATRIX_view_wrap(void* data, long long int rows, long long int cols, long long int ld, enum MATRIX_DType dtype){
+    _MATRIX_validate(rows, cols, dtype);
+    if (ld < cols){
+        fprintf(stderr, "ERROR! Invalid leading dimension %lld for a view with %lld columns\n", ld, cols);
+        exit(1);
+    }
+    struct MATRIX_View view = {
+        .data = data,
+        .rows = rows,
+        .cols = cols,
+        .ld = ld,
+        .transposed = false,
+        .dtype = dtype,
+    };
+    return view;
+}
+
+/**
+ * Gets a view of the rows x cols block of a view that starts at (row, col)
+ * RAISES: Exits if the block does not fit in the view
+*/
+struct MATRIX_View MATRIX_view_block(struct MATRIX_View view, long long int row, long long int col, long long int rows, long long int cols){
+    if (row < 0 || col < 0 || rows <= 0 || cols <= 0 || row + rows > view.rows || col + cols > view.cols){
+        fprintf(stderr, "ERROR! Block (%lld, %lld) of shape (%lld, %lld) does not fit in a view of shape (%lld, %lld)\n", row, col, rows, cols, view.rows, view.cols);
+        exit(1);
+    }
+    view.data = (char*)view.data + (row * MATRIX_view_row_stride(&view) + col * MATRIX_view_col_stride(&view)) * MATRIX_dtype_size(view.dtype);
+    view.rows = rows;
+    view.cols = cols;
+    return view;
+}
+
+/**
+ * Gets the transpose of a view (the same memory, read the other way)
+*/
+struct MATRIX_View MATRIX_view_transpose(struct MATRIX_View view){
+    long long int rows = view.rows;
+    view.rows = view.cols;
+    view.cols = rows;
+    view.transposed = !view.transposed;
+    return view;
+}
+
+/**
+ * Gets the number of elements between vertically adjacent elements of a view
+*/
+long long int MATRIX_view_row_stride(const struct MATRIX_View* view){
+    return view->transposed? 1 : view->ld;
+}
+
+/**
+ * Gets the number of elements between horizontally adjacent elements of a view
+*/
+long long int MATRIX_view_col_stride(const struct MATRIX_View* view){
+    return view->transposed? view->ld : 1;
+}
+
 /**
  * Gets the index of the element in the flattened array based on row and column number
 */
 inline long long int MATRIX_idx(long long int row, long long int col, struct Matrix* matrix){
     return row * matrix->cols + col;
-}
\ No newline at end of file
+}
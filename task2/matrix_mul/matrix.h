@@ -9,16 +9,101 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Matrix files (see MATRIX_create_mapped) start with this, followed by a MATRIX_FileHeader
+#define MATRIX_FILE_MAGIC "MATRIXMM"
+#define MATRIX_FILE_VERSION 1
+
+/**
+ * Every element type a Matrix can hold
+ * X(tag, C type, suffix used for per type functions, printf format, name used on the command line)
+*/
+#define MATRIX_DTYPES(X) \
+    X(MATRIX_INT32,  int,           i32, "%d ",   "int32")  \
+    X(MATRIX_INT64,  long long int, i64, "%lld ", "int64")  \
+    X(MATRIX_FLOAT,  float,         f32, "%g ",   "float")  \
+    X(MATRIX_DOUBLE, double,        f64, "%g ",   "double")
+
+#define _MATRIX_DTYPE_ENUM(tag, type, suffix, fmt, name) tag,
+enum MATRIX_DType{
+    MATRIX_DTYPES(_MATRIX_DTYPE_ENUM)
+    MATRIX_DTYPE_COUNT
+};
+
+/**
+ * Layout of a matrix file: this header (padded to ARENA_ALIGNMENT bytes) followed by rows * cols elements of raw (row major)
+ * data, every integer little endian (as written by the machine), so the data can be used straight out of a mapping
+*/
+struct MATRIX_FileHeader{
+    char magic[8]; // MATRIX_FILE_MAGIC (no null terminator)
+    int64_t version; // MATRIX_FILE_VERSION
+    int64_t rows; // The number of rows in the matrix
+    int64_t cols; // The number of columns in the matrix
+    int32_t dtype; // enum MATRIX_DType
+    int32_t element_size; // Size of an element in bytes
+};
+
+// A matrix file a Matrix's data lives in
+struct MATRIX_Mapping{
+    char* base; // The whole file (mapped, or read into memory where there is no mmap)
+    size_t size; // Size of the file in bytes
+    FILE* file; // Only used when the file isn't mapped (written back by MATRIX_free)
+};
 
 struct Matrix{
     long long int rows; // The number of rows in the matrix
     long long int cols; // The number of columns in the matrix
-    long long int* data; // An array that stores the matrix data (flattened)
+    enum MATRIX_DType dtype; // The type of each element
+    void* data; // An array that stores the matrix data (flattened, 64 byte aligned), the actual type depends on dtype
+    struct Arena* arena; // The arena the matrix (and its data) was allocated from, NULL if it owns its own memory
+    struct MATRIX_Mapping* mapping; // The file the data lives in (see MATRIX_create_mapped), NULL if it is in memory
+};
+
+/**
+ * A (possibly strided or transposed) window onto matrix data that lives somewhere else (a Matrix, or any other buffer)
+ * Element (i, j) of the view is data[i * ld + j], or data[j * ld + i] if transposed (so a transposed view of a row major
+ * buffer is just the same memory read column wise), nothing is ever copied
+ * NOTE: rows and cols are the shape of the view as seen from outside (after the transpose)
+*/
+struct MATRIX_View{
+    void* data; // The first element of the view
+    long long int rows; // The number of rows in the view
+    long long int cols; // The number of columns in the view
+    long long int ld; // Leading dimension: elements between the starts of consecutive rows of the underlying storage
+    bool transposed; // Set if the underlying storage is read column wise (see above)
+    enum MATRIX_DType dtype; // The type of each element
 };
 
-struct Matrix* MATRIX_create(long long int rows, long long int cols);
+struct Matrix* MATRIX_create(long long int rows, long long int cols, enum MATRIX_DType dtype);
+struct Matrix* MATRIX_create_in(struct Arena* arena, long long int rows, long long int cols, enum MATRIX_DType dtype);
+size_t MATRIX_bytes(long long int rows, long long int cols, enum MATRIX_DType dtype);
+void _MATRIX_validate(long long int rows, long long int cols, enum MATRIX_DType dtype);
 void MATRIX_free(struct Matrix* matrix);
+struct Matrix* MATRIX_create_mapped(const char* path, long long int rows, long long int cols, enum MATRIX_DType dtype);
+struct Matrix* MATRIX_open_mapped(const char* path);
+struct Matrix* _MATRIX_map(const char* path, bool create, size_t size);
 long long int MATRIX_idx(long long int row, long long int col, struct Matrix* matrix);
+void MATRIX_set(struct Matrix* matrix, long long int idx, long long int value);
 void MATRIX_print(struct Matrix* matrix, FILE* fd);
+size_t MATRIX_dtype_size(enum MATRIX_DType dtype);
+const char* MATRIX_dtype_name(enum MATRIX_DType dtype);
+bool MATRIX_dtype_parse(const char* name, enum MATRIX_DType* dtype);
+struct MATRIX_View MATRIX_view(struct Matrix* matrix);
+struct MATRIX_View MATRIX_view_wrap(void* data, long long int rows, long long int cols, long long int ld, enum MATRIX_DType dtype);
+struct MATRIX_View MATRIX_view_block(struct MATRIX_View view, long long int row, long long int col, long long int rows, long long int cols);
+struct MATRIX_View MATRIX_view_transpose(struct MATRIX_View view);
+long long int MATRIX_view_row_stride(const struct MATRIX_View* view);
+long long int MATRIX_view_col_stride(const struct MATRIX_View* view);
 
-#include "matrix.c"
\ No newline at end of file
+#include "matrix.c"
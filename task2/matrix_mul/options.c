@@ -1,16 +1,177 @@
 #include "options.h"
 
+/**
+ * Complains about the arguments and exits
+*/
+void _OPTIONS_usage_error(char* program){
+    fprintf(stderr, "ERROR! Invalid arguments to `%s`. Expected usage: `%s matrix_order{number > 0} operations{number > 0} log_products{number != 0?} [--dtype={int32|int64|float|double}] [--seed=N] [--verify=N] [--counters={on|off}] [--log_format={binary|text}] [--scheduler={shared|stealing}] [--threads={N|auto}] [--pin={none|cores|threads}] [--trace=path] [--queue_capacity={power of 2 >= 2}] [--tiles_per_thread={N|auto}] [--min_tile_side=N] [--batch_work={N|auto}] [--strassen_cutoff={N|off}] [--shared_a={on|off}] [--stream={N >= 3|off}] [--chain=d0,d1,...,dn] [--power=k] [--density=P{0 < P <= 1}] [--sparse={auto|on|off}] [--mapped=dir] [--working_set=N]`\n", program, program);
+    exit(1);
+}
+
+/**
+ * Parses a positive count (or `auto` into OPTIONS_AUTO if allow_auto), returns false if the value is invalid
+*/
+bool _OPTIONS_parse_count(const char* value, bool allow_auto, long long int* count){
+    if (allow_auto && strcmp(value, "auto") == 0){
+        *count = OPTIONS_AUTO;
+        return true;
+    }
+    char* end;
+    *count = strtoll(value, &end, 10);
+    return *end == '\0' && *count > 0;
+}
+
+/**
+ * Sets a single named option (`--name=value`), returns false if the option is unknown or the value is invalid
+*/
+bool _OPTIONS_set_named(struct Options* options, const char* name, const char* value){
+    if (strcmp(name, "dtype") == 0) return MATRIX_dtype_parse(value, &options->dtype);
+    if (strcmp(name, "scheduler") == 0){
+        if (strcmp(value, "shared") == 0) options->scheduler = WP_SHARED_QUEUE;
+        else if (strcmp(value, "stealing") == 0) options->scheduler = WP_WORK_STEALING;
+        else return false;
+        return true;
+    }
+    if (strcmp(name, "threads") == 0){
+        if (strcmp(value, "auto") == 0){
+            options->threads = 0;
+            return true;
+        }
+        options->threads = atoi(value);
+        return options->threads > 0;
+    }
+    if (strcmp(name, "seed") == 0){
+        char* end;
+        options->seed = strtoull(value, &end, 10);
+        return *value != '\0' && *end == '\0';
+    }
+    if (strcmp(name, "verify") == 0){
+        char* end;
+        options->verify = strtoll(value, &end, 10);
+        return *value != '\0' && *end == '\0' && options->verify >= 0;
+    }
+    if (strcmp(name, "counters") == 0){
+        if (strcmp(value, "on") == 0) options->counters = true;
+        else if (strcmp(value, "off") == 0) options->counters = false;
+        else return false;
+        return true;
+    }
+    if (strcmp(name, "log_format") == 0){
+        if (strcmp(value, "binary") == 0) options->log_format = OPTIONS_LOG_BINARY;
+        else if (strcmp(value, "text") == 0) options->log_format = OPTIONS_LOG_TEXT;
+        else return false;
+        return true;
+    }
+    if (strcmp(name, "trace") == 0){
+        options->trace = value;
+        return *value != '\0';
+    }
+    if (strcmp(name, "pin") == 0) return TOPO_policy_parse(value, &options->pin);
+    if (strcmp(name, "queue_capacity") == 0){
+        if (!_OPTIONS_parse_count(value, false, &options->queue_capacity)) return false;
+        return options->queue_capacity >= 2 && (options->queue_capacity & (options->queue_capacity - 1)) == 0; // Has to be a power of 2 (>= 2)
+    }
+    if (strcmp(name, "tiles_per_thread") == 0) return _OPTIONS_parse_count(value, true, &options->tiles_per_thread);
+    if (strcmp(name, "min_tile_side") == 0) return _OPTIONS_parse_count(value, false, &options->min_tile_side);
+    if (strcmp(name, "batch_work") == 0) return _OPTIONS_parse_count(value, true, &options->batch_work);
+    if (strcmp(name, "strassen_cutoff") == 0){
+        if (strcmp(value, "off") == 0){
+            options->strassen_cutoff = OPTIONS_OFF;
+            return true;
+        }
+        return _OPTIONS_parse_count(value, false, &options->strassen_cutoff);
+    }
+    if (strcmp(name, "shared_a") == 0){
+        if (strcmp(value, "on") == 0) options->shared_a = true;
+        else if (strcmp(value, "off") == 0) options->shared_a = false;
+        else return false;
+        return true;
+    }
+    if (strcmp(name, "chain") == 0){
+        options->chain = value;
+        return *value != '\0';
+    }
+    if (strcmp(name, "power") == 0) return _OPTIONS_parse_count(value, false, &options->power);
+    if (strcmp(name, "density") == 0){
+        char* end;
+        options->density = strtod(value, &end);
+        return *value != '\0' && *end == '\0' && options->density > 0 && options->density <= 1;
+    }
+    if (strcmp(name, "sparse") == 0){
+        if (strcmp(value, "auto") == 0) options->sparse = OPTIONS_SPARSE_AUTO;
+        else if (strcmp(value, "on") == 0) options->sparse = OPTIONS_SPARSE_ON;
+        else if (strcmp(value, "off") == 0) options->sparse = OPTIONS_SPARSE_OFF;
+        else return false;
+        return true;
+    }
+    if (strcmp(name, "mapped") == 0){
+        options->mapped = value;
+        return *value != '\0';
+    }
+    if (strcmp(name, "working_set") == 0) return _OPTIONS_parse_count(value, false, &options->working_set);
+    if (strcmp(name, "stream") == 0){
+        if (strcmp(value, "off") == 0){
+            options->stream = OPTIONS_OFF;
+            return true;
+        }
+        return _OPTIONS_parse_count(value, false, &options->stream) && options->stream >= 3; // Fill, multiply and consume each need a slot
+    }
+    return false;
+}
+
 /**
  * Sets options based on command line arguments
  * RAISES: Exits on invalid arguments
 */
 void OPTIONS_set(struct Options* options, int argc, char* argv[]){
-    options->matrix_order = (argc > 1)? atoi(argv[1]) : 0;
-    options->operations   = (argc > 2)? atoi(argv[2]) : 1;
-    options->log_products = (argc > 3)? atoi(argv[3]) : false;
+    options->matrix_order = 0;
+    options->operations   = 1;
+    options->log_products = false;
+    options->log_format   = OPTIONS_LOG_TEXT;
+    options->dtype        = MATRIX_INT64;
+    options->seed         = time(NULL);
+    options->verify       = 0;
+    options->counters     = false;
+    options->scheduler    = WP_SHARED_QUEUE;
+    options->threads      = 0;
+    options->pin          = TOPO_PIN_NONE;
+    options->trace        = NULL;
+    options->queue_capacity   = 0;
+    options->tiles_per_thread = 0;
+    options->min_tile_side    = 0;
+    options->batch_work       = 0;
+    options->strassen_cutoff  = 0;
+    options->shared_a         = false;
+    options->chain            = NULL;
+    options->power            = 0;
+    options->density          = 1;
+    options->sparse           = OPTIONS_SPARSE_AUTO;
+    options->mapped           = NULL;
+    options->working_set      = 0;
+    options->stream           = OPTIONS_OFF;
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i){
+        if (strncmp(argv[i], "--", 2) == 0){ // Named option
+            char name[64];
+            const char* value = strchr(argv[i], '=');
+            size_t name_length = (value == NULL)? strlen(argv[i] + 2) : (size_t)(value - argv[i] - 2);
+            if (value == NULL || name_length >= sizeof(name)) _OPTIONS_usage_error(argv[0]);
+            
+            memcpy(name, argv[i] + 2, name_length); name[name_length] = '\0';
+            if (!_OPTIONS_set_named(options, name, value + 1)) _OPTIONS_usage_error(argv[0]);
+            continue;
+        }
+
+        switch (positional++){
+        case 0: options->matrix_order = atoi(argv[i]); break;
+        case 1: options->operations   = atoi(argv[i]); break;
+        case 2: options->log_products = atoi(argv[i]); break;
+        default: _OPTIONS_usage_error(argv[0]);
+        }
+    }
     
     if (options->matrix_order <= 0 || options->operations <= 0){
-        fprintf(stderr, "ERROR! Invalid arguments to `%s`. Expected usage: `%s matrix_order{number > 0} operations{number > 0} log_products{number != 0?}`\n", argv[0], argv[0]);
-        exit(1);
+        _OPTIONS_usage_error(argv[0]);
     }
-}
\ No newline at end of file
+}
@@ -4,18 +4,67 @@
  * 
  * Provides definitions for parsing options set by command line arguments
  * 
+ * Positional arguments come first, anything of the form `--name=value` after them is a named option
+ * 
 */ 
 
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "matrix.h"
+#include "worker_pool.h"
+
+enum OPTIONS_LogFormat{
+    OPTIONS_LOG_BINARY, // Raw headers + data, see binlog.h (read it back with logread)
+    OPTIONS_LOG_TEXT, // Every element printed with MATRIX_print (what check_answers.py reads)
+};
+
+enum OPTIONS_Sparse{
+    OPTIONS_SPARSE_AUTO, // Multiply as sparse when the density heuristic says so (see SPARSE_is_sparse)
+    OPTIONS_SPARSE_ON, // Always multiply as sparse
+    OPTIONS_SPARSE_OFF, // Never multiply as sparse
+};
+
+// Value a tunable option is set to when it should be picked by calibration at startup (`--name=auto`)
+#define OPTIONS_AUTO -1
+// Value an option that can be turned off is set to when it is (`--name=off`)
+#define OPTIONS_OFF -2
 
 struct Options{
     long long int matrix_order; // The order of the square matrix that is multiplied, it is a required argument 
     long long int operations; // The number of multiplications to do, set to 1 if the second argument is not provided
     bool log_products; // Set to true if the user inputs a number != 0 as the third argument
+    enum OPTIONS_LogFormat log_format; // How products are logged (`--log_format=binary|text`, defaults to text)
+    long long int verify; // Rounds of Freivalds' check run on every product after the (timed) multiplications (`--verify=N`, defaults to 0 which is off)
+    bool counters; // Print hardware performance counters for the timed multiplications next to the time (`--counters=on|off`, defaults to off)
+    enum MATRIX_DType dtype; // The element type of every matrix (`--dtype=int32|int64|float|double`, defaults to int64)
+    unsigned long long int seed; // Seed the operands are generated from, the same seed gives the same operands (`--seed=N`, defaults to the current time)
+    enum WP_Mode scheduler; // How the worker pool hands out tasks (`--scheduler=shared|stealing`, defaults to shared, parallel only)
+    int threads; // Number of worker threads (`--threads=N|auto`, defaults to auto which is one per core/cpu depending on pin, parallel only)
+    const char* trace; // Path to write a Chrome trace of the worker pool to (`--trace=path`, defaults to NULL which is off, parallel only)
+    enum TOPO_Policy pin; // Which cpus the workers get pinned to (`--pin=none|cores|threads`, defaults to none, parallel only)
+
+    // Task granularity and queue sizing (parallel only), 0 means the built in default and OPTIONS_AUTO means calibrate at startup
+    long long int queue_capacity; // Slots in each of the worker pool's queues (`--queue_capacity=N`, a power of 2 >= 2)
+    long long int tiles_per_thread; // How many tiles each product is split into per worker (`--tiles_per_thread=N|auto`)
+    long long int min_tile_side; // The smallest tile side (`--min_tile_side=N`)
+    long long int batch_work; // Multiply-adds worth of small products per batched task (`--batch_work=N|auto`)
+    long long int strassen_cutoff; // Products with every dimension bigger than this use Strassen-Winograd (`--strassen_cutoff=N|off`, sequential too)
+    bool shared_a; // Every operation multiplies the same A (operation 0's) by its own B, A gets packed once (`--shared_a=on|off`, defaults to off, parallel only)
+    const char* chain; // Dimensions of a chain product to compute instead (`--chain=d0,d1,...,dn`, defaults to NULL which is off, parallel only, see chain.h)
+    long long int power; // Power of the matrix_order x matrix_order A to compute instead (`--power=k`, defaults to 0 which is off, parallel only, see chain.h)
+    double density; // Fraction of the operand elements that are nonzero, the rest are zeroed at random (`--density=P` with 0 < P <= 1, defaults to 1 which leaves them all)
+    enum OPTIONS_Sparse sparse; // When As get multiplied as sparse matrices (`--sparse=auto|on|off`, defaults to auto, parallel only, see sparse.h)
+    const char* mapped; // Directory the operands and products are kept in as files instead of in memory (`--mapped=dir`, defaults to NULL which is off, see mapped.h)
+    long long int working_set; // Megabytes of the mapped matrices an out-of-core multiply keeps mapped at once (`--working_set=N`, 0 means MAPPED_WORKING_SET)
+    long long int stream; // Pipeline depth (chunks of operations in memory at once) when streaming (`--stream=N|off`, defaults to off, parallel only, see stream_multiplications)
 };
 void OPTIONS_set(struct Options* options, int argc, char* argv[]);
+void _OPTIONS_usage_error(char* program);
+bool _OPTIONS_set_named(struct Options* options, const char* name, const char* value);
+bool _OPTIONS_parse_count(const char* value, bool allow_auto, long long int* count);
 
-#include "options.c"
\ No newline at end of file
+#include "options.c"
@@ -8,12 +8,42 @@
  *  matrix_order{number > 0}
  *  operations{number > 0}
  *  log_products{number != 0?}
+ *  --dtype={int32|int64|float|double} (optional, defaults to int64)
+ *  --seed=N (optional, defaults to the current time)
+ *  --counters={on|off} (optional, defaults to off, counts cycles, instructions and cache/TLB misses of the timed multiplications)
+ *  --log_format={binary|text} (optional, defaults to text, binary logs are written by the pool)
+ *  --verify=N (optional, runs N rounds of Freivalds' check on every product on the pool, exits with an error if any is wrong)
+ *  --scheduler={shared|stealing} (optional, defaults to shared)
+ *  --threads={N|auto} (optional, defaults to auto: one thread per usable cpu, or per physical core with --pin=cores)
+ *  --pin={none|cores|threads} (optional, defaults to none)
+ *  --trace=path (optional, writes a Chrome trace_event json of what every thread did to path, see trace.h)
+ *  --queue_capacity={power of 2 >= 2} (optional, slots in each of the worker pool's queues)
+ *  --tiles_per_thread={N|auto}, --min_tile_side=N, --batch_work={N|auto} (optional, task granularity, see the TASK_ defaults)
+ *  --strassen_cutoff={N|off} (optional, defaults to STRASSEN_CUTOFF, products with every dimension bigger than this use Strassen-Winograd)
+ *  --shared_a={on|off} (optional, defaults to off, every operation multiplies operation 0's A by its own B, A is packed once for all of them)
+ *  --stream={N >= 3|off} (optional, defaults to off, streams the operations through N chunks worth of recycled matrices instead of
+ *                         allocating all of them up front, see stream_multiplications, logs need --log_format=binary, auto granularity isn't calibrated)
+ *  --density=P (optional, defaults to 1, zeroes all but about P (0 < P <= 1) of the operand elements at random, same seed same zeros)
+ *  --sparse={auto|on|off} (optional, defaults to auto: As with at most SPARSE_MAX_DENSITY nonzeros are converted to CSR and multiplied
+ *                          by the sparse kernels, Bs too if they are that sparse, products smaller than SPARSE_MIN_ORDER stay dense,
+ *                          see use_sparse and request_sparse_multiplications)
+ *  --mapped=dir (optional, keeps every matrix in a file under dir (a_i.mat, b_i.mat and c_i.mat, left behind) instead of in memory and
+ *                multiplies them out-of-core, see mapped.h, can't be combined with --stream, --chain or --power)
+ *  --working_set=N (optional, defaults to MAPPED_WORKING_SET, megabytes of the mapped matrices kept mapped at once by --mapped)
+ *  --chain=d0,d1,...,dn (optional, multiplies a chain of n random matrices, the i'th being d(i-1) x d(i), in the cheapest order instead)
+ *  --power=k (optional, raises a random matrix_order x matrix_order matrix to the k'th power by repeated squaring instead)
+ *     (both of these ignore operations, verify every sub product as they go and don't log, see chain.h)
  * 
  * Outputs:
  *  stdout:
- *      Time elapsed: {time}ms
- *  PRODUCTS_LOG_FILE: (only if options.log_products is true)
+ *      Time elapsed: {time}ms (with --stream this includes generating, verifying and logging, which overlap the multiplications)
+ *      Counters: ... (only with --counters=on, one line per thread and a total)
+ *      Checksum: {hex} (only with --stream, the sum of checksum_matrix of every product)
+ *      Chain: ... (only with --chain/--power, the products done and the multiply-adds they took compared to going left to right)
+ *  PRODUCTS_LOG_FILE: (only if options.log_products is true, text by default)
  *      Outputs the matrices multiplied and the product obtained
+ *  PRODUCTS_BINLOG_FILE: (only if options.log_products is true and --log_format=binary, see binlog.h)
+ *      Same as PRODUCTS_LOG_FILE but raw (read it with logread)
  * 
 */ 
 
@@ -25,53 +55,94 @@
 #include "options.h"
 #include "common.h"
 #include "worker_pool.h"
+#include "kernel.h"
+#include "binlog.h"
+#include "perf.h"
+#include "tasks.h"
+#include "chain.h"
 
 #define PRODUCTS_LOG_FILE "matrix_mul_par.log"
-
-// Too small and the threads wait a lot more causing bad performance and too big causes it to become basically sequential (balance is key)
-#define TASK_CHUNK_SIZE 1000
-// I've got 6 cours so my best performance would be with 12 threads (Anything more really doesn't improve performance) but having just a few more threads has negligible downsides
-#define WORKER_POOL_THREAD_COUNT 16
+#define PRODUCTS_BINLOG_FILE "matrix_mul_par.bin"
 
 #pragma region Business Logix
-struct MultiplicationTask{
-    struct Matrix* op1; // The premultiplicand
-    struct Matrix* op2; // The postmultiplicand
-    struct Matrix* res; // The matrix in which the product is to be stored
-    long long int start_idx; // The start of the chunk that this task is supposed to compute
-    long long int end_idx; // The end of the chunk that this task is supposed to compute
-};
-
-void sub_multiplication_handler(void* task);
-void request_multiplication(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct WorkerPool* worker_pool);
+void run_streamed(struct Options* options);
+void run_chain(struct Options* options);
+void finish_worker_pool(struct WorkerPool* worker_pool);
 #pragma endregion
 
 int main(int argc, char* argv[]){
-    srand(time(NULL));
     struct Options options; OPTIONS_set(&options, argc, argv);
+    KERNEL_init(); // Pick the fastest micro kernel this cpu supports
 
-    // Create matrices for doing multiplication
-    struct Matrix** operand_as = create_matrix_array(options.operations, options.matrix_order, options.matrix_order);
-    struct Matrix** operand_bs = create_matrix_array(options.operations, options.matrix_order, options.matrix_order);
-    struct Matrix** products   = create_matrix_array(options.operations, options.matrix_order, options.matrix_order);
-    
-    // Fill the operand matrices with random values
-    init_operand(operand_as, options.operations); init_operand(operand_bs, options.operations);
+    if (options.stream != OPTIONS_OFF){ // Bounded memory, see stream_multiplications
+        run_streamed(&options);
+        return 0;
+    }
+    if (options.chain != NULL || options.power > 0){ // A single chain product or power, see chain.h
+        run_chain(&options);
+        return 0;
+    }
+
+    // Create matrices for doing multiplication (in files under options.mapped with --mapped, see request_mapped_multiplications)
+    // With --shared_a there is only one A and every entry of operand_as points at it (so logging and verifying don't need to care)
+    long long int a_count = options.shared_a? 1 : options.operations;
+    struct Matrix** a_storage  = create_mapped_matrix_array(options.mapped, "a", a_count, options.matrix_order, options.matrix_order, options.dtype);
+    struct Matrix** operand_as = options.shared_a? repeat_matrix(a_storage[0], options.operations) : a_storage;
+    struct Matrix** operand_bs = create_mapped_matrix_array(options.mapped, "b", options.operations, options.matrix_order, options.matrix_order, options.dtype);
+    struct Matrix** products   = create_mapped_matrix_array(options.mapped, "c", options.operations, options.matrix_order, options.matrix_order, options.dtype);
     
-    // Spawn a bunch of threads that all do the sub_multiplication
-    struct WorkerPool* worker_pool = WP_create(sub_multiplication_handler, WORKER_POOL_THREAD_COUNT);
+    if (options.trace != NULL) TRACE_enable(options.trace); // Written out by WP_join
 
-    long long int start = time_ms();
-    for (long long int i = 0; i < options.operations; ++i){
-        request_multiplication(operand_as[i], operand_bs[i], products[i], worker_pool);
+    // Spawn a bunch of threads that all do the sub_multiplication (sized and pinned according to the cpu layout)
+    struct WorkerPool* worker_pool = create_worker_pool(&options);
+
+    // Fill the operand matrices with random values (on the pool, the result only depends on the seed)
+    request_init_operand(a_storage, a_count, RNG_stream(options.seed, OPERAND_A_STREAM), options.density, worker_pool);
+    request_init_operand(operand_bs, options.operations, RNG_stream(options.seed, OPERAND_B_STREAM), options.density, worker_pool);
+    WP_wait_idle(worker_pool);
+
+    // The operands can go into the binary log right away (the products follow once they are done)
+    struct BinLog* log = NULL;
+    if (options.log_products && options.log_format == OPTIONS_LOG_BINARY){
+        log = BINLOG_create(PRODUCTS_BINLOG_FILE, options.operations, options.matrix_order, options.matrix_order, options.dtype);
+        request_log(log, 0, operand_as, options.operations, worker_pool);
+        request_log(log, 1, operand_bs, options.operations, worker_pool);
+        WP_wait_idle(worker_pool);
     }
-    WP_request_stop(worker_pool); // Request all threads to finish
-    WP_join(worker_pool); // Waits for all threads to finish
+
+    // Fill in the default task granularity (and calibrate whatever was asked to be picked automatically, this isn't timed)
+    autotune_granularity(&options, operand_as, operand_bs, products, worker_pool);
+
+    if (options.counters) PERF_enable();
+    PERF_reset(); // Whatever got counted during calibration doesn't count
+
+    long long int start = time_ms();
+    long long int trace_start = TRACE_now();
+    request_multiplications(operand_as, operand_bs, products, options.operations, worker_pool, &options);
+    TRACE_span("request_multiplications", trace_start);
+    WP_wait_idle(worker_pool); // Waits for every multiplication to finish (the threads stay alive, so tearing them down isn't timed)
     long long int end = time_ms();
     
     printf("Time elapsed: %ldms\n", end - start);
+    if (options.counters) PERF_print(stdout);
+
+    // Freivalds' check on every product (on the pool, not timed)
+    long long int failure = verify_products(operand_as, operand_bs, products, options.operations, &options, worker_pool);
+    if (failure >= 0){
+        fprintf(stderr, "ERROR! Product %lld failed verification\n", failure);
+        exit(1);
+    }
+
+    if (log != NULL){ // Stores the results of multiplications in PRODUCTS_BINLOG_FILE (copied in by the pool)
+        request_log(log, 2, products, options.operations, worker_pool);
+        WP_wait_idle(worker_pool);
+        BINLOG_close(log);
+    }
+
+    finish_worker_pool(worker_pool);
+    PERF_free();
 
-    if (options.log_products){ // Stores the results of multiplications in PRODUCTS_LOG_FILE
+    if (options.log_products && options.log_format == OPTIONS_LOG_TEXT){ // Stores the results of multiplications in PRODUCTS_LOG_FILE
         FILE* log_file = fopen(PRODUCTS_LOG_FILE, "w");
 
         for (long long int i = 0; i < options.operations; ++i){
@@ -83,79 +154,156 @@ int main(int argc, char* argv[]){
         fclose(log_file);
     }
 
-    // Just some sanity checks to make sure my worker_pool logic is not fucked
-    if (worker_pool->arg->queue->dispatched != 0){
-        fprintf(stderr, "ERROR! Core logic issue, there are still %d dispatched tasks\n", worker_pool->arg->queue->dispatched);
+    // Free the data :)
+    if (options.shared_a) free(operand_as);
+    free_matrix_array(a_storage , a_count);
+    free_matrix_array(operand_bs, options.operations);
+    free_matrix_array(products  , options.operations);
+}
+
+#pragma region Business Logix Impl
+/**
+ * Does the whole run streamed (see stream_multiplications), so only options->stream chunks of operations are ever in memory
+ * The products are verified, logged (binary only) and checksummed as they finish, so unlike main all of that is timed
+ * RAISES: Exits if a text log (or --shared_a or --mapped) was asked for or if any product fails verification
+*/
+void run_streamed(struct Options* options){
+    if (options->shared_a || options->mapped != NULL){
+        fprintf(stderr, "ERROR! --stream can't be combined with --shared_a or --mapped\n");
         exit(1);
     }
-    if (worker_pool->arg->queue->live_chunk_count != 1){
-        fprintf(stderr, "ERROR! Core logic issue, there are still %d live chunks\n", worker_pool->arg->queue->live_chunk_count);
+    if (options->log_products && options->log_format != OPTIONS_LOG_BINARY){
+        fprintf(stderr, "ERROR! --stream can only log products with --log_format=binary\n");
         exit(1);
     }
-    if (worker_pool->arg->queue->back->filled != worker_pool->arg->queue->back->next){
-        fprintf(stderr, "ERROR! Core logic issue, there are still %d undispatched tasks\n", worker_pool->arg->queue->back->filled - worker_pool->arg->queue->back->next);
-        exit(1);
+    if (options->trace != NULL) TRACE_enable(options->trace); // Written out by WP_join
+
+    struct WorkerPool* worker_pool = create_worker_pool(options);
+
+    // There are no operands around before the run to calibrate with, so auto just means the defaults
+    if (options->tiles_per_thread == OPTIONS_AUTO) options->tiles_per_thread = 0;
+    if (options->batch_work == OPTIONS_AUTO) options->batch_work = 0;
+    resolve_granularity(options);
+
+    struct BinLog* log = NULL;
+    if (options->log_products){
+        log = BINLOG_create(PRODUCTS_BINLOG_FILE, options->operations, options->matrix_order, options->matrix_order, options->dtype);
     }
 
-    // Free the data :)
-    WP_free(worker_pool);
+    if (options->counters) PERF_enable();
 
-    free_matrix_array(operand_as, options.operations);
-    free_matrix_array(operand_bs, options.operations);
-    free_matrix_array(products  , options.operations);
-}
+    uint64_t checksum;
+    long long int start = time_ms();
+    long long int trace_start = TRACE_now();
+    long long int failure = stream_multiplications(options, worker_pool, log, &checksum);
+    TRACE_span("stream_multiplications", trace_start);
+    long long int end = time_ms();
 
-#pragma region Business Logix Impl
+    printf("Time elapsed: %ldms\n", end - start);
+    if (options->counters) PERF_print(stdout);
+    printf("Checksum: %016llx\n", (unsigned long long int)checksum);
 
-/**
- * Handles part of the matrix multiplication (To be run in parallel)
- * This basically calculates the result of some cells of the product matrix
-*/
-void sub_multiplication_handler(void* vtask){
-    struct MultiplicationTask* task = vtask;
-
-    long long int row = task->start_idx / task->res->cols;
-    long long int col = task->start_idx % task->res->cols;
-    for (long long int idx = task->start_idx; idx < task->end_idx; ++idx){
-        task->res->data[idx] = 0;
-        for (long long int k = 0; k < task->op1->cols; ++k){ // Just your standard matrix multiplication again
-            task->res->data[idx] += task->op1->data[MATRIX_idx(row, k, task->op1)] * task->op2->data[MATRIX_idx(k, col, task->op2)];
-        }
-        ++col;
-        if (col == task->res->cols){
-            col = 0;
-            ++row;
-        }
+    if (failure >= 0){
+        fprintf(stderr, "ERROR! Product %lld failed verification\n", failure);
+        exit(1);
     }
+    if (log != NULL) BINLOG_close(log);
+
+    finish_worker_pool(worker_pool);
+    PERF_free();
 }
 
 /**
- * Enqueues the multiplication operation to the worker pool
- * RAISES: Exits if the matrices provided are not of correct dimensions or if could not allocate memory describe the task
+ * Computes a chain product (options->chain) or a power (options->power) of random matrices on the pool (see chain.h)
+ * The operands are generated before the timed region, the sub products (and their verification, if asked for) are timed
+ * NOTE: With floating point dtypes high powers overflow to inf quickly (the operands go up to 5 in magnitude), and verification fails then
+ * RAISES: Exits if the options don't make sense for a chain or if any product fails verification
 */
-void request_multiplication(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct WorkerPool* worker_pool){
-    if (operand_a->cols != operand_b->rows || operand_a->rows != product->rows || operand_b->cols != product->cols){
-        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+void run_chain(struct Options* options){
+    if ((options->chain != NULL && options->power > 0) || options->log_products || options->shared_a || options->stream != OPTIONS_OFF || options->mapped != NULL){
+        fprintf(stderr, "ERROR! --chain/--power can't be combined with each other, --shared_a, --stream, --mapped or logging products\n");
         exit(1);
     }
+    long long int count = 1;
+    long long int* dims = NULL;
+    if (options->chain != NULL && (dims = CHAIN_parse_dims(options->chain, &count)) == NULL){
+        fprintf(stderr, "ERROR! Invalid chain `%s` (expected d0,d1,...,dn with every d > 0)\n", options->chain);
+        exit(1);
+    }
+    if (options->trace != NULL) TRACE_enable(options->trace); // Written out by WP_join
 
-    long long int max_idx =  product->cols * product->rows;
-    for (long long int idx = 0; idx < max_idx; idx += TASK_CHUNK_SIZE){
-        struct MultiplicationTask* task = malloc(sizeof(struct MultiplicationTask));
-        if (task == NULL){
-            fprintf(stderr, "ERROR! Could not allocate memory for queueing task\n");
-            exit(1);   
-        }
-        task->op1 = operand_a;
-        task->op2 = operand_b;
-        task->res = product;
-        task->start_idx = idx;
+    struct WorkerPool* worker_pool = create_worker_pool(options);
+    if (options->tiles_per_thread == OPTIONS_AUTO) options->tiles_per_thread = 0; // Nothing to calibrate with, like run_streamed
+    if (options->batch_work == OPTIONS_AUTO) options->batch_work = 0;
+    resolve_granularity(options);
+
+    // Operand i comes from its own stream of the seed (a power's single operand is the same A as operation 0's of a regular run)
+    struct Matrix** operands = malloc(count * sizeof(struct Matrix*));
+    if (operands == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the chain\n");
+        exit(1);
+    }
+    for (long long int i = 0; i < count; ++i){
+        long long int rows = (dims != NULL)? dims[i] : options->matrix_order, cols = (dims != NULL)? dims[i + 1] : options->matrix_order;
+        uint64_t seed = (dims != NULL)? RNG_stream(RNG_stream(options->seed, CHAIN_STREAM), i) : RNG_stream(options->seed, OPERAND_A_STREAM);
+        operands[i] = MATRIX_create(rows, cols, options->dtype);
+        request_init_operand(operands + i, 1, seed, options->density, worker_pool);
+    }
+    WP_wait_idle(worker_pool);
+
+    struct CHAIN_Graph graph;
+    CHAIN_init(&graph);
+    long long int naive_cost;
+    if (dims != NULL){
+        CHAIN_build_chain(&graph, operands, count);
+        naive_cost = CHAIN_left_to_right_cost(dims, count);
+    } else{
+        CHAIN_build_power(&graph, operands[0], options->power);
+        naive_cost = (options->power - 1) * options->matrix_order * options->matrix_order * options->matrix_order;
+    }
+    struct CHAIN_Buffers buffers;
+    CHAIN_buffers_init(&buffers);
+
+    if (options->counters) PERF_enable();
 
-        // I should probably remove the ternary by just moving addition of last chunk outside the loop
-        // But this looks cleaner (full trust vro)
-        task->end_idx = (max_idx - idx >= TASK_CHUNK_SIZE)? (idx + TASK_CHUNK_SIZE) : max_idx;
-        
-        WP_enqueue_task(worker_pool, (void*) task);
+    long long int start = time_ms();
+    long long int trace_start = TRACE_now();
+    CHAIN_evaluate(&graph, &buffers, worker_pool, options);
+    TRACE_span("CHAIN_evaluate", trace_start);
+    long long int end = time_ms();
+
+    printf("Time elapsed: %ldms\n", end - start);
+    if (options->counters) PERF_print(stdout);
+    printf("Chain: %lld products, %lld multiply-adds (%lld left to right), %lld buffers\n", graph.count - (dims != NULL? count : 1), graph.cost, naive_cost, buffers.count);
+
+    finish_worker_pool(worker_pool);
+    PERF_free();
+
+    CHAIN_buffers_free(&buffers);
+    CHAIN_free(&graph);
+    for (long long int i = 0; i < count; ++i) MATRIX_free(operands[i]);
+    free(operands);
+    free(dims);
+}
+
+/**
+ * Stops and joins the worker threads, checks that no task got lost along the way and frees the pool
+ * RAISES: Exits if there are tasks left over
+*/
+void finish_worker_pool(struct WorkerPool* worker_pool){
+    WP_request_stop(worker_pool); // Request all threads to finish
+    WP_join(worker_pool); // Waits for all threads to finish
+
+    // Just some sanity checks to make sure my worker_pool logic is not fucked
+    if (WP_dispatched_tasks(worker_pool) != 0){
+        fprintf(stderr, "ERROR! Core logic issue, there are still %lld dispatched tasks\n", WP_dispatched_tasks(worker_pool));
+        exit(1);
     }
+    if (WP_pending_tasks(worker_pool) != 0){
+        fprintf(stderr, "ERROR! Core logic issue, there are still %lld undispatched tasks\n", WP_pending_tasks(worker_pool));
+        exit(1);
+    }
+
+    WP_free(worker_pool);
 }
 #pragma endregion
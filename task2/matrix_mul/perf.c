@@ -0,0 +1,203 @@
+#include "perf.h"
+
+bool PERF_enabled = false;
+
+// The counters of the current thread (NULL until it first calls PERF_begin)
+static _Thread_local struct PERF_Thread* _PERF_current = NULL;
+// Every thread that has counters, sorted by label (only touched under _PERF_mutex, except by PERF_print/PERF_reset)
+static struct PERF_Thread* _PERF_threads = NULL;
+static pthread_mutex_t _PERF_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* _PERF_names[PERF_EVENT_COUNT] = {"cycles", "instructions", "L1d misses", "LLC misses", "dTLB misses"};
+
+/**
+ * Turns on counting for every PERF_begin/PERF_end from now on
+*/
+void PERF_enable(){
+    PERF_enabled = true;
+}
+
+/**
+ * Opens a counter for an event on the calling thread (user space only, counting from now on)
+ * Returns the fd, or -1 if the event can't be counted here
+*/
+int _PERF_open(enum PERF_Event event){
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1; // So that perf_event_paranoid <= 2 lets us count
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event){
+    case PERF_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case PERF_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_LLC_MISSES:
+        attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break; // The kernel maps this to the last level cache
+    case PERF_DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        fprintf(stderr, "UNREACHABLE! Unknown perf event %d\n", event);
+        exit(1);
+    }
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0); // This thread, on any cpu, no group
+#else
+    return -1;
+#endif
+}
+
+/**
+ * Reads a counter (value, time enabled, time running), returns false if it couldn't be read
+*/
+bool _PERF_read(int fd, unsigned long long int reading[3]){
+#ifdef __linux__
+    return fd >= 0 && read(fd, reading, 3 * sizeof(unsigned long long int)) == 3 * sizeof(unsigned long long int);
+#else
+    return false;
+#endif
+}
+
+/**
+ * Gets the calling thread's counters, opening and registering them the first time
+ * RAISES: Exits if could not allocate memory
+*/
+struct PERF_Thread* _PERF_thread(int label){
+    if (_PERF_current != NULL) return _PERF_current;
+
+    struct PERF_Thread* thread = malloc(sizeof(struct PERF_Thread));
+    if (thread == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for perf counters\n");
+        exit(1);
+    }
+    thread->label = label;
+    thread->total.sections = 0;
+    for (int event = 0; event < PERF_EVENT_COUNT; ++event){
+        thread->fds[event] = _PERF_open(event);
+        thread->total.values[event] = (thread->fds[event] >= 0)? 0 : -1;
+    }
+
+    pthread_mutex_lock(&_PERF_mutex);
+    struct PERF_Thread** link = &_PERF_threads;
+    while (*link != NULL && (*link)->label <= label) link = &(*link)->next;
+    thread->next = *link;
+    *link = thread;
+    pthread_mutex_unlock(&_PERF_mutex);
+
+    _PERF_current = thread;
+    return thread;
+}
+
+/**
+ * Starts counting a section of work on the calling thread (label is what the thread is printed as, only used the first time)
+ * NOTE: Does nothing unless PERF_enabled
+*/
+void PERF_begin(int label){
+    if (!PERF_enabled) return;
+    struct PERF_Thread* thread = _PERF_thread(label);
+    for (int event = 0; event < PERF_EVENT_COUNT; ++event){
+        if (!_PERF_read(thread->fds[event], thread->start[event])) thread->start[event][0] = 0;
+    }
+}
+
+/**
+ * Adds whatever was counted since the calling thread's PERF_begin to its totals
+*/
+void PERF_end(){
+    if (!PERF_enabled || _PERF_current == NULL) return;
+    struct PERF_Thread* thread = _PERF_current;
+    for (int event = 0; event < PERF_EVENT_COUNT; ++event){
+        unsigned long long int now[3];
+        if (!_PERF_read(thread->fds[event], now)) continue;
+
+        double delta = now[0] - thread->start[event][0];
+        unsigned long long int enabled = now[1] - thread->start[event][1];
+        unsigned long long int running = now[2] - thread->start[event][2];
+        if (running > 0 && running < enabled) delta = delta * enabled / running; // Multiplexed, extrapolate
+        thread->total.values[event] += (long long int)delta;
+    }
+    ++thread->total.sections;
+}
+
+/**
+ * Zeroes every thread's totals
+ * NOTE: Only call this while no thread is between PERF_begin and PERF_end (e.g. right after WP_wait_idle)
+*/
+void PERF_reset(){
+    pthread_mutex_lock(&_PERF_mutex);
+    for (struct PERF_Thread* thread = _PERF_threads; thread != NULL; thread = thread->next){
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event){
+            thread->total.values[event] = (thread->fds[event] >= 0)? 0 : -1;
+        }
+        thread->total.sections = 0;
+    }
+    pthread_mutex_unlock(&_PERF_mutex);
+}
+
+/**
+ * Prints the totals of every thread (one line each, then their sum)
+ * NOTE: Only call this while no thread is between PERF_begin and PERF_end (e.g. right after WP_wait_idle)
+*/
+void PERF_print(FILE* fd){
+    fprintf(fd, "Counters: %-10s", "thread");
+    for (int event = 0; event < PERF_EVENT_COUNT; ++event) fprintf(fd, " %15s", _PERF_names[event]);
+    fprintf(fd, " %6s %10s\n", "IPC", "sections");
+
+    struct PERF_Counters sum = {0};
+    pthread_mutex_lock(&_PERF_mutex);
+    for (struct PERF_Thread* thread = _PERF_threads; ; thread = thread->next){
+        struct PERF_Counters* counters = (thread != NULL)? &thread->total : &sum;
+        char label[32];
+        if (thread == NULL) snprintf(label, sizeof(label), "total");
+        else if (thread->label < 0) snprintf(label, sizeof(label), "main");
+        else snprintf(label, sizeof(label), "worker %d", thread->label);
+
+        fprintf(fd, "          %-10s", label);
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event){
+            if (counters->values[event] < 0) fprintf(fd, " %15s", "n/a");
+            else fprintf(fd, " %15lld", counters->values[event]);
+        }
+        if (counters->values[PERF_CYCLES] > 0 && counters->values[PERF_INSTRUCTIONS] >= 0){
+            fprintf(fd, " %6.2f", (double)counters->values[PERF_INSTRUCTIONS] / counters->values[PERF_CYCLES]);
+        } else{
+            fprintf(fd, " %6s", "n/a");
+        }
+        fprintf(fd, " %10lld\n", counters->sections);
+        if (thread == NULL) break;
+
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event){ // An event is only summed if every thread could count it
+            if (sum.values[event] < 0 || counters->values[event] < 0) sum.values[event] = -1;
+            else sum.values[event] += counters->values[event];
+        }
+        sum.sections += counters->sections;
+    }
+    pthread_mutex_unlock(&_PERF_mutex);
+}
+
+/**
+ * Closes every thread's counters and forgets them
+ * NOTE: Call this after the worker threads have been joined
+*/
+void PERF_free(){
+    pthread_mutex_lock(&_PERF_mutex);
+    while (_PERF_threads != NULL){
+        struct PERF_Thread* thread = _PERF_threads;
+        _PERF_threads = thread->next;
+#ifdef __linux__
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event){
+            if (thread->fds[event] >= 0) close(thread->fds[event]);
+        }
+#endif
+        free(thread);
+    }
+    pthread_mutex_unlock(&_PERF_mutex);
+    _PERF_current = NULL;
+}
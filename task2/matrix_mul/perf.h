@@ -0,0 +1,63 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Provides optional hardware performance counters (cycles, instructions, L1d/LLC/dTLB misses) via perf_event_open
+ *
+ * Every thread that calls PERF_begin gets its own counters (counting only that thread, user space only), PERF_end adds
+ * whatever was counted since the matching PERF_begin to the thread's totals, and PERF_print prints the totals of every
+ * thread (and their sum) once the work is done
+ * NOTE: Counters the kernel won't give us (no PMU in a VM, perf_event_paranoid too high, ...) just print as n/a,
+ *       and anywhere but linux nothing is counted at all
+ * NOTE: Counts are scaled up when the kernel had to multiplex the counters (time enabled / time running)
+ *
+*/
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+enum PERF_Event{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES, // L1 data cache read misses
+    PERF_LLC_MISSES, // Last level cache misses
+    PERF_DTLB_MISSES, // Data TLB read misses
+    PERF_EVENT_COUNT
+};
+
+struct PERF_Counters{
+    long long int values[PERF_EVENT_COUNT]; // -1 if the event could not be counted
+    long long int sections; // Number of PERF_begin/PERF_end pairs counted
+};
+
+struct PERF_Thread{
+    int label; // What the thread is printed as (the worker id, -1 for the main thread)
+    int fds[PERF_EVENT_COUNT]; // -1 if the event could not be opened
+    unsigned long long int start[PERF_EVENT_COUNT][3]; // Value, time enabled and time running at PERF_begin
+    struct PERF_Counters total; // Everything counted so far
+    struct PERF_Thread* next; // The next registered thread
+};
+
+extern bool PERF_enabled; // PERF_begin and PERF_end do nothing unless this is set (see PERF_enable)
+
+void PERF_enable();
+void PERF_begin(int label);
+void PERF_end();
+void PERF_reset();
+void PERF_print(FILE* fd);
+void PERF_free();
+struct PERF_Thread* _PERF_thread(int label);
+int _PERF_open(enum PERF_Event event);
+bool _PERF_read(int fd, unsigned long long int reading[3]);
+
+#include "perf.c"
@@ -1,153 +1,265 @@
 #include "queue.h"
 
 /**
- * Creates a new QueueChunk
- * RAISES: Exits if could not allocate memory for chunk
+ * Creates a new Queue of void* (default capacity)
+ * RAISES: Exits if could not allocate memory
+*/
+struct Queue* QUEUE_create(){
+    return QUEUE_create_sized(sizeof(void*), _QUEUE_CAPACITY);
+}
+
+/**
+ * Creates a new Queue that holds `capacity` items of `item_size` bytes each (items are copied in and out)
+ * NOTE: capacity must be a power of 2 and at least 2 (with a single slot a put publishes the very sequence the next put
+ *       waits for, so it would overwrite an item that hasn't been taken yet)
+ * RAISES: Exits if could not allocate memory or if capacity is not a power of 2 (>= 2)
 */
-struct QueueChunk* QUEUE_create_chunk(){
-    struct QueueChunk* qc = malloc(sizeof(struct QueueChunk));
-    if (qc == NULL){
-        fprintf(stderr, "ERROR! Could not allocate enough memory for QueueChunk\n");
+struct Queue* QUEUE_create_sized(size_t item_size, size_t capacity){
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0){
+        fprintf(stderr, "ERROR! Queue capacity must be a power of 2 >= 2 (got %zu)\n", capacity);
         exit(1);
     }
 
-    qc->tasks = malloc(_QUEUE_CHUNK_SIZE * sizeof(void*));
-    if (qc->tasks == NULL){
-        fprintf(stderr, "ERROR! Could not allocate enough memory for QueueChunk\n");
+    struct Queue* q = aligned_alloc(_Alignof(struct Queue), sizeof(struct Queue));
+    if (q == NULL){
+        fprintf(stderr, "ERROR! Could not allocate enough memory for Queue\n");
         exit(1);
     }
 
-    qc->filled = 0;
-    qc->next = 0;
-    qc->next_chunk = NULL;
-
-    return qc;
-}
-
-/**
- * Creates a new Queue
- * RAISES: Exits if could not allocate memory
-*/
-struct Queue* QUEUE_create(){
-    struct Queue* q = malloc(sizeof(struct Queue));
-    if (q == NULL){
+    q->item_size = item_size;
+    q->cell_stride = (sizeof(struct QueueCell) + item_size + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * _Alignof(max_align_t);
+    q->cells = aligned_alloc(64, (capacity * q->cell_stride + 63) / 64 * 64);
+    if (q->cells == NULL){
         fprintf(stderr, "ERROR! Could not allocate enough memory for Queue\n");
         exit(1);
     }
+    q->mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i){
+        atomic_init(&_QUEUE_cell(q, i)->sequence, i);
+    }
 
-    q->front = QUEUE_create_chunk();
-    q->back = q->front;
-    q->dispatched = 0;
-    q->live_chunk_count = 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    atomic_init(&q->dispatched, 0);
+    atomic_init(&q->parked_readers, 0);
+    atomic_init(&q->parked_writers, 0);
     
     pthread_cond_init(&q->read_ready_cond, NULL);
     pthread_cond_init(&q->write_ready_cond, NULL);
-    pthread_mutex_init(&q->rw_mutex, NULL);
-    pthread_mutex_init(&q->dispatch_counter_mutex, NULL);
-    pthread_mutex_init(&q->live_counter_mutex, NULL);
+    pthread_mutex_init(&q->park_mutex, NULL);
 
     return q;
 }
 
 /**
- * Frees a chunk allocated by QUEUE_create_chunk
- * NOTE: This will recursively free every chunk that is a child of this
- * NOTE: Consider setting the queue_chunk's next_chunk to NULL to prevent this behaviour
- * NOTE: This will not free any undispatched tasks
+ * Frees a queue allocated by QUEUE_create
+ * NOTE: This will not free the void* pointers stored in the queue
 */
-void QUEUE_free_chunk(struct QueueChunk* queue_chunk){
-    if (queue_chunk == NULL) return;
-    QUEUE_free_chunk(queue_chunk->next_chunk);
-    free(queue_chunk->tasks);
-    free(queue_chunk);
+void QUEUE_free(struct Queue* queue){
+    pthread_cond_destroy(&queue->read_ready_cond);
+    pthread_cond_destroy(&queue->write_ready_cond);
+    pthread_mutex_destroy(&queue->park_mutex);
+    free(queue->cells);
+    free(queue);
 }
 
 /**
- * Frees a chunk allocated by QUEUE_create
- * NOTE: This will not free the void* pointers stored in the queue
+ * Gets the cell that position pos maps to
 */
-void QUEUE_free(struct Queue* queue){
-    QUEUE_free_chunk(queue->front);
-    free(queue);
+inline struct QueueCell* _QUEUE_cell(struct Queue* queue, size_t pos){
+    return (struct QueueCell*)(queue->cells + (pos & queue->mask) * queue->cell_stride);
 }
 
 /**
  * Marks a task as completed (Basically just updates the count of dispatched tasks)
 */
 void QUEUE_register_completion(struct Queue* queue){
-    pthread_mutex_lock(&queue->dispatch_counter_mutex);
-    --(queue->dispatched);
-    pthread_mutex_unlock(&queue->dispatch_counter_mutex);
+    atomic_fetch_sub_explicit(&queue->dispatched, 1, memory_order_release);
 }
 
 /**
- * Welcome to mutex hell
- * Blocks until the queue is non empty then pops out the first element
+ * Gets the number of tasks that have been added but not yet popped
+ * NOTE: This is only a snapshot if other threads are still using the queue
+*/
+long long int QUEUE_pending(struct Queue* queue){
+    size_t enqueued = atomic_load_explicit(&queue->enqueue_pos, memory_order_acquire);
+    size_t dequeued = atomic_load_explicit(&queue->dequeue_pos, memory_order_acquire);
+    return (long long int)(enqueued - dequeued);
+}
+
+/**
+ * Tells the cpu we are spinning (so that the sibling hyperthread gets the core)
+*/
+void _QUEUE_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+/**
+ * Copies the first item out into *item if there is one, returns false if the queue is empty
+*/
+bool _QUEUE_try_take(struct Queue* queue, void* item){
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    while (true){
+        struct QueueCell* cell = _QUEUE_cell(queue, pos);
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+        if (diff == 0){ // The cell holds an item for this lap, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)){
+                memcpy(item, cell + 1, queue->item_size);
+                // Hand the cell back to producers for the next lap
+                atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+                return true;
+            }
+            // NOTE: On failure the CAS reloads pos for us
+        } else if (diff < 0){ // The producer for this position hasn't written yet, so the queue is empty
+            return false;
+        } else{ // Some other consumer beat us to it
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Copies item to the end of the queue if there is space, returns false if the queue is full
+*/
+bool _QUEUE_try_put(struct Queue* queue, const void* item){
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    while (true){
+        struct QueueCell* cell = _QUEUE_cell(queue, pos);
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0){ // The cell is free for this lap, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)){
+                memcpy(cell + 1, item, queue->item_size);
+                // Publish the item to consumers
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0){ // The consumer from the last lap hasn't read this cell yet, so the queue is full
+            return false;
+        } else{ // Some other producer beat us to it
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Wakes up one thread parked on cond (if there is one)
+ * NOTE: The fence pairs with the one in the parking loop so that either the parked thread sees our change or we see it parked
+*/
+void _QUEUE_wake(struct Queue* queue, atomic_int* parked, pthread_cond_t* cond){
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(parked, memory_order_relaxed) == 0) return; // Common case, nobody is asleep so no syscalls
+
+    pthread_mutex_lock(&queue->park_mutex);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&queue->park_mutex);
+}
+
+/**
+ * Blocks until the queue is non empty then copies the first item out into *item
+ * Spins for _QUEUE_SPIN_COUNT attempts before going to sleep
  * NOTE: This is thread safe :)
- * FUTURE: For more performance one might consider creating more locks so as to allow some reading and writing to happen concurrently
 */
-void* QUEUE_get(struct Queue* queue){
-    pthread_mutex_lock(&queue->rw_mutex);
-    while (queue->front->next >= queue->front->filled){ // Wait till reads are possible
-        pthread_cond_wait(&queue->read_ready_cond, &queue->rw_mutex);
+void QUEUE_take(struct Queue* queue, void* item){
+    bool got = _QUEUE_try_take(queue, item);
+    long long int wait_start = got? 0 : TRACE_now(); // Only waits show up in the trace (see trace.h)
+    for (int spin = 0; spin < _QUEUE_SPIN_COUNT && !got; ++spin){
+        _QUEUE_relax();
+        got = _QUEUE_try_take(queue, item);
     }
-    
-    struct QueueChunk* front = queue->front;
-    void* task = front->tasks[front->next++];
-
-    if (front->next >= _QUEUE_CHUNK_SIZE){ // All values in chunk have been read, delete the used up chunk
-        queue->front = front->next_chunk;
-        front->next_chunk = NULL; QUEUE_free_chunk(front);
-        
-        if (queue->front == NULL){
-            queue->front = QUEUE_create_chunk();
-            queue->back = queue->front;
-        } else{
-            pthread_mutex_lock(&queue->live_counter_mutex);
-            --(queue->live_chunk_count);
-            pthread_mutex_unlock(&queue->live_counter_mutex);
+
+    if (!got){ // Park till a producer wakes us up
+        pthread_mutex_lock(&queue->park_mutex);
+        atomic_fetch_add_explicit(&queue->parked_readers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!_QUEUE_try_take(queue, item)){
+            pthread_cond_wait(&queue->read_ready_cond, &queue->park_mutex);
         }
-        
-        front = queue->front;
+        atomic_fetch_sub_explicit(&queue->parked_readers, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&queue->park_mutex);
     }
+    if (wait_start != 0) TRACE_span("QUEUE_take (empty)", wait_start);
+
+    // Update the dispatched counter
+    atomic_fetch_add_explicit(&queue->dispatched, 1, memory_order_relaxed);
 
     // Signal that writes are possible since a spot has been freed
-    pthread_cond_signal(&queue->write_ready_cond);
-    pthread_mutex_unlock(&queue->rw_mutex);
+    _QUEUE_wake(queue, &queue->parked_writers, &queue->write_ready_cond);
+}
 
-    // Update the dispatched counter
-    pthread_mutex_lock(&queue->dispatch_counter_mutex);
-    ++(queue->dispatched);
-    pthread_mutex_unlock(&queue->dispatch_counter_mutex);
-    return task;
+/**
+ * Copies the first item out into *item if there is one, returns false (without blocking) if the queue is empty
+ * NOTE: Counts as a dispatch just like QUEUE_take (so call QUEUE_register_completion once the task is done)
+ * NOTE: This is thread safe :)
+*/
+bool QUEUE_try_take(struct Queue* queue, void* item){
+    if (!_QUEUE_try_take(queue, item)) return false;
+    atomic_fetch_add_explicit(&queue->dispatched, 1, memory_order_relaxed);
+    _QUEUE_wake(queue, &queue->parked_writers, &queue->write_ready_cond);
+    return true;
 }
 
 /**
- * Welcome to mutex hell
- * Blocks until the queue is not full, then appends to the end of the queue
+ * Blocks until the queue is not full, then copies item to the end of the queue
+ * Spins for _QUEUE_SPIN_COUNT attempts before going to sleep
  * NOTE: This is thread safe :)
- * FUTURE: For more performance one might consider creating more locks so as to allow some reading and writing to happen concurrently
 */
-void* QUEUE_add(struct Queue* queue, void* task){
-    pthread_mutex_lock(&queue->rw_mutex);
-    while (queue->back->filled >= _QUEUE_CHUNK_SIZE && queue->live_chunk_count >= _QUEUE_MAX_LIVE_CHUNKS){
-        // Wait till writes are possible
-        pthread_cond_wait(&queue->write_ready_cond, &queue->rw_mutex);
+void QUEUE_put(struct Queue* queue, const void* item){
+    bool added = _QUEUE_try_put(queue, item);
+    long long int wait_start = added? 0 : TRACE_now(); // Only waits show up in the trace (see trace.h)
+    for (int spin = 0; spin < _QUEUE_SPIN_COUNT && !added; ++spin){
+        _QUEUE_relax();
+        added = _QUEUE_try_put(queue, item);
     }
-    
-    struct QueueChunk* back = queue->back;
-    if (back->filled >= _QUEUE_CHUNK_SIZE){ // The chunk is full, we need to create a new chunk
-        back = QUEUE_create_chunk();
-        queue->back->next_chunk = back;
-        queue->back = back;
-        pthread_mutex_lock(&queue->live_counter_mutex);
-        ++(queue->live_chunk_count);
-        pthread_mutex_unlock(&queue->live_counter_mutex);
+
+    if (!added){ // Park till a consumer wakes us up
+        pthread_mutex_lock(&queue->park_mutex);
+        atomic_fetch_add_explicit(&queue->parked_writers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!_QUEUE_try_put(queue, item)){
+            pthread_cond_wait(&queue->write_ready_cond, &queue->park_mutex);
+        }
+        atomic_fetch_sub_explicit(&queue->parked_writers, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&queue->park_mutex);
     }
+    if (wait_start != 0) TRACE_span("QUEUE_put (full)", wait_start);
 
-    back->tasks[back->filled++] = task;
+    // Signal that reads are possible since an item has been added
+    _QUEUE_wake(queue, &queue->parked_readers, &queue->read_ready_cond);
+}
 
-    // Signal that reads are possible since a spot has been freed
-    pthread_cond_signal(&queue->read_ready_cond);
-    pthread_mutex_unlock(&queue->rw_mutex);
+/**
+ * Blocks until the queue is non empty then pops out the first element
+ * NOTE: Only for queues of void* (QUEUE_create)
+ * NOTE: This is thread safe :)
+*/
+void* QUEUE_get(struct Queue* queue){
+    void* task;
+    QUEUE_take(queue, &task);
+    return task;
+}
+
+/**
+ * Pops the first element into *task if there is one, returns false (without blocking) if the queue is empty
+ * NOTE: Only for queues of void* (QUEUE_create)
+ * NOTE: This is thread safe :)
+*/
+bool QUEUE_try_get(struct Queue* queue, void** task){
+    return QUEUE_try_take(queue, task);
+}
+
+/**
+ * Blocks until the queue is not full, then appends to the end of the queue
+ * NOTE: Only for queues of void* (QUEUE_create)
+ * NOTE: This is thread safe :)
+*/
+void QUEUE_add(struct Queue* queue, void* task){
+    QUEUE_put(queue, &task);
 }
@@ -4,52 +4,73 @@
  * 
  * Queue moment frfr
  * Provides definitions for a thread safe queue
- * FUTURE: Some optimizations can be made (by using more mutexes to allow for more concurrency), but this works for now :)
+ * 
+ * This is a bounded lock free multi producer multi consumer ring buffer (Dmitry Vyukov's design):
+ *  - Every cell has a sequence number that says whether it is ready to be written to or read from (for the current lap)
+ *  - Producers and consumers claim positions with a single CAS on enqueue_pos / dequeue_pos, so they never block each other
+ *  - A thread that finds the queue full (or empty) spins for a bit and only then parks on a condition variable
+ *  - Items are copied into the cells themselves (fixed item size per queue), so adding to the queue never allocates
  * 
 */ 
 
 #pragma once
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sched.h>
+#include "trace.h"
 
 /**
- * The max number of tasks stored in each QueueChunk
- * Too low and you will have a huge number of malloc calls. Too high and you will waste space
+ * The max number of tasks that can be in the queue at once by default (must be a power of 2 >= 2)
+ * Too low and you will have your queue_addition wait a lot and too high would mean high memory usage
 */
-#define _QUEUE_CHUNK_SIZE 1000
+#define _QUEUE_CAPACITY (1 << 16)
 
 /**
- * The max number of QueueChunks that can exist at a given point
- * Too low and you will have your queue_addition wait a lot and too high would mean high memory usage
+ * The number of times QUEUE_get/QUEUE_add retry (with a pause in between) before parking the thread
 */
-#define _QUEUE_MAX_LIVE_CHUNKS 1000
+#define _QUEUE_SPIN_COUNT 256
 
-struct QueueChunk{
-    void** tasks; // Stores an array of data
-    struct QueueChunk* next_chunk; // Pretty self explanatory ngl
-    int filled; // The amount of elements fill in the chunk
-    int next; // Index of the next element to be read
+struct QueueCell{
+    atomic_size_t sequence; // pos if the cell is free for the producer at pos, pos + 1 if it holds the item for the consumer at pos
+    // Followed by item_size bytes of item
 };
 
 struct Queue{
-    struct QueueChunk* front;
-    struct QueueChunk* back;
-    int live_chunk_count; // A count of the number of chunks that are allocated
-    int dispatched; // A count of number of tasks that are currently being worked on
-    pthread_cond_t read_ready_cond; // Signal that is broadcasted when data is added to the queue
-    pthread_cond_t write_ready_cond; // Signal that is broadcasted when data is popped from the queue
-    pthread_mutex_t rw_mutex; // read-write mutex
-    pthread_mutex_t dispatch_counter_mutex; // Mutex that protects `dispatched`
-    pthread_mutex_t live_counter_mutex; // Mutex that protects `live_chunk_count`
+    char* cells; // The ring buffer itself (cells are cell_stride bytes apart)
+    size_t cell_stride; // Size of a QueueCell plus its item (rounded up to keep the sequence numbers aligned)
+    size_t item_size; // Number of bytes copied in and out per item
+    size_t mask; // capacity - 1 (used to wrap positions into the ring)
+    _Alignas(64) atomic_size_t enqueue_pos; // Next position a producer will claim (on its own cache line so that producers and consumers don't fight over it)
+    _Alignas(64) atomic_size_t dequeue_pos; // Next position a consumer will claim
+    _Alignas(64) atomic_int dispatched; // A count of number of tasks that are currently being worked on
+    atomic_int parked_readers; // Number of consumers sleeping on read_ready_cond
+    atomic_int parked_writers; // Number of producers sleeping on write_ready_cond
+    pthread_cond_t read_ready_cond; // Signal that is sent when data is added to the queue (only if someone is parked)
+    pthread_cond_t write_ready_cond; // Signal that is sent when data is popped from the queue (only if someone is parked)
+    pthread_mutex_t park_mutex; // Only protects the sleeping, the queue itself is lock free
 };
 
-struct QueueChunk* QUEUE_create_chunk();
 struct Queue* QUEUE_create();
-void QUEUE_free_chunk(struct QueueChunk* queue_chunk);
+struct Queue* QUEUE_create_sized(size_t item_size, size_t capacity);
 void QUEUE_free(struct Queue* queue);
+void QUEUE_take(struct Queue* queue, void* item);
+bool QUEUE_try_take(struct Queue* queue, void* item);
+void QUEUE_put(struct Queue* queue, const void* item);
 void* QUEUE_get(struct Queue* queue);
-void* QUEUE_add(struct Queue* queue, void* task);
+bool QUEUE_try_get(struct Queue* queue, void** task);
+void QUEUE_add(struct Queue* queue, void* task);
 void QUEUE_register_completion(struct Queue* queue);
+long long int QUEUE_pending(struct Queue* queue);
+struct QueueCell* _QUEUE_cell(struct Queue* queue, size_t pos);
+bool _QUEUE_try_take(struct Queue* queue, void* item);
+bool _QUEUE_try_put(struct Queue* queue, const void* item);
+void _QUEUE_relax();
+void _QUEUE_wake(struct Queue* queue, atomic_int* parked, pthread_cond_t* cond);
 
-#include "queue.c"
\ No newline at end of file
+#include "queue.c"
@@ -0,0 +1,25 @@
+#include "rng.h"
+
+/**
+ * splitmix64's finalizer, scrambles every bit of x into every bit of the output
+*/
+inline uint64_t RNG_mix(uint64_t x){
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Gets the counter-th random number of the stream seed
+ * NOTE: This is exactly the counter-th output of a splitmix64 generator seeded with seed
+*/
+inline uint64_t RNG_at(uint64_t seed, uint64_t counter){
+    return RNG_mix(seed + (counter + 1) * _RNG_GAMMA);
+}
+
+/**
+ * Derives the seed of an independent stream (so the same user seed can drive several unrelated sequences)
+*/
+inline uint64_t RNG_stream(uint64_t seed, uint64_t stream){
+    return RNG_mix(seed ^ RNG_mix(stream + _RNG_GAMMA));
+}
@@ -0,0 +1,23 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides a counter based random number generator (splitmix64 as a hash)
+ * 
+ * The n-th number of a stream is just a hash of (seed, n), so there is no state to share or lock (unlike rand())
+ * and any thread can produce any part of a stream. This means a matrix filled by 16 threads is bit for bit the same
+ * as one filled by a single thread from the same seed
+ * 
+*/ 
+
+#pragma once
+#include <stdint.h>
+
+// splitmix64's increment (2^64 / golden ratio)
+#define _RNG_GAMMA 0x9E3779B97F4A7C15ULL
+
+uint64_t RNG_mix(uint64_t x);
+uint64_t RNG_at(uint64_t seed, uint64_t counter);
+uint64_t RNG_stream(uint64_t seed, uint64_t stream);
+
+#include "rng.c"
@@ -8,12 +8,24 @@
  *  matrix_order{number > 0}
  *  operations{number > 0}
  *  log_products{number != 0?}
+ *  --dtype={int32|int64|float|double} (optional, defaults to int64)
+ *  --seed=N (optional, defaults to the current time)
+ *  --strassen_cutoff={N|off} (optional, defaults to STRASSEN_CUTOFF, products with every dimension bigger than this use Strassen-Winograd)
+ *  --density=P (optional, defaults to 1, zeroes all but about P (0 < P <= 1) of the operand elements at random, same as parallel.c)
+ *  --counters={on|off} (optional, defaults to off, counts cycles, instructions and cache/TLB misses of the timed multiplications)
+ *  --log_format={binary|text} (optional, defaults to text)
+ *  --verify=N (optional, runs N rounds of Freivalds' check on every product, exits with an error if any is wrong)
+ *  --mapped=dir, --working_set=N (optional, keeps every matrix in a file under dir instead of in memory and multiplies them
+ *                                 out-of-core with about N megabytes mapped at once, same as parallel.c)
  * 
  * Outputs:
  *  stdout:
  *      Time elapsed: {time}ms
- *  PRODUCTS_LOG_FILE: (only if options.log_products is true)
+ *      Counters: ... (only with --counters=on, one line per thread and a total)
+ *  PRODUCTS_LOG_FILE: (only if options.log_products is true, text by default)
  *      Outputs the matrices multiplied and the product obtained
+ *  PRODUCTS_BINLOG_FILE: (only if options.log_products is true and --log_format=binary, see binlog.h)
+ *      Same as PRODUCTS_LOG_FILE but raw (read it with logread)
  * 
 */ 
 
@@ -24,34 +36,68 @@
 #include "matrix.h"
 #include "options.h"
 #include "common.h"
+#include "kernel.h"
+#include "verify.h"
+#include "binlog.h"
+#include "perf.h"
+#include "strassen.h"
+#include "mapped.h"
 
 #define PRODUCTS_LOG_FILE "matrix_mul_seq.log"
+#define PRODUCTS_BINLOG_FILE "matrix_mul_seq.bin"
 
 #pragma region Business Logix
-void multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product);
+void multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int strassen_cutoff, long long int working_set);
 #pragma endregion
 
 int main(int argc, char* argv[]){
-    srand(time(NULL));
     struct Options options; OPTIONS_set(&options, argc, argv);
+    KERNEL_init(); // Pick the fastest micro kernel this cpu supports
 
-    // Create matrices for doing multiplication
-    struct Matrix** operand_as = create_matrix_array(options.operations, options.matrix_order, options.matrix_order);
-    struct Matrix** operand_bs = create_matrix_array(options.operations, options.matrix_order, options.matrix_order);
-    struct Matrix** products   = create_matrix_array(options.operations, options.matrix_order, options.matrix_order);
+    // Create matrices for doing multiplication (in files under options.mapped with --mapped)
+    struct Matrix** operand_as = create_mapped_matrix_array(options.mapped, "a", options.operations, options.matrix_order, options.matrix_order, options.dtype);
+    struct Matrix** operand_bs = create_mapped_matrix_array(options.mapped, "b", options.operations, options.matrix_order, options.matrix_order, options.dtype);
+    struct Matrix** products   = create_mapped_matrix_array(options.mapped, "c", options.operations, options.matrix_order, options.matrix_order, options.dtype);
     
     // Fill the operand matrices with random values
-    init_operand(operand_as, options.operations); init_operand(operand_bs, options.operations);
+    init_operand(operand_as, options.operations, RNG_stream(options.seed, OPERAND_A_STREAM), options.density);
+    init_operand(operand_bs, options.operations, RNG_stream(options.seed, OPERAND_B_STREAM), options.density);
     
+    if (options.counters) PERF_enable();
+    long long int strassen_cutoff = (options.strassen_cutoff == 0)? STRASSEN_CUTOFF : options.strassen_cutoff;
+    long long int working_set = (options.working_set > 0)? (options.working_set << 20) : MAPPED_WORKING_SET;
+
     long long int start = time_ms();
     for (long long int i = 0; i < options.operations; ++i){
-        multiply(operand_as[i], operand_bs[i], products[i]);
+        PERF_begin(-1);
+        multiply(operand_as[i], operand_bs[i], products[i], strassen_cutoff, working_set);
+        PERF_end();
     }
     long long int end = time_ms();
     
     printf("Time elapsed: %ldms\n", end - start);
+    if (options.counters) PERF_print(stdout);
+
+    // Freivalds' check on every product (not timed)
+    for (long long int round = 0; round < options.verify; ++round){
+        for (long long int i = 0; i < options.operations; ++i){
+            if (!VERIFY_product(operand_as[i], operand_bs[i], products[i], verify_seed(options.seed, round, i))){
+                fprintf(stderr, "ERROR! Product %lld failed verification\n", i);
+                exit(1);
+            }
+        }
+    }
+
+    if (options.log_products && options.log_format == OPTIONS_LOG_BINARY){ // Stores the results of multiplications in PRODUCTS_BINLOG_FILE
+        struct BinLog* log = BINLOG_create(PRODUCTS_BINLOG_FILE, options.operations, options.matrix_order, options.matrix_order, options.dtype);
+        long long int elements = options.operations * options.matrix_order * options.matrix_order;
+        BINLOG_write_array(log, 0, operand_as, 0, elements);
+        BINLOG_write_array(log, 1, operand_bs, 0, elements);
+        BINLOG_write_array(log, 2, products, 0, elements);
+        BINLOG_close(log);
+    }
 
-    if (options.log_products){ // Stores the results of multiplications in PRODUCTS_LOG_FILE
+    if (options.log_products && options.log_format == OPTIONS_LOG_TEXT){ // Stores the results of multiplications in PRODUCTS_LOG_FILE
         FILE* log_file = fopen(PRODUCTS_LOG_FILE, "w");
 
         for (long long int i = 0; i < options.operations; ++i){
@@ -64,6 +110,7 @@ int main(int argc, char* argv[]){
     }
 
     // Free the data :)
+    PERF_free();
     free_matrix_array(operand_as, options.operations);
     free_matrix_array(operand_bs, options.operations);
     free_matrix_array(products  , options.operations);
@@ -72,21 +119,20 @@ int main(int argc, char* argv[]){
 #pragma region Business Logix Impl
 /**
  * Multiplies 2 matrices and stores the result in product matrix
+ * Mapped products (see create_mapped_matrix_array) are computed out-of-core with about working_set bytes mapped at once
  * RAISES: Exits if the matrices provided are not of correct dimensions
 */
-void multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product){
-    if (operand_a->cols != operand_b->rows || operand_a->rows != product->rows || operand_b->cols != product->cols){
+void multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int strassen_cutoff, long long int working_set){
+    if (!KERNEL_can_multiply(operand_a, operand_b, product)){
         fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
         exit(1);
     }
-    // Just your generic matrix multiplication algorithm
-    for (long long int row = 0; row < product->rows; ++row){
-        for (long long int col = 0; col < product->cols; ++col){
-            product->data[MATRIX_idx(row, col, product)] = 0;
-            for (long long int k = 0; k < operand_a->cols; ++k){
-                product->data[MATRIX_idx(row, col, product)] += operand_a->data[MATRIX_idx(row, k, operand_a)] * operand_b->data[MATRIX_idx(k, col, operand_b)];
-            }
-        }
+    if (product->mapping != NULL){ // Tiles streamed through a bounded working set (see mapped.h)
+        MAPPED_multiply(operand_a, operand_b, product, working_set);
+        return;
     }
+    // Cache blocked multiplication (see kernel.h), with Strassen-Winograd on top for big products (see strassen.h)
+    struct Arena* scratch = STRASSEN_thread_scratch(STRASSEN_scratch_bytes(operand_a->rows, operand_a->cols, operand_b->cols, product->dtype, strassen_cutoff));
+    STRASSEN_multiply(operand_a, operand_b, product, strassen_cutoff, scratch);
 }
 #pragma endregion
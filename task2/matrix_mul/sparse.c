@@ -0,0 +1,212 @@
+#include "sparse.h"
+
+/**
+ * Allocates a sparse matrix with room for nnz elements (offsets, indices and values are left for the caller to fill in)
+ * RAISES: Exits if could not allocate memory or if given invalid arguments
+*/
+struct SPARSE_Matrix* SPARSE_create(long long int rows, long long int cols, long long int nnz, enum MATRIX_DType dtype){
+    _MATRIX_validate(rows, cols, dtype);
+    if (nnz < 0 || nnz > rows * cols){
+        fprintf(stderr, "ERROR! Invalid number of nonzeros for a (%lld, %lld) sparse matrix (%lld)\n", rows, cols, nnz);
+        exit(1);
+    }
+
+    struct SPARSE_Matrix* matrix = malloc(sizeof(struct SPARSE_Matrix));
+    if (matrix == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for sparse matrix :(\n");
+        exit(1);
+    }
+    long long int room = (nnz > 0)? nnz : 1; // malloc(0) may well be NULL
+    matrix->offsets = malloc((rows + 1) * sizeof(long long int));
+    matrix->indices = malloc(room * sizeof(long long int));
+    matrix->values = malloc(room * MATRIX_dtype_size(dtype));
+    if (matrix->offsets == NULL || matrix->indices == NULL || matrix->values == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for sparse matrix :(\n");
+        exit(1);
+    }
+
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->nnz = nnz;
+    matrix->dtype = dtype;
+    matrix->offsets[0] = 0;
+    matrix->offsets[rows] = nnz;
+    return matrix;
+}
+
+/**
+ * Frees a sparse matrix
+*/
+void SPARSE_free(struct SPARSE_Matrix* matrix){
+    free(matrix->offsets);
+    free(matrix->indices);
+    free(matrix->values);
+    free(matrix);
+}
+
+/**
+ * Counts the nonzero elements of a dense matrix, stopping as soon as there are more than limit (a negative limit counts all)
+ * NOTE: So with a limit it only tells whether there are more than that many (and is cheap when there are)
+*/
+long long int SPARSE_count_nonzeros(struct Matrix* matrix, long long int limit){
+    long long int elements = matrix->rows * matrix->cols, count = 0;
+    switch (matrix->dtype){
+#define _SPARSE_COUNT_CASE(tag, type, suffix, fmt, name) \
+    case tag:{ \
+        const type* data = matrix->data; \
+        for (long long int idx = 0; idx < elements && (limit < 0 || count <= limit); ++idx) count += (data[idx] != 0); \
+        break; \
+    }
+    MATRIX_DTYPES(_SPARSE_COUNT_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", matrix->dtype);
+        exit(1);
+    }
+    return count;
+}
+
+/**
+ * Checks whether at most max_density of a dense matrix's elements are nonzero (the density heuristic, see SPARSE_MAX_DENSITY)
+ * NOTE: Gives up as soon as the count goes over, so a dense matrix costs a small fraction of a pass
+*/
+bool SPARSE_is_sparse(struct Matrix* matrix, double max_density){
+    long long int limit = (long long int)(max_density * (double)(matrix->rows * matrix->cols));
+    return SPARSE_count_nonzeros(matrix, limit) <= limit;
+}
+
+/**
+ * Converts a dense matrix into a sparse one holding just its nonzero elements
+ * RAISES: Exits if could not allocate memory
+*/
+struct SPARSE_Matrix* SPARSE_from_dense(struct Matrix* matrix){
+    struct SPARSE_Matrix* sparse = SPARSE_create(matrix->rows, matrix->cols, SPARSE_count_nonzeros(matrix, -1), matrix->dtype);
+    long long int rows = matrix->rows, cols = matrix->cols;
+
+    switch (matrix->dtype){
+#define _SPARSE_FROM_DENSE_CASE(tag, type, suffix, fmt, name) \
+    case tag:{ \
+        const type* data = matrix->data; type* values = sparse->values; long long int count = 0; \
+        for (long long int r = 0; r < rows; ++r){ \
+            sparse->offsets[r] = count; \
+            for (long long int c = 0; c < cols; ++c){ \
+                type value = data[r * cols + c]; \
+                if (value == 0) continue; \
+                sparse->indices[count] = c; \
+                values[count++] = value; \
+            } \
+        } \
+        break; \
+    }
+    MATRIX_DTYPES(_SPARSE_FROM_DENSE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", matrix->dtype);
+        exit(1);
+    }
+    return sparse;
+}
+
+/**
+ * Gets the prefix sums of the work every row of operand_a * operand_b takes (work[r] is the work of rows before r, work[rows]
+ * the total), for SPARSE_partition
+ * The work of a row is 1 (so empty rows still count for something) plus its multiply-adds divided by the columns of the product
+ * when operand_b is dense (NULL): the nonzeros of the row, and when it is sparse: the nonzeros of every row of B it picks
+ * NOTE: The result is malloced
+ * RAISES: Exits if could not allocate memory
+*/
+long long int* SPARSE_row_work(struct SPARSE_Matrix* operand_a, struct SPARSE_Matrix* operand_b){
+    long long int* work = malloc((operand_a->rows + 1) * sizeof(long long int));
+    if (work == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for sparse partition\n");
+        exit(1);
+    }
+    work[0] = 0;
+    for (long long int r = 0; r < operand_a->rows; ++r){
+        long long int row_work = 1;
+        if (operand_b == NULL) row_work += operand_a->offsets[r + 1] - operand_a->offsets[r];
+        else for (long long int p = operand_a->offsets[r]; p < operand_a->offsets[r + 1]; ++p){
+            long long int k = operand_a->indices[p];
+            row_work += operand_b->offsets[k + 1] - operand_b->offsets[k];
+        }
+        work[r + 1] = work[r] + row_work;
+    }
+    return work;
+}
+
+/**
+ * Splits rows into parts of about equal work (work being prefix sums, see SPARSE_row_work), part p is rows
+ * [bounds[p], bounds[p + 1]) so bounds needs parts + 1 entries
+ * NOTE: Parts can be empty (a single row can hold more than a part's worth of work)
+*/
+void SPARSE_partition(const long long int* work, long long int rows, long long int parts, long long int* bounds){
+    bounds[0] = 0;
+    for (long long int p = 1; p < parts; ++p){
+        // First row at which the work done so far reaches p parts worth (binary search, work only ever goes up)
+        long long int target = (long long int)((double)work[rows] * p / parts), low = bounds[p - 1], high = rows;
+        while (low < high){
+            long long int mid = low + (high - low) / 2;
+            if (work[mid] < target) low = mid + 1;
+            else high = mid;
+        }
+        bounds[p] = low;
+    }
+    bounds[parts] = rows;
+}
+
+/**
+ * Computes rows [row_start, row_end) of product = operand_a * operand_b, operand_a being sparse and operand_b dense
+ * Every nonzero a(i, k) adds a(i, k) * B[k, :] to C[i, :] (so B is only ever read a row at a time)
+ * NOTE: Dimensions are not checked here (see request_sparse_multiplications)
+*/
+void SPARSE_multiply_dense_rows(struct SPARSE_Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int row_start, long long int row_end){
+    long long int cols = product->cols;
+    switch (product->dtype){
+#define _SPARSE_DENSE_CASE(tag, type, suffix, fmt, name) \
+    case tag:{ \
+        const type* values = operand_a->values; const type* b = operand_b->data; \
+        for (long long int i = row_start; i < row_end; ++i){ \
+            type* c = (type*)product->data + i * cols; \
+            memset(c, 0, cols * sizeof(type)); \
+            for (long long int p = operand_a->offsets[i]; p < operand_a->offsets[i + 1]; ++p){ \
+                type value = values[p]; const type* b_row = b + operand_a->indices[p] * cols; \
+                for (long long int j = 0; j < cols; ++j) c[j] += value * b_row[j]; \
+            } \
+        } \
+        break; \
+    }
+    MATRIX_DTYPES(_SPARSE_DENSE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", product->dtype);
+        exit(1);
+    }
+}
+
+/**
+ * Computes rows [row_start, row_end) of product = operand_a * operand_b, both operands being sparse and product dense
+ * Gustavson's algorithm with the product's row itself as the accumulator: every nonzero a(i, k) scatters a(i, k) * B[k, :]
+ * (just its nonzeros) into C[i, :]
+ * NOTE: Dimensions are not checked here (see request_sparse_multiplications)
+*/
+void SPARSE_multiply_sparse_dense_rows(struct SPARSE_Matrix* operand_a, struct SPARSE_Matrix* operand_b, struct Matrix* product, long long int row_start, long long int row_end){
+    long long int cols = product->cols;
+    switch (product->dtype){
+#define _SPARSE_SPARSE_DENSE_CASE(tag, type, suffix, fmt, name) \
+    case tag:{ \
+        const type* a_values = operand_a->values; const type* b_values = operand_b->values; \
+        for (long long int i = row_start; i < row_end; ++i){ \
+            type* c = (type*)product->data + i * cols; \
+            memset(c, 0, cols * sizeof(type)); \
+            for (long long int p = operand_a->offsets[i]; p < operand_a->offsets[i + 1]; ++p){ \
+                type value = a_values[p]; long long int k = operand_a->indices[p]; \
+                for (long long int q = operand_b->offsets[k]; q < operand_b->offsets[k + 1]; ++q){ \
+                    c[operand_b->indices[q]] += value * b_values[q]; \
+                } \
+            } \
+        } \
+        break; \
+    }
+    MATRIX_DTYPES(_SPARSE_SPARSE_DENSE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", product->dtype);
+        exit(1);
+    }
+}
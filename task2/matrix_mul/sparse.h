@@ -0,0 +1,53 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Provides sparse (CSR) matrices and the kernels that multiply them, for operands that are mostly zeros
+ *
+ * A CSR matrix stores, row by row, only the nonzero elements (values) and their columns (indices), offsets[r] being where
+ * row r starts (offsets[rows] is the number of nonzeros)
+ *
+ * The kernels work on a range of rows of the (dense) product, so tasks.c can split them up:
+ *  - sparse * dense: every nonzero a(i, k) adds a(i, k) * B[k, :] to C[i, :]
+ *  - sparse * sparse: Gustavson's row by row algorithm, with the product's row itself as the accumulator
+ * Rows are far from equal amounts of work, SPARSE_partition splits them by work (nonzeros) instead of by count
+ * NOTE: Products are always dense (every product of a run gets logged, verified and checksummed as a struct Matrix)
+ *
+*/
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "matrix.h"
+
+// Operands with at most this fraction of nonzeros are multiplied as sparse when picking automatically (see SPARSE_is_sparse)
+// At order 1000 (int64 and double) the sparse kernels are about twice as fast at 10% nonzeros with a dense B (more with a
+// sparse one) and break even at about 20%
+#define SPARSE_MAX_DENSITY 0.1
+// Products with any dimension smaller than this stay dense when picking automatically (below about 64 converting the operands
+// of every product costs more than the zeros save)
+#define SPARSE_MIN_ORDER 64
+
+struct SPARSE_Matrix{
+    long long int rows; // The number of rows in the matrix
+    long long int cols; // The number of columns in the matrix
+    long long int nnz; // The number of stored elements
+    enum MATRIX_DType dtype; // The type of each element
+    long long int* offsets; // Where every row starts in indices/values, one extra at the end (= nnz)
+    long long int* indices; // The column of every stored element
+    void* values; // Every stored element, the actual type depends on dtype
+};
+
+struct SPARSE_Matrix* SPARSE_create(long long int rows, long long int cols, long long int nnz, enum MATRIX_DType dtype);
+void SPARSE_free(struct SPARSE_Matrix* matrix);
+long long int SPARSE_count_nonzeros(struct Matrix* matrix, long long int limit);
+bool SPARSE_is_sparse(struct Matrix* matrix, double max_density);
+struct SPARSE_Matrix* SPARSE_from_dense(struct Matrix* matrix);
+long long int* SPARSE_row_work(struct SPARSE_Matrix* operand_a, struct SPARSE_Matrix* operand_b);
+void SPARSE_partition(const long long int* work, long long int rows, long long int parts, long long int* bounds);
+void SPARSE_multiply_dense_rows(struct SPARSE_Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int row_start, long long int row_end);
+void SPARSE_multiply_sparse_dense_rows(struct SPARSE_Matrix* operand_a, struct SPARSE_Matrix* operand_b, struct Matrix* product, long long int row_start, long long int row_end);
+
+#include "sparse.c"
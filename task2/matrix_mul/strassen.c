@@ -0,0 +1,177 @@
+#include "strassen.h"
+
+// Per thread scratch arena for STRASSEN_multiply (grown as needed)
+// NOTE: Never freed, it lives as long as the thread (like the kernel's packing buffers)
+static _Thread_local struct Arena* _STRASSEN_scratch = NULL;
+
+/**
+ * Checks whether a product is big enough (every dimension bigger than cutoff) to be split, a cutoff <= 0 never splits
+*/
+bool STRASSEN_should_split(struct Matrix* operand_a, struct Matrix* operand_b, long long int cutoff){
+    return cutoff > 0 && operand_a->rows > cutoff && operand_a->cols > cutoff && operand_b->cols > cutoff;
+}
+
+/**
+ * Gets the number of bytes STRASSEN_split takes from the scratch arena for a (rows x depth) * (depth x cols) product
+*/
+size_t STRASSEN_split_bytes(long long int rows, long long int depth, long long int cols, enum MATRIX_DType dtype){
+    long long int half_rows = (rows + 1) / 2, half_depth = (depth + 1) / 2, half_cols = (cols + 1) / 2;
+    return 7 * (MATRIX_bytes(half_rows, half_depth, dtype) + MATRIX_bytes(half_depth, half_cols, dtype) + MATRIX_bytes(half_rows, half_cols, dtype));
+}
+
+/**
+ * Gets the size of the scratch arena STRASSEN_multiply needs for a (rows x depth) * (depth x cols) product
+ * (every level down to the cutoff, the 7 products of a level reuse the same space one after the other)
+*/
+size_t STRASSEN_scratch_bytes(long long int rows, long long int depth, long long int cols, enum MATRIX_DType dtype, long long int cutoff){
+    if (cutoff <= 0 || rows <= cutoff || depth <= cutoff || cols <= cutoff) return 0;
+    return STRASSEN_split_bytes(rows, depth, cols, dtype) + STRASSEN_scratch_bytes((rows + 1) / 2, (depth + 1) / 2, (cols + 1) / 2, dtype, cutoff);
+}
+
+/**
+ * Does the first half of a level: copies out the quadrants, computes the S and T sums and makes room for M1 to M7
+ * Once all 7 products in split are done, STRASSEN_merge puts them together into product
+ * NOTE: Everything is allocated from scratch (STRASSEN_split_bytes worth), so keep it around till after the merge
+*/
+void STRASSEN_split(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct Arena* scratch, struct STRASSEN_Split* split){
+    enum MATRIX_DType dtype = product->dtype;
+    long long int half_rows = (operand_a->rows + 1) / 2, half_depth = (operand_a->cols + 1) / 2, half_cols = (operand_b->cols + 1) / 2;
+
+    // A21 and B12 are only ever needed in sums, so they get copied straight into where S3 and T3 end up
+    struct Matrix* a11 = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_copy(a11, operand_a, 0, 0);
+    struct Matrix* a12 = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_copy(a12, operand_a, 0, half_depth);
+    struct Matrix* a22 = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_copy(a22, operand_a, half_rows, half_depth);
+    struct Matrix* s3  = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_copy(s3, operand_a, half_rows, 0);
+    struct Matrix* s1  = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_combine(s1, s3, a22, false);
+    struct Matrix* s2  = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_combine(s2, s1, a11, true);
+    struct Matrix* s4  = MATRIX_create_in(scratch, half_rows, half_depth, dtype); _STRASSEN_combine(s4, a12, s2, true);
+    _STRASSEN_combine(s3, a11, s3, true);
+
+    struct Matrix* b11 = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_copy(b11, operand_b, 0, 0);
+    struct Matrix* b21 = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_copy(b21, operand_b, half_depth, 0);
+    struct Matrix* b22 = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_copy(b22, operand_b, half_depth, half_cols);
+    struct Matrix* t3  = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_copy(t3, operand_b, 0, half_cols);
+    struct Matrix* t1  = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_combine(t1, t3, b11, true);
+    struct Matrix* t2  = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_combine(t2, b22, t1, true);
+    struct Matrix* t4  = MATRIX_create_in(scratch, half_depth, half_cols, dtype); _STRASSEN_combine(t4, t2, b21, true);
+    _STRASSEN_combine(t3, b22, t3, true);
+
+    struct Matrix* operands[7][2] = {{a11, b11}, {a12, b21}, {s4, b22}, {a22, t4}, {s1, t1}, {s2, t2}, {s3, t3}};
+    memcpy(split->operands, operands, sizeof(operands));
+    for (int i = 0; i < 7; ++i) split->products[i] = MATRIX_create_in(scratch, half_rows, half_cols, dtype);
+    split->product = product;
+}
+
+/**
+ * Does the second half of a level: puts M1 to M7 together into the product (dropping the padding)
+ * NOTE: Overwrites some of the Ms along the way
+*/
+void STRASSEN_merge(struct STRASSEN_Split* split){
+    struct Matrix** m = split->products;
+    long long int half_rows = m[0]->rows, half_cols = m[0]->cols;
+
+    _STRASSEN_combine(m[5], m[0], m[5], false); // U2 = M1 + M6
+    _STRASSEN_store(split->product, 0, 0, m[0], m[1], false); // C11 = M1 + M2
+    _STRASSEN_combine(m[6], m[5], m[6], false); // U3 = U2 + M7
+    _STRASSEN_combine(m[5], m[5], m[4], false); // U4 = U2 + M5
+    _STRASSEN_store(split->product, 0, half_cols, m[5], m[2], false); // C12 = U4 + M3
+    _STRASSEN_store(split->product, half_rows, 0, m[6], m[3], true); // C21 = U3 - M4
+    _STRASSEN_store(split->product, half_rows, half_cols, m[6], m[4], false); // C22 = U3 + M5
+}
+
+/**
+ * Multiplies 2 matrices (Strassen-Winograd down to the cutoff, the blocked kernel below it) and stores the result in product
+ * NOTE: scratch needs STRASSEN_scratch_bytes free (and is left as it was found)
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void STRASSEN_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int cutoff, struct Arena* scratch){
+    if (!KERNEL_can_multiply(operand_a, operand_b, product)){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    if (!STRASSEN_should_split(operand_a, operand_b, cutoff)){
+        KERNEL_multiply_tile(operand_a, operand_b, product, 0, product->rows, 0, product->cols);
+        return;
+    }
+
+    size_t mark = ARENA_mark(scratch);
+    struct STRASSEN_Split split;
+    STRASSEN_split(operand_a, operand_b, product, scratch, &split);
+    for (int i = 0; i < 7; ++i){
+        STRASSEN_multiply(split.operands[i][0], split.operands[i][1], split.products[i], cutoff, scratch);
+    }
+    STRASSEN_merge(&split);
+    ARENA_rewind(scratch, mark);
+}
+
+/**
+ * Gets the calling thread's scratch arena, making sure it can hold at least `bytes` bytes
+ * RAISES: Exits if could not allocate memory
+*/
+struct Arena* STRASSEN_thread_scratch(size_t bytes){
+    if (_STRASSEN_scratch != NULL && _STRASSEN_scratch->size >= bytes) return _STRASSEN_scratch;
+    if (_STRASSEN_scratch != NULL) ARENA_free(_STRASSEN_scratch);
+    _STRASSEN_scratch = ARENA_create((bytes > 0)? bytes : ARENA_ALIGNMENT);
+    return _STRASSEN_scratch;
+}
+
+/**
+ * Copies the block of matrix starting at (row, col) into block (the parts that fall outside matrix are zero padding)
+*/
+void _STRASSEN_copy(struct Matrix* block, struct Matrix* matrix, long long int row, long long int col){
+    size_t element_size = MATRIX_dtype_size(block->dtype);
+    long long int cols = (matrix->cols - col < block->cols)? matrix->cols - col : block->cols;
+    for (long long int r = 0; r < block->rows; ++r){
+        char* dst = (char*)block->data + r * block->cols * element_size;
+        if (row + r >= matrix->rows){
+            memset(dst, 0, block->cols * element_size);
+            continue;
+        }
+        memcpy(dst, (char*)matrix->data + ((row + r) * matrix->cols + col) * element_size, cols * element_size);
+        memset(dst + cols * element_size, 0, (block->cols - cols) * element_size);
+    }
+}
+
+/**
+ * Computes result = x + y (or x - y), all three being the same shape
+ * NOTE: result can be x or y
+*/
+void _STRASSEN_combine(struct Matrix* result, struct Matrix* x, struct Matrix* y, bool subtract){
+    long long int elements = result->rows * result->cols;
+    switch (result->dtype){
+#define _STRASSEN_COMBINE_CASE(tag, type, suffix, fmt, name) \
+    case tag:{ \
+        type* r = result->data; const type* a = x->data; const type* b = y->data; \
+        if (subtract) for (long long int i = 0; i < elements; ++i) r[i] = a[i] - b[i]; \
+        else for (long long int i = 0; i < elements; ++i) r[i] = a[i] + b[i]; \
+        break; \
+    }
+    MATRIX_DTYPES(_STRASSEN_COMBINE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", result->dtype);
+        exit(1);
+    }
+}
+
+/**
+ * Stores x + y (or x - y) into the block of matrix starting at (row, col) (whatever falls outside matrix is padding, and dropped)
+*/
+void _STRASSEN_store(struct Matrix* matrix, long long int row, long long int col, struct Matrix* x, struct Matrix* y, bool subtract){
+    long long int rows = (matrix->rows - row < x->rows)? matrix->rows - row : x->rows;
+    long long int cols = (matrix->cols - col < x->cols)? matrix->cols - col : x->cols;
+    switch (matrix->dtype){
+#define _STRASSEN_STORE_CASE(tag, type, suffix, fmt, name) \
+    case tag: \
+        for (long long int r = 0; r < rows; ++r){ \
+            type* dst = (type*)matrix->data + (row + r) * matrix->cols + col; \
+            const type* a = (const type*)x->data + r * x->cols; const type* b = (const type*)y->data + r * y->cols; \
+            if (subtract) for (long long int c = 0; c < cols; ++c) dst[c] = a[c] - b[c]; \
+            else for (long long int c = 0; c < cols; ++c) dst[c] = a[c] + b[c]; \
+        } \
+        break;
+    MATRIX_DTYPES(_STRASSEN_STORE_CASE)
+    default:
+        fprintf(stderr, "UNREACHABLE! Unexpected dtype %d\n", matrix->dtype);
+        exit(1);
+    }
+}
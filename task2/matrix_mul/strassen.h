@@ -0,0 +1,55 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Provides Strassen-Winograd multiplication (7 half size products per level instead of 8, with 15 additions)
+ *
+ * Every level splits the operands into quadrants (odd dimensions get padded with zeros) and computes
+ *  S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21, S4 = A12 - S2
+ *  T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12, T4 = T2 - B21
+ *  M1 = A11 B11, M2 = A12 B21, M3 = S4 B22, M4 = A22 T4, M5 = S1 T1, M6 = S2 T2, M7 = S3 T3
+ *  C11 = M1 + M2, C12 = M1 + M6 + M5 + M3, C21 = M1 + M6 + M7 - M4, C22 = M1 + M6 + M7 + M5
+ * and recursion stops once any dimension is at most the cutoff, where the blocked kernel (kernel.h) takes over
+ *
+ * A level is split in two halves (STRASSEN_split and STRASSEN_merge) so that the 7 products in between can be computed
+ * any which way, STRASSEN_multiply does them one after the other and tasks.c hands them to the worker pool
+ *
+ * Quadrants, sums and products all live in a scratch arena that is used as a stack (every level takes its space on the
+ * way down and gives it back on the way up), so the recursion never mallocs
+ * NOTE: That scratch is a lot (about 5/4 of the operands and the product per level, see STRASSEN_split_bytes)
+ * NOTE: Integer dtypes come out exactly like the blocked kernel (everything is just additions and multiplications, wrapping
+ *       the same way), floating point ones can round differently (the usual Strassen error bound is a bit looser)
+ *
+*/
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "matrix.h"
+#include "arena.h"
+#include "kernel.h"
+
+// Products with every dimension bigger than this are split by default (can be changed at runtime, see options.h)
+// Below about 1000 the extra additions and copies eat up the saved multiplications (so only the 1500+ orders get split)
+#define STRASSEN_CUTOFF 1024
+
+struct STRASSEN_Split{
+    struct Matrix* operands[7][2]; // The premultiplicand and postmultiplicand of each of the 7 products
+    struct Matrix* products[7]; // Where each of the 7 products goes (M1 to M7)
+    struct Matrix* product; // The product being computed (what STRASSEN_merge writes)
+};
+
+bool STRASSEN_should_split(struct Matrix* operand_a, struct Matrix* operand_b, long long int cutoff);
+size_t STRASSEN_split_bytes(long long int rows, long long int depth, long long int cols, enum MATRIX_DType dtype);
+size_t STRASSEN_scratch_bytes(long long int rows, long long int depth, long long int cols, enum MATRIX_DType dtype, long long int cutoff);
+void STRASSEN_split(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct Arena* scratch, struct STRASSEN_Split* split);
+void STRASSEN_merge(struct STRASSEN_Split* split);
+void STRASSEN_multiply(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, long long int cutoff, struct Arena* scratch);
+struct Arena* STRASSEN_thread_scratch(size_t bytes);
+void _STRASSEN_copy(struct Matrix* block, struct Matrix* matrix, long long int row, long long int col);
+void _STRASSEN_combine(struct Matrix* result, struct Matrix* x, struct Matrix* y, bool subtract);
+void _STRASSEN_store(struct Matrix* matrix, long long int row, long long int col, struct Matrix* x, struct Matrix* y, bool subtract);
+
+#include "strassen.c"
@@ -1,2 +1,5 @@
 gcc parallel.c -pthread -opar
-gcc sequential.c -oseq
\ No newline at end of file
+gcc sequential.c -pthread -oseq
+gcc logread.c -ologread
+gcc bench.c -pthread -obench
+gcc test.c -pthread -otest
\ No newline at end of file
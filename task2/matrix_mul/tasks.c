@@ -0,0 +1,904 @@
+#include "tasks.h"
+
+/**
+ * Spawns the worker pool, with as many threads as options->threads says (or as the cpu layout suggests) pinned by options->pin
+ * NOTE: The operands (filled on the pool), each worker's packing buffers and product tiles are first touched by the (pinned)
+ *       workers themselves, so linux spreads them over the workers' NUMA nodes
+ * RAISES: Exits if could not allocate memory
+*/
+struct WorkerPool* create_worker_pool(struct Options* options){
+    struct Topology* topology = TOPO_detect();
+    int thread_count = (options->threads > 0)? options->threads : TOPO_auto_thread_count(topology, options->pin);
+
+    int* cpus = malloc(thread_count * sizeof(int));
+    if (cpus == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the cpu plan\n");
+        exit(1);
+    }
+    TOPO_plan(topology, options->pin, thread_count, cpus);
+
+    struct WorkerPool* worker_pool = WP_create_pinned(sub_multiplication_handler, thread_count, options->scheduler, cpus, options->queue_capacity);
+    free(cpus);
+    TOPO_free(topology);
+    return worker_pool;
+}
+
+/**
+ * Replaces every granularity option that was left at 0 with its TASK_ default (OPTIONS_AUTO is left for autotune_granularity)
+*/
+void resolve_granularity(struct Options* options){
+    if (options->tiles_per_thread == 0) options->tiles_per_thread = TASK_TILES_PER_THREAD;
+    if (options->min_tile_side == 0) options->min_tile_side = TASK_MIN_TILE_SIDE;
+    if (options->batch_work == 0) options->batch_work = TASK_BATCH_WORK;
+    if (options->strassen_cutoff == 0) options->strassen_cutoff = STRASSEN_CUTOFF;
+}
+
+/**
+ * Times one round of request_multiplications (till the pool is idle again) in us
+*/
+long long int time_requests(struct Options* options, struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool){
+    long long int best = -1;
+    for (int repeat = 0; repeat < TASK_TUNE_REPEATS; ++repeat){
+        long long int start = time_us();
+        request_multiplications(operand_as, operand_bs, products, count, worker_pool, options);
+        WP_wait_idle(worker_pool);
+        long long int elapsed = time_us() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/**
+ * Resolves the granularity options, picking the ones set to OPTIONS_AUTO by timing a few short calibration multiplies
+ * Only the option that matters for this order is calibrated (tiles_per_thread for tiled products, batch_work for batched ones),
+ * the other one just gets its default
+ * NOTE: The calibration multiplies write into products (they get overwritten by the real run anyway)
+*/
+void autotune_granularity(struct Options* options, struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, struct WorkerPool* worker_pool){
+    bool tune_tiles = options->tiles_per_thread == OPTIONS_AUTO;
+    bool tune_batch = options->batch_work == OPTIONS_AUTO;
+    if (tune_tiles) options->tiles_per_thread = 0;
+    if (tune_batch) options->batch_work = 0;
+    resolve_granularity(options);
+
+    if (is_batched(operand_as[0], products[0])){
+        if (!tune_batch) return;
+        long long int work = products[0]->rows * products[0]->cols * operand_as[0]->cols;
+        long long int count = TASK_TUNE_WORK / work;
+        if (count < 1) count = 1;
+        if (count > options->operations) count = options->operations;
+
+        long long int best_time = -1, best_work = TASK_BATCH_WORK;
+        for (long long int candidate = TASK_BATCH_WORK >> 4; candidate <= TASK_BATCH_WORK << 4; candidate <<= 2){
+            options->batch_work = candidate;
+            long long int elapsed = time_requests(options, operand_as, operand_bs, products, count, worker_pool);
+            if (best_time < 0 || elapsed < best_time){ best_time = elapsed; best_work = candidate; }
+        }
+        options->batch_work = best_work;
+        return;
+    }
+
+    if (!tune_tiles) return;
+    long long int best_time = -1, best_tiles = TASK_TILES_PER_THREAD;
+    for (long long int candidate = 1; candidate <= 4 * TASK_TILES_PER_THREAD; candidate *= 2){
+        options->tiles_per_thread = candidate;
+        long long int elapsed = time_requests(options, operand_as, operand_bs, products, 1, worker_pool);
+        if (best_time < 0 || elapsed < best_time){ best_time = elapsed; best_tiles = candidate; }
+    }
+    options->tiles_per_thread = best_tiles;
+}
+
+/**
+ * Enqueues filling the operand array with random values (reproducible from seed, see fill_operands) to the worker pool
+ * NOTE: WP_wait_idle before using the operands
+*/
+void request_init_operand(struct Matrix** operand_array, long long int size, uint64_t seed, double density, struct WorkerPool* worker_pool){
+    request_fill_operands(operand_array, size, 0, seed, density, worker_pool, NULL);
+}
+
+/**
+ * Same as request_init_operand, but the array starts at element offset of the operands (see fill_operands) and the tasks
+ * are counted in latch (if not NULL)
+*/
+void request_fill_operands(struct Matrix** operand_array, long long int size, long long int offset, uint64_t seed, double density, struct WorkerPool* worker_pool, struct WP_Latch* latch){
+    long long int elements = size * operand_array[0]->rows * operand_array[0]->cols;
+    for (long long int start = 0; start < elements; start += TASK_FILL_CHUNK){
+        struct FillTask task = {
+            .kind = TASK_FILL,
+            .operands = operand_array,
+            .offset = offset,
+            .start = start,
+            .end = (elements - start > TASK_FILL_CHUNK)? (start + TASK_FILL_CHUNK) : elements,
+            .seed = seed,
+            .density = density,
+        };
+        WP_submit_to(worker_pool, &task, sizeof(task), latch);
+    }
+}
+
+/**
+ * Enqueues copying a whole matrix array into the binary log (as matrix `which` of every operation) to the worker pool
+ * NOTE: WP_wait_idle before closing the log
+*/
+void request_log(struct BinLog* log, int which, struct Matrix** matrices, long long int size, struct WorkerPool* worker_pool){
+    long long int elements = size * matrices[0]->rows * matrices[0]->cols;
+    for (long long int start = 0; start < elements; start += TASK_LOG_CHUNK){
+        struct LogTask task = {
+            .kind = TASK_LOG,
+            .log = log,
+            .matrices = matrices,
+            .which = which,
+            .start = start,
+            .end = (elements - start > TASK_LOG_CHUNK)? (start + TASK_LOG_CHUNK) : elements,
+        };
+        WP_submit(worker_pool, &task, sizeof(task));
+    }
+}
+
+/**
+ * Handles one phase of Freivalds' check for a range of rows (that may span several products)
+*/
+void verify_handler(struct VerifyTask* task){
+    bool prepare = task->kind == TASK_VERIFY_PREPARE;
+    long long int rows = prepare? task->operand_bs[0]->rows : task->products[0]->rows;
+    long long int depth = task->operand_bs[0]->rows; // Entries per product
+
+    for (long long int row = task->start; row < task->end;){
+        long long int i = row / rows;
+        long long int first = row % rows;
+        long long int last = (task->end - (row - first) < rows)? task->end - (row - first) : rows;
+        uint64_t seed = verify_seed(task->seed, task->round, i);
+
+        if (prepare){
+            VERIFY_prepare(task->operand_bs[i], seed, first, last, task->entries + i * depth);
+        } else if (!VERIFY_check(task->operand_as[i], task->products[i], seed, first, last, task->entries + i * depth)){
+            atomic_store(task->failure, i);
+        }
+        row += last - first;
+    }
+}
+
+/**
+ * Runs options->verify rounds of Freivalds' check on every product on the worker pool
+ * Each round is two waves of tasks (B * r for every product, then the comparison) with a WP_wait_idle in between
+ * Returns the index of a wrong product (-1 if everything checks out)
+ * RAISES: Exits if could not allocate memory
+*/
+long long int verify_products(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct Options* options, struct WorkerPool* worker_pool){
+    if (options->verify == 0) return -1;
+
+    struct VERIFY_Entry* entries = malloc(count * operand_bs[0]->rows * sizeof(struct VERIFY_Entry));
+    if (entries == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for verification\n");
+        exit(1);
+    }
+    atomic_llong failure;
+    atomic_init(&failure, -1);
+
+    for (long long int round = 0; round < options->verify && atomic_load(&failure) < 0; ++round){
+        for (int phase = 0; phase < 2; ++phase){
+            enum TaskKind kind = (phase == 0)? TASK_VERIFY_PREPARE : TASK_VERIFY_CHECK;
+            long long int rows = count * ((phase == 0)? operand_bs[0]->rows : products[0]->rows);
+            long long int chunk = TASK_VERIFY_CHUNK / products[0]->cols;
+            if (chunk < 1) chunk = 1;
+
+            for (long long int start = 0; start < rows; start += chunk){
+                struct VerifyTask task = {
+                    .kind = kind,
+                    .operand_as = operand_as,
+                    .operand_bs = operand_bs,
+                    .products = products,
+                    .start = start,
+                    .end = (rows - start > chunk)? (start + chunk) : rows,
+                    .entries = entries,
+                    .seed = options->seed,
+                    .round = round,
+                    .failure = &failure,
+                };
+                WP_submit(worker_pool, &task, sizeof(task));
+            }
+            WP_wait_idle(worker_pool);
+        }
+    }
+
+    free(entries);
+    return atomic_load(&failure);
+}
+
+/**
+ * Handles part of the matrix multiplication (To be run in parallel)
+ * This is what every worker runs for every task, the counters (see perf.h) are taken around each one
+*/
+void sub_multiplication_handler(void* vtask){
+    long long int start = TRACE_now();
+    PERF_begin(WP_current_worker_id());
+    handle_task(vtask);
+    PERF_end();
+    TRACE_span(task_name(vtask), start);
+}
+
+/**
+ * Gets what a task shows up as in the trace (see trace.h)
+*/
+const char* task_name(void* vtask){
+    switch (*(enum TaskKind*)vtask){
+    case TASK_MULTIPLY: return (((struct MultiplicationTask*)vtask)->batch_count > 0)? "MultiplicationTask (batch)" : "MultiplicationTask (tile)";
+    case TASK_FILL: return "FillTask";
+    case TASK_VERIFY_PREPARE: return "VerifyTask (B * r)";
+    case TASK_VERIFY_CHECK: return "VerifyTask (check)";
+    case TASK_LOG: return "LogTask";
+    case TASK_STRASSEN: return "StrassenTask";
+    case TASK_CONSUME: return "ConsumeTask";
+    case TASK_SHARED: return "SharedTask";
+    case TASK_SPARSE: return "SparseTask";
+    case TASK_MAPPED: return "MappedTask";
+    case TASK_SPLIT: return "SplitTask";
+    default: return "unknown task";
+    }
+}
+
+/**
+ * Does a single task
+ * This basically calculates the result of one rectangular tile of the product matrix (or a batch of whole small products)
+ * NOTE: Also handles filling in part of an operand array (TASK_FILL), verification, binary logging, consuming streamed products,
+ *       the rows of sparse and out-of-core products and splitting products into tiles (TASK_SPLIT)
+*/
+void handle_task(void* vtask){
+    switch (*(enum TaskKind*)vtask){
+    case TASK_FILL:{
+        struct FillTask* fill = vtask;
+        fill_operands(fill->operands, fill->offset, fill->start, fill->end, fill->seed, fill->density);
+        return;
+    }
+    case TASK_VERIFY_PREPARE:
+    case TASK_VERIFY_CHECK:
+        verify_handler(vtask);
+        return;
+    case TASK_LOG:{
+        struct LogTask* log = vtask;
+        BINLOG_write_array(log->log, log->which, log->matrices, log->start, log->end);
+        return;
+    }
+    case TASK_STRASSEN:{
+        struct StrassenTask* strassen = vtask;
+        struct Arena* scratch = STRASSEN_thread_scratch(STRASSEN_scratch_bytes(strassen->op1->rows, strassen->op1->cols, strassen->op2->cols, strassen->res->dtype, strassen->cutoff));
+        STRASSEN_multiply(strassen->op1, strassen->op2, strassen->res, strassen->cutoff, scratch);
+        return;
+    }
+    case TASK_CONSUME:
+        consume_handler(vtask);
+        return;
+    case TASK_SHARED:{
+        struct SharedTask* shared = vtask;
+        for (long long int i = 0; i < shared->count; ++i){
+            struct MATRIX_View b = MATRIX_view(shared->op2s[i]), c = MATRIX_view(shared->res[i]);
+            KERNEL_gemm_packed_tile(1, shared->op1, &b, 0, &c, shared->row_start, shared->row_end, 0, c.cols);
+        }
+        return;
+    }
+    case TASK_SPARSE:{
+        struct SparseTask* sparse = vtask;
+        if (sparse->sparse_op2 != NULL) SPARSE_multiply_sparse_dense_rows(sparse->op1, sparse->sparse_op2, sparse->res, sparse->row_start, sparse->row_end);
+        else SPARSE_multiply_dense_rows(sparse->op1, sparse->op2, sparse->res, sparse->row_start, sparse->row_end);
+        return;
+    }
+    case TASK_MAPPED:{
+        struct MappedTask* mapped = vtask;
+        MAPPED_multiply_rows(mapped->op1, mapped->op2, mapped->res, mapped->plan, mapped->step, mapped->row_start, mapped->row_end);
+        return;
+    }
+    case TASK_SPLIT:{
+        struct SplitTask* split = vtask;
+        request_multiplication(split->op1, split->op2, split->res, split->pool, split->options, split->latch);
+        return;
+    }
+    default:
+        break;
+    }
+
+    struct MultiplicationTask* task = vtask;
+    if (task->batch_count > 0){
+        KERNEL_multiply_batch(task->batch_op1s, task->batch_op2s, task->batch_res, task->batch_count);
+        return;
+    }
+    KERNEL_multiply_tile(task->op1, task->op2, task->res, task->row_start, task->row_end, task->col_start, task->col_end);
+}
+
+/**
+ * Checks whether products of this shape are handed out in batches of whole products (instead of being split into tiles)
+*/
+bool is_batched(struct Matrix* operand_a, struct Matrix* product){
+    return product->rows <= KERNEL_BATCH_MAX_ORDER && product->cols <= KERNEL_BATCH_MAX_ORDER && operand_a->cols <= KERNEL_BATCH_MAX_ORDER;
+}
+
+/**
+ * Picks the dimensions of the tiles a product is split into
+ * Tiles are roughly square (so both the A panel and the B panel get reused across the tile) and sized so that
+ * each worker gets about options->tiles_per_thread of them, rounded to multiples of the micro kernel block
+*/
+void choose_tile_size(struct Matrix* product, int thread_count, struct Options* options, long long int* tile_rows, long long int* tile_cols){
+    long long int area = (product->rows * product->cols) / (options->tiles_per_thread * (long long int)thread_count);
+    long long int side = 1;
+    while ((side + 1) * (side + 1) <= area) ++side; // isqrt (this is called once per product so who cares)
+    if (side < options->min_tile_side) side = options->min_tile_side;
+
+    *tile_rows = (side + KERNEL_MR - 1) / KERNEL_MR * KERNEL_MR;
+    *tile_cols = (side + KERNEL_NR - 1) / KERNEL_NR * KERNEL_NR;
+    if (*tile_rows > product->rows) *tile_rows = product->rows;
+    if (*tile_cols > product->cols) *tile_cols = product->cols;
+}
+
+/**
+ * Enqueues the multiplication operation to the worker pool (the tasks are counted in latch, if not NULL)
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void request_multiplication(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch){
+    if (!KERNEL_can_multiply(operand_a, operand_b, product)){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+
+    long long int tile_rows, tile_cols;
+    choose_tile_size(product, worker_pool->thread_count, options, &tile_rows, &tile_cols);
+
+    for (long long int row = 0; row < product->rows; row += tile_rows){
+        for (long long int col = 0; col < product->cols; col += tile_cols){
+            struct MultiplicationTask task = {
+                .kind = TASK_MULTIPLY,
+                .op1 = operand_a,
+                .op2 = operand_b,
+                .res = product,
+                .row_start = row,
+                .row_end = (product->rows - row > tile_rows)? (row + tile_rows) : product->rows,
+                .col_start = col,
+                .col_end = (product->cols - col > tile_cols)? (col + tile_cols) : product->cols,
+                .batch_count = 0,
+            };
+            WP_submit_to(worker_pool, &task, sizeof(task), latch); // NOTE: Copied into the queue, no malloc
+        }
+    }
+}
+
+/**
+ * Enqueues a task that splits the product into tiles once a worker picks it up (the tile tasks are counted in latch, if not NULL)
+ * Tasks submitted from inside a WP_WORK_STEALING pool go on the submitting worker's deque, so the tiles of a product start out
+ * on one worker (which goes through them newest first, while they are still warm) and idle workers steal the oldest ones
+ * NOTE: The split task itself is counted in latch as well, so the latch can't hit 0 before every tile has been submitted
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void request_split(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch){
+    if (!KERNEL_can_multiply(operand_a, operand_b, product)){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    struct SplitTask task = {
+        .kind = TASK_SPLIT,
+        .op1 = operand_a,
+        .op2 = operand_b,
+        .res = product,
+        .pool = worker_pool,
+        .options = options,
+        .latch = latch,
+    };
+    WP_submit_to(worker_pool, &task, sizeof(task), latch);
+}
+
+/**
+ * Picks how many whole products go into each batched task
+ * Enough that each task does about options->batch_work multiply-adds, but never so many that some workers get nothing to do
+*/
+long long int choose_batch_size(struct Matrix* operand_a, struct Matrix* product, long long int count, int thread_count, struct Options* options){
+    long long int work = product->rows * product->cols * operand_a->cols;
+    long long int batch = options->batch_work / work;
+    long long int tasks = options->tiles_per_thread * thread_count;
+    long long int fair_share = (count + tasks - 1) / tasks;
+
+    if (batch > fair_share) batch = fair_share;
+    return (batch < 1)? 1 : batch;
+}
+
+/**
+ * Enqueues a bunch of small multiplications to the worker pool, several whole products per task (counted in latch, if not NULL)
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void request_batch_multiplication(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch){
+    long long int batch = choose_batch_size(operand_as[0], products[0], count, worker_pool->thread_count, options);
+
+    for (long long int i = 0; i < count; i += batch){
+        struct MultiplicationTask task = {
+            .kind = TASK_MULTIPLY,
+            .batch_count = (count - i > batch)? batch : (count - i),
+            .batch_op1s = operand_as + i,
+            .batch_op2s = operand_bs + i,
+            .batch_res = products + i,
+        };
+        WP_submit_to(worker_pool, &task, sizeof(task), latch); // NOTE: Copied into the queue, no malloc
+    }
+}
+
+/**
+ * Picks how many levels of a Strassen-Winograd product get split on the main thread (at least 1, at most TASK_STRASSEN_LEVELS)
+ * Enough that there are about options->tiles_per_thread tasks per worker, if the product is big enough to split that far
+*/
+int strassen_levels(struct Matrix* operand_a, struct Matrix* operand_b, int thread_count, struct Options* options){
+    int levels = 1;
+    long long int tasks = 7, rows = (operand_a->rows + 1) / 2, depth = (operand_a->cols + 1) / 2, cols = (operand_b->cols + 1) / 2;
+    while (levels < TASK_STRASSEN_LEVELS && tasks < options->tiles_per_thread * thread_count && rows > options->strassen_cutoff && depth > options->strassen_cutoff && cols > options->strassen_cutoff){
+        ++levels; tasks *= 7;
+        rows = (rows + 1) / 2; depth = (depth + 1) / 2; cols = (cols + 1) / 2;
+    }
+    return levels;
+}
+
+/**
+ * Picks how many Strassen-Winograd products (of `leaves` tasks each, needing slot_bytes of scratch each) are kept in flight:
+ * enough that every worker has a task, plus one so the next product is already queued while the oldest gets merged, but no
+ * more than count or than TASK_STRASSEN_SCRATCH allows
+ * Returns 0 if even that many products can't give every worker a task (the products are better off tiled)
+*/
+long long int strassen_window(long long int leaves, size_t slot_bytes, long long int count, int thread_count){
+    long long int window = (thread_count + leaves - 1) / leaves + 1;
+    long long int affordable = (slot_bytes > 0)? (long long int)(TASK_STRASSEN_SCRATCH / slot_bytes) : window;
+    if (window > affordable) window = affordable;
+    if (window > count) window = count;
+    return (window * leaves >= thread_count)? window : 0;
+}
+
+/**
+ * Gets the scratch (in bytes) expand_strassen needs for `levels` levels of a product
+*/
+size_t strassen_tree_bytes(long long int rows, long long int depth, long long int cols, enum MATRIX_DType dtype, long long int cutoff, int levels){
+    if (levels == 0 || rows <= cutoff || depth <= cutoff || cols <= cutoff) return 0;
+    return STRASSEN_split_bytes(rows, depth, cols, dtype) + 7 * strassen_tree_bytes((rows + 1) / 2, (depth + 1) / 2, (cols + 1) / 2, dtype, cutoff, levels - 1);
+}
+
+/**
+ * Splits a product for `levels` levels (adding every split to splits, parents before their children) and enqueues the products
+ * of the last level as StrassenTasks counted by latch
+*/
+void expand_strassen(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, int levels, struct Arena* scratch, struct STRASSEN_Split* splits, int* split_count, struct WorkerPool* worker_pool, struct WP_Latch* latch, struct Options* options){
+    if (levels == 0 || !STRASSEN_should_split(operand_a, operand_b, options->strassen_cutoff)){
+        struct StrassenTask task = {
+            .kind = TASK_STRASSEN,
+            .op1 = operand_a,
+            .op2 = operand_b,
+            .res = product,
+            .cutoff = options->strassen_cutoff,
+        };
+        WP_submit_to(worker_pool, &task, sizeof(task), latch);
+        return;
+    }
+
+    struct STRASSEN_Split* split = &splits[(*split_count)++];
+    STRASSEN_split(operand_a, operand_b, product, scratch, split);
+    for (int i = 0; i < 7; ++i){
+        expand_strassen(split->operands[i][0], split->operands[i][1], split->products[i], levels - 1, scratch, splits, split_count, worker_pool, latch, options);
+    }
+}
+
+/**
+ * Does `count` Strassen-Winograd multiplications (products[i] = operand_as[i] * operand_bs[i]) on the worker pool
+ * The top levels of each product are split here, their 7^levels products run as tasks and the merges happen here once they are done
+ * A product alone is only 7^levels tasks (7 for orders up to twice the cutoff), so a window of products (see strassen_window)
+ * is kept in flight, each with its own scratch and latch: the oldest one is merged while the workers go through the tasks of
+ * the rest, then its slot takes the next product. If no window gives every worker a task the products are tiled instead
+ * NOTE: Unlike the other request_ functions this blocks till the products are done (the merges need the tasks to be done)
+ * NOTE: Every matrix in the arrays is expected to have the same shape (as create_matrix_array makes them)
+ * RAISES: Exits if the matrices provided are not of correct dimensions or if could not allocate memory
+*/
+void request_strassen_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options){
+    if (!KERNEL_can_multiply(operand_as[0], operand_bs[0], products[0])){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    int levels = strassen_levels(operand_as[0], operand_bs[0], worker_pool->thread_count, options);
+    int max_splits = 0;
+    long long int leaves = 1;
+    for (int level = 0; level < levels; ++level, leaves *= 7) max_splits += leaves;
+    size_t tree_bytes = strassen_tree_bytes(operand_as[0]->rows, operand_as[0]->cols, operand_bs[0]->cols, products[0]->dtype, options->strassen_cutoff, levels);
+    size_t slot_bytes = ARENA_round(max_splits * sizeof(struct STRASSEN_Split)) + tree_bytes;
+    long long int window = strassen_window(leaves, slot_bytes, count, worker_pool->thread_count);
+
+    if (window == 0){ // Too few products (or too big ones) to keep every worker busy, tiles can
+        struct WP_Latch latch;
+        WP_latch_init(&latch);
+        for (long long int i = 0; i < count; ++i) request_multiplication(operand_as[i], operand_bs[i], products[i], worker_pool, options, &latch);
+        WP_latch_wait(&latch);
+        WP_latch_destroy(&latch);
+        return;
+    }
+
+    // One slot (scratch, splits and latch) per product in flight, product i goes in slot i % window
+    struct Arena** scratches = malloc(window * sizeof(struct Arena*));
+    struct STRASSEN_Split** splits = malloc(window * sizeof(struct STRASSEN_Split*));
+    int* split_counts = malloc(window * sizeof(int));
+    struct WP_Latch* latches = malloc(window * sizeof(struct WP_Latch));
+    if (scratches == NULL || splits == NULL || split_counts == NULL || latches == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for Strassen-Winograd products\n");
+        exit(1);
+    }
+    for (long long int s = 0; s < window; ++s){
+        scratches[s] = ARENA_create(slot_bytes);
+        WP_latch_init(&latches[s]);
+    }
+
+    for (long long int i = 0; i < count + window; ++i){
+        long long int s = i % window;
+        if (i >= window){ // The slot still holds product i - window, merge it before reusing the slot
+            WP_latch_wait(&latches[s]);
+            for (int k = split_counts[s] - 1; k >= 0; --k) STRASSEN_merge(&splits[s][k]); // Children before their parents
+            ARENA_rewind(scratches[s], 0);
+        }
+        if (i < count){
+            splits[s] = ARENA_alloc(scratches[s], max_splits * sizeof(struct STRASSEN_Split));
+            split_counts[s] = 0;
+            expand_strassen(operand_as[i], operand_bs[i], products[i], levels, scratches[s], splits[s], &split_counts[s], worker_pool, &latches[s], options);
+        }
+    }
+
+    for (long long int s = 0; s < window; ++s){
+        WP_latch_destroy(&latches[s]);
+        ARENA_free(scratches[s]);
+    }
+    free(latches);
+    free(split_counts);
+    free(splits);
+    free(scratches);
+}
+
+/**
+ * Does `count` multiplications that all share the same premultiplicand (products[i] = operand_a * operand_bs[i]) on the worker pool
+ * A is packed once (instead of once per tile of every product) and every task reads its panels straight from there, so the
+ * packed A is all that A ever costs in cache and memory traffic no matter how many Bs there are
+ * The work is split across the Bs first (each task goes through a run of whole products, about options->tiles_per_thread
+ * tasks per worker), and only if there aren't enough Bs for that are the rows of A split into bands (multiples of KERNEL_MC rows)
+ * NOTE: Like request_strassen_multiplications this blocks till the products are done (the packed A is freed afterwards)
+ * RAISES: Exits if the matrices provided are not of correct dimensions or if could not allocate memory
+*/
+void request_shared_multiplications(struct Matrix* operand_a, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options){
+    if (!KERNEL_can_multiply(operand_a, operand_bs[0], products[0])){
+        fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+        exit(1);
+    }
+    struct MATRIX_View a = MATRIX_view(operand_a);
+    struct KERNEL_PackedA* packed = KERNEL_pack_a(&a);
+
+    long long int tasks = options->tiles_per_thread * worker_pool->thread_count;
+    long long int runs = (count < tasks)? count : tasks;
+    long long int run = (count + runs - 1) / runs;
+    long long int bands = (tasks + runs - 1) / runs;
+    long long int band_rows = (operand_a->rows + bands - 1) / bands;
+    band_rows = (band_rows + KERNEL_MC - 1) / KERNEL_MC * KERNEL_MC;
+
+    struct WP_Latch latch;
+    WP_latch_init(&latch);
+    for (long long int i = 0; i < count; i += run){
+        for (long long int row = 0; row < operand_a->rows; row += band_rows){
+            struct SharedTask task = {
+                .kind = TASK_SHARED,
+                .op1 = packed,
+                .op2s = operand_bs + i,
+                .res = products + i,
+                .count = (count - i > run)? run : (count - i),
+                .row_start = row,
+                .row_end = (operand_a->rows - row > band_rows)? (row + band_rows) : operand_a->rows,
+            };
+            WP_submit_to(worker_pool, &task, sizeof(task), &latch);
+        }
+    }
+    WP_latch_wait(&latch);
+    WP_latch_destroy(&latch);
+    KERNEL_free_packed_a(packed);
+}
+
+/**
+ * Checks whether a product should be computed with operand_a as a sparse matrix (options->sparse, or when that is auto the
+ * density heuristic for products with every dimension at least SPARSE_MIN_ORDER)
+*/
+bool use_sparse(struct Matrix* operand_a, struct Matrix* operand_b, struct Options* options){
+    switch (options->sparse){
+    case OPTIONS_SPARSE_ON: return true;
+    case OPTIONS_SPARSE_OFF: return false;
+    default:
+        if (operand_a->rows < SPARSE_MIN_ORDER || operand_a->cols < SPARSE_MIN_ORDER || operand_b->cols < SPARSE_MIN_ORDER) return false;
+        return SPARSE_is_sparse(operand_a, SPARSE_MAX_DENSITY);
+    }
+}
+
+/**
+ * Picks how many tasks the rows of a sparse product are split into: about options->batch_work multiply-adds each (the work
+ * being SPARSE_row_work's, times cols for a dense postmultiplicand and 1 for a sparse one), at most options->tiles_per_thread
+ * per worker and at most one per row
+*/
+long long int sparse_task_count(struct SPARSE_Matrix* operand_a, const long long int* work, long long int cols, int thread_count, struct Options* options){
+    long long int multiply_adds = (work[operand_a->rows] - operand_a->rows) * cols;
+    long long int tasks = multiply_adds / options->batch_work + 1;
+    if (tasks > options->tiles_per_thread * thread_count) tasks = options->tiles_per_thread * thread_count;
+    return (tasks < operand_a->rows)? tasks : operand_a->rows;
+}
+
+/**
+ * Enqueues a sparse task for every part of the rows of task.op1 (split by work, see SPARSE_partition) to the worker pool
+ * Everything but the rows is taken from task, and the tasks are counted in latch
+ * RAISES: Exits if could not allocate memory
+*/
+void request_sparse_rows(struct SparseTask task, const long long int* work, long long int parts, struct WorkerPool* worker_pool, struct WP_Latch* latch){
+    long long int* bounds = malloc((parts + 1) * sizeof(long long int));
+    if (bounds == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for sparse partition\n");
+        exit(1);
+    }
+    SPARSE_partition(work, task.op1->rows, parts, bounds);
+    for (long long int p = 0; p < parts; ++p){
+        if (bounds[p] == bounds[p + 1]) continue;
+        task.row_start = bounds[p];
+        task.row_end = bounds[p + 1];
+        WP_submit_to(worker_pool, &task, sizeof(task), latch);
+    }
+    free(bounds);
+}
+
+/**
+ * Computes `count` multiplications (products[i] = operand_as[i] * operand_bs[i]) with every A converted to CSR (see sparse.h)
+ * Each B stays dense unless it is sparse too (by the density heuristic whatever options->sparse says, then it is converted
+ * as well and the product goes through Gustavson's algorithm), products are always dense
+ * The rows of every product are split into tasks of about equal nonzeros (not rows, see SPARSE_row_work), and the tasks of
+ * every product go to the pool at once
+ * NOTE: Like request_strassen_multiplications this blocks till the products are done (the sparse operands are freed afterwards)
+ * RAISES: Exits if the matrices provided are not of correct dimensions or if could not allocate memory
+*/
+void request_sparse_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options){
+    struct SPARSE_Matrix** sparse = calloc(2 * count, sizeof(struct SPARSE_Matrix*)); // The A and (NULL if dense) B of every product
+    if (sparse == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for sparse operands\n");
+        exit(1);
+    }
+
+    struct WP_Latch latch;
+    WP_latch_init(&latch);
+    for (long long int i = 0; i < count; ++i){
+        if (!KERNEL_can_multiply(operand_as[i], operand_bs[i], products[i])){
+            fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+            exit(1);
+        }
+        sparse[2 * i] = SPARSE_from_dense(operand_as[i]);
+        if (SPARSE_is_sparse(operand_bs[i], SPARSE_MAX_DENSITY)) sparse[2 * i + 1] = SPARSE_from_dense(operand_bs[i]);
+
+        struct SparseTask task = {
+            .kind = TASK_SPARSE,
+            .op1 = sparse[2 * i],
+            .op2 = (sparse[2 * i + 1] == NULL)? operand_bs[i] : NULL,
+            .sparse_op2 = sparse[2 * i + 1],
+            .res = products[i],
+        };
+        long long int* work = SPARSE_row_work(task.op1, task.sparse_op2);
+        long long int parts = sparse_task_count(task.op1, work, (task.sparse_op2 == NULL)? products[i]->cols : 1, worker_pool->thread_count, options);
+        request_sparse_rows(task, work, parts, worker_pool, &latch);
+        free(work);
+    }
+    WP_latch_wait(&latch);
+    WP_latch_destroy(&latch);
+
+    for (long long int i = 0; i < 2 * count; ++i){
+        if (sparse[i] != NULL) SPARSE_free(sparse[i]);
+    }
+    free(sparse);
+}
+
+/**
+ * Computes `count` multiplications (products[i] = operand_as[i] * operand_bs[i]) out-of-core (see mapped.h), one product
+ * and one step at a time so that only about options->working_set megabytes are mapped at once
+ * The rows of every step's tile are split into tasks (about options->tiles_per_thread per worker, at least options->min_tile_side
+ * rows each), and while they run the main thread prefetches the next step and then lets go of what is done
+ * NOTE: Like request_strassen_multiplications this blocks till the products are done
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void request_mapped_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options){
+    long long int working_set = (options->working_set > 0)? (options->working_set << 20) : MAPPED_WORKING_SET;
+    struct WP_Latch latch;
+    WP_latch_init(&latch);
+
+    for (long long int i = 0; i < count; ++i){
+        if (!KERNEL_can_multiply(operand_as[i], operand_bs[i], products[i])){
+            fprintf(stderr, "ERROR! Invalid matrix dimension for multiplication\n");
+            exit(1);
+        }
+        struct MAPPED_Plan plan;
+        MAPPED_plan(operand_as[i], operand_bs[i], working_set, &plan);
+        long long int band_rows = (plan.panel_rows + options->tiles_per_thread * worker_pool->thread_count - 1) / (options->tiles_per_thread * worker_pool->thread_count);
+        if (band_rows < options->min_tile_side) band_rows = options->min_tile_side;
+
+        long long int steps = MAPPED_steps(&plan);
+        MAPPED_release(operand_as[i]);
+        MAPPED_release(operand_bs[i]);
+        MAPPED_prefetch(operand_as[i], operand_bs[i], &plan, 0);
+        for (long long int step = 0; step < steps; ++step){
+            struct MAPPED_Step s = MAPPED_step(operand_as[i], operand_bs[i], &plan, step);
+            for (long long int row = s.row; row < s.row + s.rows; row += band_rows){
+                struct MappedTask task = {
+                    .kind = TASK_MAPPED,
+                    .op1 = operand_as[i],
+                    .op2 = operand_bs[i],
+                    .res = products[i],
+                    .plan = &plan,
+                    .step = step,
+                    .row_start = row,
+                    .row_end = (s.row + s.rows - row > band_rows)? (row + band_rows) : (s.row + s.rows),
+                };
+                WP_submit_to(worker_pool, &task, sizeof(task), &latch);
+            }
+            if (step + 1 < steps) MAPPED_prefetch(operand_as[i], operand_bs[i], &plan, step + 1);
+            WP_latch_wait(&latch);
+            MAPPED_finish(operand_as[i], operand_bs[i], products[i], &plan, step);
+        }
+    }
+    WP_latch_destroy(&latch);
+}
+
+/**
+ * Enqueues `count` multiplications (products[i] = operand_as[i] * operand_bs[i]) to the worker pool
+ * Mapped products (see create_mapped_matrix_array) are computed out-of-core (which blocks, see request_mapped_multiplications),
+ * with options->shared_a every product shares operand_as[0] (which blocks, see request_shared_multiplications), otherwise
+ * sparse As (see use_sparse, only operand_as[0] is looked at) go through the sparse kernels (which blocks, see request_sparse_multiplications),
+ * big products (every dimension above options->strassen_cutoff) go through Strassen-Winograd (which blocks, see request_strassen_multiplications),
+ * small products (up to KERNEL_BATCH_MAX_ORDER) are batched, everything else is split into tiles (on a worker in a
+ * WP_WORK_STEALING pool, see request_split)
+ * NOTE: Every matrix in the arrays is expected to have the same shape (as create_matrix_array makes them)
+ * RAISES: Exits if the matrices provided are not of correct dimensions
+*/
+void request_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options){
+    request_multiplications_to(operand_as, operand_bs, products, count, worker_pool, options, NULL);
+}
+
+/**
+ * Same as request_multiplications, but the tasks are also counted in latch (if not NULL)
+ * NOTE: Strassen-Winograd, sparse, mapped and shared operand products are already done by the time this returns, so they never add to latch
+*/
+void request_multiplications_to(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch){
+    if (products[0]->mapping != NULL){
+        request_mapped_multiplications(operand_as, operand_bs, products, count, worker_pool, options);
+        return;
+    }
+    if (options->shared_a){
+        request_shared_multiplications(operand_as[0], operand_bs, products, count, worker_pool, options);
+        return;
+    }
+    if (use_sparse(operand_as[0], operand_bs[0], options)){
+        request_sparse_multiplications(operand_as, operand_bs, products, count, worker_pool, options);
+        return;
+    }
+    if (STRASSEN_should_split(operand_as[0], operand_bs[0], options->strassen_cutoff)){
+        request_strassen_multiplications(operand_as, operand_bs, products, count, worker_pool, options);
+        return;
+    }
+    if (is_batched(operand_as[0], products[0])){
+        request_batch_multiplication(operand_as, operand_bs, products, count, worker_pool, options, latch);
+        return;
+    }
+
+    for (long long int i = 0; i < count; ++i){
+        if (worker_pool->mode == WP_WORK_STEALING) request_split(operand_as[i], operand_bs[i], products[i], worker_pool, options, latch);
+        else request_multiplication(operand_as[i], operand_bs[i], products[i], worker_pool, options, latch);
+    }
+}
+
+/**
+ * Consumes a finished streamed product: runs task->verify rounds of Freivalds' check on it, copies the operation into the
+ * binary log and adds the product to the checksum
+*/
+void consume_handler(struct ConsumeTask* task){
+    for (long long int round = 0; round < task->verify; ++round){
+        if (!VERIFY_product(task->op1, task->op2, task->res, verify_seed(task->seed, round, task->operation))){
+            atomic_store(task->failure, task->operation);
+            break;
+        }
+    }
+    if (task->log != NULL){
+        long long int elements = task->res->rows * task->res->cols;
+        BINLOG_write(task->log, task->operation, 0, task->op1, 0, elements);
+        BINLOG_write(task->log, task->operation, 1, task->op2, 0, elements);
+        BINLOG_write(task->log, task->operation, 2, task->res, 0, elements);
+    }
+    atomic_fetch_add_explicit(task->checksum, checksum_matrix(task->res, task->operation), memory_order_relaxed);
+}
+
+/**
+ * Enqueues consuming every product of a streamed chunk (one ConsumeTask per product, counted in the slot's latch)
+*/
+void request_consume(struct StreamSlot* slot, struct Options* options, struct BinLog* log, atomic_ullong* checksum, atomic_llong* failure, struct WorkerPool* worker_pool){
+    for (long long int i = 0; i < slot->count; ++i){
+        struct ConsumeTask task = {
+            .kind = TASK_CONSUME,
+            .op1 = slot->operand_as[i],
+            .op2 = slot->operand_bs[i],
+            .res = slot->products[i],
+            .operation = slot->first + i,
+            .verify = options->verify,
+            .seed = options->seed,
+            .log = log,
+            .checksum = checksum,
+            .failure = failure,
+        };
+        WP_submit_to(worker_pool, &task, sizeof(task), &slot->latch);
+    }
+}
+
+/**
+ * Picks how many operations go into each streamed chunk
+ * Enough that multiplying a chunk hands every worker about TASK_STREAM_TASKS_PER_THREAD tasks (several batches, or at least
+ * one whole product that gets tiled) so that a single chunk can keep the pool busy
+*/
+long long int stream_chunk_size(struct Options* options, int thread_count){
+    long long int work = options->matrix_order * options->matrix_order * options->matrix_order;
+    long long int chunk = TASK_STREAM_TASKS_PER_THREAD * thread_count * options->batch_work / work;
+    if (chunk > options->operations) chunk = options->operations;
+    return (chunk < 1)? 1 : chunk;
+}
+
+/**
+ * Does every multiplication of the run in a pipeline that only ever has options->stream chunks of operations in memory
+ * (instead of all of them up front), returns the operation that failed verification (-1 if everything checks out)
+ * Every chunk goes through three stages on the worker pool, each one waited on (through the chunk's latch) before the next:
+ *  fill (the operands, the same values as without streaming), multiply and consume (verify, binary log and checksum)
+ * and every step of the loop below starts filling chunk i, multiplying chunk i - 1 and consuming chunk i - 2, so generating
+ * and consuming overlap with the multiplications. A slot is only refilled once the chunk that was in it has been consumed
+ * The sum of checksum_matrix of every product is written to checksum
+ * NOTE: Peak memory is 3 * options->stream * chunk matrices (see stream_chunk_size), not 3 * options->operations
+ * NOTE: Expects the granularity to be resolved already (see resolve_granularity)
+ * RAISES: Exits if could not allocate memory
+*/
+long long int stream_multiplications(struct Options* options, struct WorkerPool* worker_pool, struct BinLog* log, uint64_t* checksum){
+    long long int order = options->matrix_order;
+    long long int chunk = stream_chunk_size(options, worker_pool->thread_count);
+    long long int chunks = (options->operations + chunk - 1) / chunk;
+    long long int depth = (options->stream < chunks)? options->stream : chunks; // No point in slots that never get used
+
+    struct StreamSlot* slots = malloc(depth * sizeof(struct StreamSlot));
+    if (slots == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the stream\n");
+        exit(1);
+    }
+    for (long long int i = 0; i < depth; ++i){
+        slots[i].operand_as = create_matrix_array(chunk, order, order, options->dtype);
+        slots[i].operand_bs = create_matrix_array(chunk, order, order, options->dtype);
+        slots[i].products   = create_matrix_array(chunk, order, order, options->dtype);
+        WP_latch_init(&slots[i].latch);
+    }
+    atomic_ullong sum;
+    atomic_init(&sum, 0);
+    atomic_llong failure;
+    atomic_init(&failure, -1);
+
+    for (long long int step = 0; step < chunks + 2; ++step){
+        if (step < chunks){ // Fill
+            struct StreamSlot* slot = &slots[step % depth];
+            WP_latch_wait(&slot->latch); // The chunk that was here has been consumed
+            slot->first = step * chunk;
+            slot->count = (options->operations - slot->first < chunk)? options->operations - slot->first : chunk;
+            request_fill_operands(slot->operand_as, slot->count, slot->first * order * order, RNG_stream(options->seed, OPERAND_A_STREAM), options->density, worker_pool, &slot->latch);
+            request_fill_operands(slot->operand_bs, slot->count, slot->first * order * order, RNG_stream(options->seed, OPERAND_B_STREAM), options->density, worker_pool, &slot->latch);
+        }
+        if (step >= 1 && step - 1 < chunks){ // Multiply
+            struct StreamSlot* slot = &slots[(step - 1) % depth];
+            WP_latch_wait(&slot->latch); // Filled
+            request_multiplications_to(slot->operand_as, slot->operand_bs, slot->products, slot->count, worker_pool, options, &slot->latch);
+        }
+        if (step >= 2){ // Consume
+            struct StreamSlot* slot = &slots[(step - 2) % depth];
+            WP_latch_wait(&slot->latch); // Multiplied
+            request_consume(slot, options, log, &sum, &failure, worker_pool);
+        }
+    }
+
+    for (long long int i = 0; i < depth; ++i){
+        WP_latch_wait(&slots[i].latch);
+        WP_latch_destroy(&slots[i].latch);
+        free_matrix_array(slots[i].operand_as, chunk);
+        free_matrix_array(slots[i].operand_bs, chunk);
+        free_matrix_array(slots[i].products, chunk);
+    }
+    free(slots);
+
+    *checksum = atomic_load(&sum);
+    return atomic_load(&failure);
+}
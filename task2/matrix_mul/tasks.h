@@ -0,0 +1,239 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides the tasks parallel.c (and bench.c) hand to the worker pool, and the functions that split work up into them
+ * 
+ * Every task starts with its TaskKind and is copied straight into a worker pool slot (so none of them may be bigger than
+ * WP_TASK_SIZE), sub_multiplication_handler is the one handler every worker runs and tells them apart by that kind
+ * 
+*/ 
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "options.h"
+#include "common.h"
+#include "worker_pool.h"
+#include "kernel.h"
+#include "verify.h"
+#include "binlog.h"
+#include "perf.h"
+#include "strassen.h"
+#include "sparse.h"
+#include "mapped.h"
+
+
+// NOTE: The TASK_ values below are just the defaults, all of them can be changed at runtime (see options.h)
+// Each product is split into roughly this many tiles per worker (a few extra so the ragged last tiles don't leave cores idle)
+#define TASK_TILES_PER_THREAD 4
+// Too small and the threads wait a lot more causing bad performance (and the packed panels barely get reused) (balance is key)
+#define TASK_MIN_TILE_SIDE 32
+// Batched tasks (see KERNEL_BATCH_MAX_ORDER) get about this many multiply-adds worth of whole products each (enough to amortize the queue round trip)
+#define TASK_BATCH_WORK (1 << 18)
+// Autotuning times every candidate this many times and keeps the best (the first run also warms up the packing buffers)
+#define TASK_TUNE_REPEATS 2
+// Autotuning of batched tasks only multiplies about this many multiply-adds worth of products per run (so that it stays quick)
+#define TASK_TUNE_WORK (1 << 26)
+// Number of operand elements each fill task generates
+#define TASK_FILL_CHUNK (1 << 16)
+// Number of matrix elements each binary log task copies
+#define TASK_LOG_CHUNK (1 << 18)
+// Number of matrix elements each verification task reads (rows are spread over tasks across products, like TASK_FILL_CHUNK)
+#define TASK_VERIFY_CHUNK (1 << 16)
+// Strassen-Winograd products are split on the main thread for at most this many levels (7^2 = 49 tasks), the products of
+// the last level are tasks (that keep splitting on their own till the cutoff)
+#define TASK_STRASSEN_LEVELS 2
+// Strassen-Winograd products in flight at once (each one's split operands and products) get at most this much scratch in total,
+// if that isn't enough products to give every worker a task they are tiled instead (see strassen_window)
+#define TASK_STRASSEN_SCRATCH (1LL << 30)
+// Streamed chunks hold about this many batched tasks worth of products per worker (see stream_chunk_size)
+#define TASK_STREAM_TASKS_PER_THREAD 4
+
+enum TaskKind{
+    TASK_MULTIPLY, // A MultiplicationTask
+    TASK_FILL, // A FillTask
+    TASK_VERIFY_PREPARE, // A VerifyTask computing B * r
+    TASK_VERIFY_CHECK, // A VerifyTask comparing A * (B * r) with C * r
+    TASK_LOG, // A LogTask
+    TASK_STRASSEN, // A StrassenTask
+    TASK_CONSUME, // A ConsumeTask
+    TASK_SHARED, // A SharedTask
+    TASK_SPARSE, // A SparseTask
+    TASK_MAPPED, // A MappedTask
+    TASK_SPLIT, // A SplitTask
+};
+
+struct MultiplicationTask{
+    enum TaskKind kind; // TASK_MULTIPLY (every task starts with its kind, that's how the handler tells them apart)
+    struct Matrix* op1; // The premultiplicand
+    struct Matrix* op2; // The postmultiplicand
+    struct Matrix* res; // The matrix in which the product is to be stored
+    long long int row_start; // The first row of the tile that this task is supposed to compute
+    long long int row_end; // One past the last row of the tile
+    long long int col_start; // The first column of the tile that this task is supposed to compute
+    long long int col_end; // One past the last column of the tile
+
+    // Batched tasks (for small matrices) compute whole products instead of a single tile
+    long long int batch_count; // The number of whole products in this task (0 for a regular tile task)
+    struct Matrix** batch_op1s; // The premultiplicands of the batch
+    struct Matrix** batch_op2s; // The postmultiplicands of the batch
+    struct Matrix** batch_res; // The matrices in which the products of the batch are to be stored
+};
+_Static_assert(sizeof(struct MultiplicationTask) <= WP_TASK_SIZE, "MultiplicationTask must fit in a worker pool slot");
+
+struct FillTask{
+    enum TaskKind kind; // TASK_FILL
+    struct Matrix** operands; // The operand array being filled
+    long long int offset; // The number of the array's first element among all the operands (see fill_operands)
+    long long int start; // The first element (numbered across the whole array, see fill_operands) this task fills
+    long long int end; // One past the last element
+    uint64_t seed; // The stream the operand array is generated from
+    double density; // Fraction of the elements left nonzero (see fill_operands)
+};
+_Static_assert(sizeof(struct FillTask) <= WP_TASK_SIZE, "FillTask must fit in a worker pool slot");
+
+struct VerifyTask{
+    enum TaskKind kind; // TASK_VERIFY_PREPARE or TASK_VERIFY_CHECK
+    struct Matrix** operand_as; // The premultiplicands
+    struct Matrix** operand_bs; // The postmultiplicands
+    struct Matrix** products; // The products being verified
+    long long int start; // The first row this task handles (rows numbered across all products, of B when preparing and of C when checking)
+    long long int end; // One past the last row
+    struct VERIFY_Entry* entries; // B * r of every product (one after the other)
+    uint64_t seed; // The seed of the round (see verify_seed)
+    long long int round; // The round being run
+    atomic_llong* failure; // Set to the index of a wrong product (left alone if everything checks out)
+};
+_Static_assert(sizeof(struct VerifyTask) <= WP_TASK_SIZE, "VerifyTask must fit in a worker pool slot");
+
+struct LogTask{
+    enum TaskKind kind; // TASK_LOG
+    struct BinLog* log; // The log being written
+    struct Matrix** matrices; // The matrix array being copied into the log
+    int which; // Which matrix of each operation the array is (0 for operand a, 1 for operand b and 2 for the product)
+    long long int start; // The first element (numbered across the whole array, like FillTask) this task copies
+    long long int end; // One past the last element
+};
+_Static_assert(sizeof(struct LogTask) <= WP_TASK_SIZE, "LogTask must fit in a worker pool slot");
+
+struct StrassenTask{
+    enum TaskKind kind; // TASK_STRASSEN
+    struct Matrix* op1; // The premultiplicand
+    struct Matrix* op2; // The postmultiplicand
+    struct Matrix* res; // The matrix in which the (whole) product is to be stored
+    long long int cutoff; // See STRASSEN_multiply
+};
+_Static_assert(sizeof(struct StrassenTask) <= WP_TASK_SIZE, "StrassenTask must fit in a worker pool slot");
+
+// Splits a product into MultiplicationTasks from inside the pool (WP_WORK_STEALING only, so that the tiles land on the deque
+// of the worker running it and the others steal them from there, see request_split)
+struct SplitTask{
+    enum TaskKind kind; // TASK_SPLIT
+    struct Matrix* op1; // The premultiplicand
+    struct Matrix* op2; // The postmultiplicand
+    struct Matrix* res; // The matrix in which the (whole) product is to be stored
+    struct WorkerPool* pool; // The pool the tiles are submitted to (the one running this task)
+    struct Options* options; // Picks the tile size (must outlive the product)
+    struct WP_Latch* latch; // Counts the tiles too (NULL if the product isn't part of a group)
+};
+_Static_assert(sizeof(struct SplitTask) <= WP_TASK_SIZE, "SplitTask must fit in a worker pool slot");
+
+struct ConsumeTask{
+    enum TaskKind kind; // TASK_CONSUME
+    struct Matrix* op1; // The premultiplicand
+    struct Matrix* op2; // The postmultiplicand
+    struct Matrix* res; // The (finished) product
+    long long int operation; // Which operation this is (numbered across the whole run, not just the chunk)
+    long long int verify; // Rounds of Freivalds' check to run on the product (0 for none)
+    uint64_t seed; // The user's seed (see verify_seed)
+    struct BinLog* log; // The log the operation is copied into (NULL if not logging)
+    atomic_ullong* checksum; // Sum of checksum_matrix of every product (added to, wrapping)
+    atomic_llong* failure; // Set to operation if the product is wrong (left alone if it checks out)
+};
+_Static_assert(sizeof(struct ConsumeTask) <= WP_TASK_SIZE, "ConsumeTask must fit in a worker pool slot");
+
+struct SharedTask{
+    enum TaskKind kind; // TASK_SHARED
+    const struct KERNEL_PackedA* op1; // The premultiplicand every product shares (packed once, see KERNEL_pack_a)
+    struct Matrix** op2s; // The postmultiplicands this task goes through
+    struct Matrix** res; // The matrices in which the products are to be stored
+    long long int count; // The number of products in this task
+    long long int row_start; // The first row (of every product) this task computes (a multiple of KERNEL_MC, see KERNEL_gemm_packed_tile)
+    long long int row_end; // One past the last row
+};
+_Static_assert(sizeof(struct SharedTask) <= WP_TASK_SIZE, "SharedTask must fit in a worker pool slot");
+
+struct SparseTask{
+    enum TaskKind kind; // TASK_SPARSE
+    struct SPARSE_Matrix* op1; // The premultiplicand
+    struct Matrix* op2; // The postmultiplicand if it is dense (NULL if it is sparse)
+    struct SPARSE_Matrix* sparse_op2; // The postmultiplicand if it is sparse (NULL if it is dense)
+    struct Matrix* res; // The matrix in which the product is to be stored
+    long long int row_start; // The first row of the product this task computes
+    long long int row_end; // One past the last row
+};
+_Static_assert(sizeof(struct SparseTask) <= WP_TASK_SIZE, "SparseTask must fit in a worker pool slot");
+
+struct MappedTask{
+    enum TaskKind kind; // TASK_MAPPED
+    struct Matrix* op1; // The premultiplicand
+    struct Matrix* op2; // The postmultiplicand
+    struct Matrix* res; // The matrix in which the product is to be stored
+    const struct MAPPED_Plan* plan; // How the product is split into steps (see MAPPED_plan)
+    long long int step; // The step this task is part of
+    long long int row_start; // The first row (of the step's tile) this task computes
+    long long int row_end; // One past the last row
+};
+_Static_assert(sizeof(struct MappedTask) <= WP_TASK_SIZE, "MappedTask must fit in a worker pool slot");
+
+// A chunk of operations in flight while streaming, its matrices get reused by every depth'th chunk
+struct StreamSlot{
+    struct Matrix** operand_as; // The premultiplicands of the chunk
+    struct Matrix** operand_bs; // The postmultiplicands of the chunk
+    struct Matrix** products; // The products of the chunk
+    long long int first; // The operation the chunk starts at
+    long long int count; // Operations in the chunk (the last one can be short)
+    struct WP_Latch latch; // Counts the tasks of the chunk's current stage (fill, multiply or consume)
+};
+
+void sub_multiplication_handler(void* task);
+void handle_task(void* task);
+const char* task_name(void* task);
+struct WorkerPool* create_worker_pool(struct Options* options);
+void request_init_operand(struct Matrix** operand_array, long long int size, uint64_t seed, double density, struct WorkerPool* worker_pool);
+void request_fill_operands(struct Matrix** operand_array, long long int size, long long int offset, uint64_t seed, double density, struct WorkerPool* worker_pool, struct WP_Latch* latch);
+void verify_handler(struct VerifyTask* task);
+void request_log(struct BinLog* log, int which, struct Matrix** matrices, long long int size, struct WorkerPool* worker_pool);
+long long int verify_products(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct Options* options, struct WorkerPool* worker_pool);
+void resolve_granularity(struct Options* options);
+void autotune_granularity(struct Options* options, struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, struct WorkerPool* worker_pool);
+long long int time_requests(struct Options* options, struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool);
+bool is_batched(struct Matrix* operand_a, struct Matrix* product);
+void choose_tile_size(struct Matrix* product, int thread_count, struct Options* options, long long int* tile_rows, long long int* tile_cols);
+long long int choose_batch_size(struct Matrix* operand_a, struct Matrix* product, long long int count, int thread_count, struct Options* options);
+void request_multiplication(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch);
+void request_split(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch);
+void request_batch_multiplication(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch);
+int strassen_levels(struct Matrix* operand_a, struct Matrix* operand_b, int thread_count, struct Options* options);
+long long int strassen_window(long long int leaves, size_t slot_bytes, long long int count, int thread_count);
+size_t strassen_tree_bytes(long long int rows, long long int depth, long long int cols, enum MATRIX_DType dtype, long long int cutoff, int levels);
+void expand_strassen(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, int levels, struct Arena* scratch, struct STRASSEN_Split* splits, int* split_count, struct WorkerPool* worker_pool, struct WP_Latch* latch, struct Options* options);
+void request_strassen_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options);
+void request_shared_multiplications(struct Matrix* operand_a, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options);
+bool use_sparse(struct Matrix* operand_a, struct Matrix* operand_b, struct Options* options);
+long long int sparse_task_count(struct SPARSE_Matrix* operand_a, const long long int* work, long long int cols, int thread_count, struct Options* options);
+void request_sparse_rows(struct SparseTask task, const long long int* work, long long int parts, struct WorkerPool* worker_pool, struct WP_Latch* latch);
+void request_sparse_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options);
+void request_mapped_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options);
+void request_multiplications(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options);
+void request_multiplications_to(struct Matrix** operand_as, struct Matrix** operand_bs, struct Matrix** products, long long int count, struct WorkerPool* worker_pool, struct Options* options, struct WP_Latch* latch);
+void consume_handler(struct ConsumeTask* task);
+void request_consume(struct StreamSlot* slot, struct Options* options, struct BinLog* log, atomic_ullong* checksum, atomic_llong* failure, struct WorkerPool* worker_pool);
+long long int stream_chunk_size(struct Options* options, int thread_count);
+long long int stream_multiplications(struct Options* options, struct WorkerPool* worker_pool, struct BinLog* log, uint64_t* checksum);
+
+#include "tasks.c"
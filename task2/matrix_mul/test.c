@@ -0,0 +1,82 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Checks that a product split into more tiles than a worker's deque and inbox can hold at once still finishes (and is right)
+ * with the work stealing scheduler
+ *
+ * Every tile of a product is submitted from inside the pool (see request_split), so with tiny tiles and queues the deque of
+ * the worker doing the split fills up, and a worker that waited for space there would wait forever (every other worker
+ * could be stuck doing the same)
+ *
+ * Inputs: None
+ *
+ * Outputs:
+ *  stdout:
+ *      OK (if the products were right and the pool's counts came back to 0)
+ *  Exits with an error if any product is wrong, and gets killed (SIGALRM) if they take longer than TEST_TIMEOUT seconds
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "matrix.h"
+#include "options.h"
+#include "common.h"
+#include "worker_pool.h"
+#include "kernel.h"
+#include "tasks.h"
+
+// Seconds after which the products are taken to have hung
+#define TEST_TIMEOUT 120
+// Order of the products, 512 / KERNEL_MR * 512 / KERNEL_NR tiles of KERNEL_MR x KERNEL_NR is 8192 tiles per product
+#define TEST_ORDER "512"
+
+int main(){
+    char* argv[] = {"test", TEST_ORDER, "2", "0", "--scheduler=stealing", "--threads=2", "--strassen_cutoff=off", "--sparse=off",
+                    "--min_tile_side=1", "--tiles_per_thread=100000", "--queue_capacity=2", "--verify=2", "--seed=1"};
+    int argc = sizeof(argv) / sizeof(argv[0]);
+    struct Options options; OPTIONS_set(&options, argc, argv);
+    KERNEL_init();
+
+    long long int tiles = (options.matrix_order / KERNEL_MR) * (options.matrix_order / KERNEL_NR);
+    if (tiles <= _DEQUE_CAPACITY + options.queue_capacity){
+        fprintf(stderr, "ERROR! %lld tiles per product fit in the deque and inbox, the test wouldn't test anything\n", tiles);
+        exit(1);
+    }
+
+    struct Matrix** operand_as = create_matrix_array(options.operations, options.matrix_order, options.matrix_order, options.dtype);
+    struct Matrix** operand_bs = create_matrix_array(options.operations, options.matrix_order, options.matrix_order, options.dtype);
+    struct Matrix** products   = create_matrix_array(options.operations, options.matrix_order, options.matrix_order, options.dtype);
+    struct WorkerPool* worker_pool = create_worker_pool(&options);
+
+    request_init_operand(operand_as, options.operations, RNG_stream(options.seed, OPERAND_A_STREAM), options.density, worker_pool);
+    request_init_operand(operand_bs, options.operations, RNG_stream(options.seed, OPERAND_B_STREAM), options.density, worker_pool);
+    WP_wait_idle(worker_pool);
+    autotune_granularity(&options, operand_as, operand_bs, products, worker_pool); // Nothing is set to auto, so this only fills in defaults
+
+    alarm(TEST_TIMEOUT); // A hang is the failure this is looking for
+    request_multiplications(operand_as, operand_bs, products, options.operations, worker_pool, &options);
+    WP_wait_idle(worker_pool);
+    alarm(0);
+
+    long long int failure = verify_products(operand_as, operand_bs, products, options.operations, &options, worker_pool);
+    if (failure >= 0){
+        fprintf(stderr, "ERROR! Product %lld failed verification\n", failure);
+        exit(1);
+    }
+    printf("OK\n");
+
+    WP_request_stop(worker_pool);
+    WP_join(worker_pool);
+    if (WP_dispatched_tasks(worker_pool) != 0 || WP_pending_tasks(worker_pool) != 0){ // Tasks run in place of a push must not be left counted
+        fprintf(stderr, "ERROR! %lld dispatched and %lld pending tasks left over\n", WP_dispatched_tasks(worker_pool), WP_pending_tasks(worker_pool));
+        exit(1);
+    }
+    WP_free(worker_pool);
+    free_matrix_array(operand_as, options.operations);
+    free_matrix_array(operand_bs, options.operations);
+    free_matrix_array(products  , options.operations);
+}
@@ -0,0 +1,233 @@
+#include "topology.h"
+
+/**
+ * Reads a single integer out of a (sysfs) file, returns fallback if it couldn't
+*/
+int _TOPO_read_int(const char* path, int fallback){
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return fallback;
+    int value;
+    if (fscanf(file, "%d", &value) != 1) value = fallback;
+    fclose(file);
+    return value;
+}
+
+/**
+ * Parses a cpu/node list file (of the form `0-3,8,10-11`) into set (which must have TOPO_MAX_CPUS entries)
+ * Returns the number of ids in the list (-1 if the file couldn't be read)
+*/
+int _TOPO_parse_list(const char* path, bool* set){
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return -1;
+    memset(set, 0, TOPO_MAX_CPUS * sizeof(bool));
+
+    int count = 0, first, last;
+    while (fscanf(file, "%d", &first) == 1){
+        last = first;
+        int c = fgetc(file);
+        if (c == '-'){
+            if (fscanf(file, "%d", &last) != 1) break;
+            c = fgetc(file);
+        }
+        for (int id = first; id <= last && id < TOPO_MAX_CPUS; ++id){
+            if (id >= 0 && !set[id]){ set[id] = true; ++count; }
+        }
+        if (c != ',') break;
+    }
+    fclose(file);
+    return count;
+}
+
+/**
+ * Gets the cpus this process is allowed to run on (taskset, cgroups, ...) into set
+ * Returns -1 if the mask couldn't be read
+ * NOTE: Uses the raw syscall so that we don't need _GNU_SOURCE (and the CPU_SET macros) everywhere
+*/
+int _TOPO_affinity(bool* set){
+#if defined(__linux__) && defined(SYS_sched_getaffinity)
+    unsigned long mask[TOPO_MAX_CPUS / (8 * sizeof(unsigned long))] = {0};
+    long bytes = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+    if (bytes <= 0) return -1;
+
+    int count = 0;
+    for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu){
+        set[cpu] = (mask[cpu / (8 * sizeof(unsigned long))] >> (cpu % (8 * sizeof(unsigned long)))) & 1;
+        count += set[cpu];
+    }
+    return count;
+#else
+    (void)set;
+    return -1;
+#endif
+}
+
+/**
+ * Sorts cpus by (node, package, core, smt_index)
+*/
+int _TOPO_compare_cpus(const void* va, const void* vb){
+    const struct TOPO_Cpu* a = va;
+    const struct TOPO_Cpu* b = vb;
+    if (a->node != b->node) return (a->node < b->node)? -1 : 1;
+    if (a->package != b->package) return (a->package < b->package)? -1 : 1;
+    if (a->core != b->core) return (a->core < b->core)? -1 : 1;
+    return (a->cpu < b->cpu)? -1 : (a->cpu > b->cpu);
+}
+
+/**
+ * Reads the cpu layout of the machine
+ * RAISES: Exits if could not allocate memory
+*/
+struct Topology* TOPO_detect(){
+    struct Topology* topology = malloc(sizeof(struct Topology));
+    bool* usable = malloc(TOPO_MAX_CPUS * sizeof(bool));
+    bool* scratch = malloc(TOPO_MAX_CPUS * sizeof(bool));
+    int* node_of = malloc(TOPO_MAX_CPUS * sizeof(int));
+    if (topology == NULL || usable == NULL || scratch == NULL || node_of == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for Topology\n");
+        exit(1);
+    }
+
+    // Usable = online and in our affinity mask
+    if (_TOPO_parse_list(_TOPO_SYSFS_CPU "/online", usable) < 0){
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        if (online < 1) online = 1;
+        for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu) usable[cpu] = cpu < online;
+    }
+    if (_TOPO_affinity(scratch) > 0){
+        for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu) usable[cpu] = usable[cpu] && scratch[cpu];
+    }
+
+    // Which node every cpu is on (no node directory means no NUMA, so everything is node 0)
+    for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu) node_of[cpu] = 0;
+    bool* nodes = malloc(TOPO_MAX_CPUS * sizeof(bool));
+    if (nodes == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for Topology\n");
+        exit(1);
+    }
+    if (_TOPO_parse_list(_TOPO_SYSFS_NODE "/online", nodes) > 0){
+        char path[128];
+        for (int node = 0; node < TOPO_MAX_CPUS; ++node){
+            if (!nodes[node]) continue;
+            snprintf(path, sizeof(path), _TOPO_SYSFS_NODE "/node%d/cpulist", node);
+            if (_TOPO_parse_list(path, scratch) < 0) continue;
+            for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu){
+                if (scratch[cpu]) node_of[cpu] = node;
+            }
+        }
+    }
+    free(nodes);
+
+    int count = 0;
+    for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu) count += usable[cpu];
+    if (count == 0){ // Something is very off, at least pretend we have the cpu we are running on
+        usable[0] = true;
+        count = 1;
+    }
+    topology->cpus = malloc(count * sizeof(struct TOPO_Cpu));
+    if (topology->cpus == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for Topology\n");
+        exit(1);
+    }
+
+    topology->cpu_count = 0;
+    for (int cpu = 0; cpu < TOPO_MAX_CPUS; ++cpu){
+        if (!usable[cpu]) continue;
+        char path[128];
+        struct TOPO_Cpu* entry = &topology->cpus[topology->cpu_count++];
+        entry->cpu = cpu;
+        snprintf(path, sizeof(path), _TOPO_SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        entry->core = _TOPO_read_int(path, cpu); // Unknown layout, so every cpu is its own core
+        snprintf(path, sizeof(path), _TOPO_SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        entry->package = _TOPO_read_int(path, 0);
+        entry->node = node_of[cpu];
+    }
+    qsort(topology->cpus, topology->cpu_count, sizeof(struct TOPO_Cpu), _TOPO_compare_cpus);
+
+    // Siblings are next to each other after sorting, so numbering them (and counting cores and nodes) is a single pass
+    topology->core_count = 0;
+    topology->node_count = 0;
+    for (int i = 0; i < topology->cpu_count; ++i){
+        struct TOPO_Cpu* entry = &topology->cpus[i];
+        struct TOPO_Cpu* previous = (i > 0)? &topology->cpus[i - 1] : NULL;
+        bool same_core = previous != NULL && previous->node == entry->node && previous->package == entry->package && previous->core == entry->core;
+        entry->smt_index = same_core? previous->smt_index + 1 : 0;
+        if (!same_core) ++topology->core_count;
+        if (previous == NULL || previous->node != entry->node) ++topology->node_count;
+    }
+
+    free(usable);
+    free(scratch);
+    free(node_of);
+    return topology;
+}
+
+/**
+ * Frees everything TOPO_detect allocated
+*/
+void TOPO_free(struct Topology* topology){
+    free(topology->cpus);
+    free(topology);
+}
+
+/**
+ * Gets the number of threads worth running with this policy (one per physical core for TOPO_PIN_CORES, one per logical cpu otherwise)
+*/
+int TOPO_auto_thread_count(struct Topology* topology, enum TOPO_Policy policy){
+    return (policy == TOPO_PIN_CORES)? topology->core_count : topology->cpu_count;
+}
+
+/**
+ * Picks the cpu every one of thread_count threads gets pinned to (cpus must have thread_count entries)
+ * Cores are handed out node by node (so neighbouring workers share a node), SMT siblings only once every core has a thread
+ * If there are more threads than cpus for the policy they wrap around
+ * Returns the number of distinct cpus used (0 for TOPO_PIN_NONE, in which case cpus is filled with -1)
+*/
+int TOPO_plan(struct Topology* topology, enum TOPO_Policy policy, int thread_count, int* cpus){
+    if (policy == TOPO_PIN_NONE){
+        for (int i = 0; i < thread_count; ++i) cpus[i] = -1;
+        return 0;
+    }
+
+    int max_smt = (policy == TOPO_PIN_CORES)? 0 : TOPO_MAX_CPUS;
+    int planned = 0;
+    for (int smt = 0; smt <= max_smt && planned < thread_count; ++smt){
+        bool any = false;
+        for (int i = 0; i < topology->cpu_count && planned < thread_count; ++i){
+            if (topology->cpus[i].smt_index != smt) continue;
+            cpus[planned++] = topology->cpus[i].cpu;
+            any = true;
+        }
+        if (!any) break;
+    }
+
+    int distinct = planned;
+    for (int i = planned; i < thread_count; ++i) cpus[i] = cpus[i % distinct];
+    return distinct;
+}
+
+/**
+ * Pins the calling thread to a single cpu, returns false if that didn't work (which is fine, the thread just isn't pinned)
+ * NOTE: Uses the raw syscall so that we don't need _GNU_SOURCE (and the CPU_SET macros) everywhere
+*/
+bool TOPO_pin_current_thread(int cpu){
+#if defined(__linux__) && defined(SYS_sched_setaffinity)
+    if (cpu < 0 || cpu >= TOPO_MAX_CPUS) return false;
+    unsigned long mask[TOPO_MAX_CPUS / (8 * sizeof(unsigned long))] = {0};
+    mask[cpu / (8 * sizeof(unsigned long))] = 1UL << (cpu % (8 * sizeof(unsigned long)));
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+/**
+ * Parses a policy name (none, cores, threads), returns false if the name isn't one of them
+*/
+bool TOPO_policy_parse(const char* name, enum TOPO_Policy* policy){
+    if (strcmp(name, "none") == 0) *policy = TOPO_PIN_NONE;
+    else if (strcmp(name, "cores") == 0) *policy = TOPO_PIN_CORES;
+    else if (strcmp(name, "threads") == 0) *policy = TOPO_PIN_THREADS;
+    else return false;
+    return true;
+}
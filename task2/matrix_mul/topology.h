@@ -0,0 +1,64 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides definitions for reading the cpu layout (logical cpus, physical cores, sockets, NUMA nodes) from sysfs
+ * and for pinning threads to cpus
+ * 
+ * Only cpus that are online and in the process' affinity mask are considered (so taskset/cgroups are respected)
+ * Anywhere sysfs isn't around (or isn't linux) every cpu is treated as its own core on node 0 and pinning is a no-op
+ * 
+ * NOTE: There is no explicit NUMA allocation here, linux already puts a page on the node of the thread that first touches it
+ *       so pinned workers that allocate/write their own buffers (packing panels, product tiles) get local memory for free
+ * 
+*/ 
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// The most logical cpus we know about (cpu ids at or above this are ignored)
+#define TOPO_MAX_CPUS 1024
+#define _TOPO_SYSFS_CPU "/sys/devices/system/cpu"
+#define _TOPO_SYSFS_NODE "/sys/devices/system/node"
+
+enum TOPO_Policy{
+    TOPO_PIN_NONE, // Don't pin, let the scheduler move threads around (one thread per logical cpu)
+    TOPO_PIN_CORES, // One thread per physical core (SMT siblings are left alone)
+    TOPO_PIN_THREADS, // One thread per logical cpu (all the physical cores get a thread before any SMT sibling does)
+};
+
+struct TOPO_Cpu{
+    int cpu; // The logical cpu id (what the kernel calls cpuN)
+    int core; // core_id (only unique within a package)
+    int package; // physical_package_id (the socket)
+    int node; // The NUMA node the cpu belongs to
+    int smt_index; // 0 for the first logical cpu of a physical core, 1 for its sibling and so on
+};
+
+struct Topology{
+    struct TOPO_Cpu* cpus; // Every usable logical cpu, sorted by (node, package, core, smt_index)
+    int cpu_count; // Number of usable logical cpus
+    int core_count; // Number of usable physical cores
+    int node_count; // Number of NUMA nodes with at least one usable cpu
+};
+
+struct Topology* TOPO_detect();
+void TOPO_free(struct Topology* topology);
+int TOPO_plan(struct Topology* topology, enum TOPO_Policy policy, int thread_count, int* cpus);
+int TOPO_auto_thread_count(struct Topology* topology, enum TOPO_Policy policy);
+bool TOPO_pin_current_thread(int cpu);
+bool TOPO_policy_parse(const char* name, enum TOPO_Policy* policy);
+int _TOPO_read_int(const char* path, int fallback);
+int _TOPO_parse_list(const char* path, bool* set);
+int _TOPO_affinity(bool* set);
+int _TOPO_compare_cpus(const void* a, const void* b);
+
+#include "topology.c"
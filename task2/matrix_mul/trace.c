@@ -0,0 +1,119 @@
+#include "trace.h"
+
+bool TRACE_enabled = false;
+
+static const char* _TRACE_path = NULL; // Where TRACE_flush writes the trace
+static long long int _TRACE_origin = 0; // TRACE_now when tracing was enabled (the trace starts at 0 from there)
+
+// The calling thread's label (set by TRACE_set_label) and ring buffer (NULL until it first records something)
+static _Thread_local int _TRACE_label = -1;
+static _Thread_local struct TRACE_Thread* _TRACE_current = NULL;
+// Every thread that has recorded something (only touched under _TRACE_mutex)
+static struct TRACE_Thread* _TRACE_threads = NULL;
+static int _TRACE_thread_count = 0;
+static pthread_mutex_t _TRACE_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Starts recording spans on every thread, TRACE_flush writes them to path
+ * NOTE: Call this before spawning any threads that should be traced
+*/
+void TRACE_enable(const char* path){
+    _TRACE_path = path;
+    _TRACE_origin = TRACE_now();
+    TRACE_enabled = true;
+}
+
+/**
+ * Sets what the calling thread is called in the trace (a worker id, -1 being the main thread)
+ * NOTE: Only has an effect before the thread records its first span
+*/
+void TRACE_set_label(int label){
+    _TRACE_label = label;
+}
+
+/**
+ * Gets the time to start a span at in ns (monotonic), 0 if tracing is off
+*/
+long long int TRACE_now(){
+    if (!TRACE_enabled) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((long long)ts.tv_sec)*1000000000)+ts.tv_nsec;
+}
+
+/**
+ * Gets the calling thread's ring buffer, allocating and registering it the first time
+ * RAISES: Exits if could not allocate memory
+*/
+struct TRACE_Thread* _TRACE_thread(){
+    if (_TRACE_current != NULL) return _TRACE_current;
+
+    struct TRACE_Thread* thread = malloc(sizeof(struct TRACE_Thread));
+    struct TRACE_Span* spans = malloc(TRACE_RING_CAPACITY * sizeof(struct TRACE_Span));
+    if (thread == NULL || spans == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for the trace\n");
+        exit(1);
+    }
+    thread->label = _TRACE_label;
+    thread->spans = spans;
+    thread->count = 0;
+
+    pthread_mutex_lock(&_TRACE_mutex);
+    thread->tid = _TRACE_thread_count++;
+    thread->next = _TRACE_threads;
+    _TRACE_threads = thread;
+    pthread_mutex_unlock(&_TRACE_mutex);
+
+    _TRACE_current = thread;
+    return thread;
+}
+
+/**
+ * Records a span called name on the calling thread, from start (a TRACE_now) till now
+*/
+void TRACE_span(const char* name, long long int start){
+    if (!TRACE_enabled) return;
+    long long int end = TRACE_now();
+    struct TRACE_Thread* thread = _TRACE_thread();
+    struct TRACE_Span* span = &thread->spans[thread->count++ % TRACE_RING_CAPACITY];
+    span->name = name;
+    span->start = start;
+    span->end = end;
+}
+
+/**
+ * Writes every thread's spans to the path given to TRACE_enable (as Chrome trace_event json, times in us)
+ * NOTE: Only call this while no other thread is recording (e.g. after the worker threads have been joined)
+ * NOTE: Rewrites the whole file every time, so calling it again (for another pool) just adds to it
+ * RAISES: Exits if the trace could not be written
+*/
+void TRACE_flush(){
+    if (!TRACE_enabled) return;
+    FILE* file = fopen(_TRACE_path, "w");
+    if (file == NULL){
+        fprintf(stderr, "ERROR! Could not create trace `%s`\n", _TRACE_path);
+        exit(1);
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    bool first = true;
+    pthread_mutex_lock(&_TRACE_mutex);
+    for (struct TRACE_Thread* thread = _TRACE_threads; thread != NULL; thread = thread->next){
+        char name[32];
+        if (thread->label < 0) snprintf(name, sizeof(name), "main");
+        else snprintf(name, sizeof(name), "worker %d", thread->label);
+        fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", first? "" : ",", thread->tid, name);
+        fprintf(file, ",\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"sort_index\": %d}}", thread->tid, thread->label);
+        first = false;
+
+        long long int oldest = (thread->count > TRACE_RING_CAPACITY)? thread->count - TRACE_RING_CAPACITY : 0;
+        for (long long int i = oldest; i < thread->count; ++i){
+            struct TRACE_Span* span = &thread->spans[i % TRACE_RING_CAPACITY];
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                span->name, thread->tid, (span->start - _TRACE_origin) / 1e3, (span->end - span->start) / 1e3);
+        }
+    }
+    pthread_mutex_unlock(&_TRACE_mutex);
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
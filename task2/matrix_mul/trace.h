@@ -0,0 +1,48 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ *
+ * Provides an optional timeline of what every thread was doing, written out as Chrome trace_event json
+ * (open it in chrome://tracing or https://ui.perfetto.dev)
+ *
+ * Every thread records spans (a name, when it started and when it ended) into its own ring buffer, so recording never
+ * takes a lock or allocates (only the first span of a thread allocates its buffer). TRACE_flush (called by WP_join) writes
+ * every thread's spans out, if a thread recorded more than TRACE_RING_CAPACITY spans only the latest ones are kept
+ * NOTE: Spans are only recorded once TRACE_enable has been called, before that TRACE_now/TRACE_span cost a branch
+ *
+*/
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+// Spans kept per thread (older ones get overwritten)
+#define TRACE_RING_CAPACITY (1 << 16)
+
+struct TRACE_Span{
+    const char* name; // NOTE: Must be a string literal (or otherwise live till the flush)
+    long long int start; // ns (TRACE_now)
+    long long int end; // ns (TRACE_now)
+};
+
+struct TRACE_Thread{
+    int tid; // Thread id in the trace (in the order the threads first recorded something)
+    int label; // What the thread is named in the trace (the worker id, -1 for the main thread)
+    struct TRACE_Span* spans; // Ring buffer of TRACE_RING_CAPACITY spans
+    long long int count; // Spans recorded so far (the latest is at (count - 1) % TRACE_RING_CAPACITY)
+    struct TRACE_Thread* next; // The next registered thread
+};
+
+extern bool TRACE_enabled; // Nothing is recorded unless this is set (see TRACE_enable)
+
+void TRACE_enable(const char* path);
+void TRACE_set_label(int label);
+long long int TRACE_now();
+void TRACE_span(const char* name, long long int start);
+void TRACE_flush();
+struct TRACE_Thread* _TRACE_thread();
+
+#include "trace.c"
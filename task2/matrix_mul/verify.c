@@ -0,0 +1,109 @@
+#include "verify.h"
+
+/**
+ * Checks whether products of this dtype are verified exactly (integers) or with a tolerance (floating point)
+*/
+bool VERIFY_is_exact(enum MATRIX_DType dtype){
+    return dtype == MATRIX_INT32 || dtype == MATRIX_INT64;
+}
+
+/**
+ * Gets an (integer) element as an unsigned 64 bit number (sign extended, so that arithmetic modulo 2^64 matches the dtype's)
+*/
+inline uint64_t _VERIFY_load_exact(struct Matrix* matrix, long long int idx){
+    switch (matrix->dtype){
+    case MATRIX_INT32: return (uint64_t)(long long int)((int*)matrix->data)[idx];
+    case MATRIX_INT64: return (uint64_t)((long long int*)matrix->data)[idx];
+    default: return 0;
+    }
+}
+
+/**
+ * Gets an element as a double
+*/
+inline double _VERIFY_load_value(struct Matrix* matrix, long long int idx){
+    switch (matrix->dtype){
+#define _VERIFY_LOAD_CASE(tag, type, suffix, fmt, name) case tag: return (double)((type*)matrix->data)[idx];
+    MATRIX_DTYPES(_VERIFY_LOAD_CASE)
+    default: return 0;
+    }
+}
+
+/**
+ * Gets r[j] for floating point checks (small integers, so that B * r doesn't add any rounding of its own)
+ * NOTE: Integer checks use the full 64 bit RNG_at(seed, j) instead
+*/
+inline double _VERIFY_r(uint64_t seed, long long int j){
+    return (double)((int)(RNG_at(seed, j) % 11) - 5);
+}
+
+/**
+ * Computes rows [row_start, row_end) of B * r (r is the vector generated from seed) into entries[row_start:row_end]
+*/
+void VERIFY_prepare(struct Matrix* operand_b, uint64_t seed, long long int row_start, long long int row_end, struct VERIFY_Entry* entries){
+    bool exact = VERIFY_is_exact(operand_b->dtype);
+    for (long long int k = row_start; k < row_end; ++k){
+        struct VERIFY_Entry entry = {0, 0, 0};
+        for (long long int j = 0; j < operand_b->cols; ++j){
+            long long int idx = MATRIX_idx(k, j, operand_b);
+            if (exact){
+                entry.exact += _VERIFY_load_exact(operand_b, idx) * RNG_at(seed, j);
+            } else{
+                double b = _VERIFY_load_value(operand_b, idx), r = _VERIFY_r(seed, j);
+                entry.value += b * r;
+                entry.bound += fabs(b) * fabs(r);
+            }
+        }
+        entries[k] = entry;
+    }
+}
+
+/**
+ * Compares rows [row_start, row_end) of A * (B * r) with C * r (entries must hold all of B * r, see VERIFY_prepare)
+ * Returns false if any row differs (by more than the tolerance for floating point dtypes)
+*/
+bool VERIFY_check(struct Matrix* operand_a, struct Matrix* product, uint64_t seed, long long int row_start, long long int row_end, const struct VERIFY_Entry* entries){
+    if (VERIFY_is_exact(product->dtype)){
+        int bits = 8 * MATRIX_dtype_size(product->dtype);
+        uint64_t mask = (bits >= 64)? ~0ULL : ((1ULL << bits) - 1);
+
+        for (long long int i = row_start; i < row_end; ++i){
+            uint64_t expected = 0, got = 0;
+            for (long long int k = 0; k < operand_a->cols; ++k) expected += _VERIFY_load_exact(operand_a, MATRIX_idx(i, k, operand_a)) * entries[k].exact;
+            for (long long int j = 0; j < product->cols; ++j) got += _VERIFY_load_exact(product, MATRIX_idx(i, j, product)) * RNG_at(seed, j);
+            if ((expected & mask) != (got & mask)) return false;
+        }
+        return true;
+    }
+
+    // Every element of C is a K term dot product computed in the dtype, so it is off by at most ~K * eps * sum(|A| * |B|)
+    double eps = (product->dtype == MATRIX_FLOAT)? FLT_EPSILON : DBL_EPSILON;
+    for (long long int i = row_start; i < row_end; ++i){
+        double expected = 0, got = 0, bound = 0;
+        for (long long int k = 0; k < operand_a->cols; ++k){
+            double a = _VERIFY_load_value(operand_a, MATRIX_idx(i, k, operand_a));
+            expected += a * entries[k].value;
+            bound += fabs(a) * entries[k].bound;
+        }
+        for (long long int j = 0; j < product->cols; ++j) got += _VERIFY_load_value(product, MATRIX_idx(i, j, product)) * _VERIFY_r(seed, j);
+        if (fabs(expected - got) > VERIFY_TOLERANCE_FACTOR * (operand_a->cols + 2) * eps * bound) return false;
+    }
+    return true;
+}
+
+/**
+ * Runs one round of Freivalds' check on a whole product (single threaded)
+ * Returns false if the product is wrong
+ * RAISES: Exits if could not allocate memory
+*/
+bool VERIFY_product(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, uint64_t seed){
+    struct VERIFY_Entry* entries = malloc(operand_b->rows * sizeof(struct VERIFY_Entry));
+    if (entries == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for verification\n");
+        exit(1);
+    }
+    VERIFY_prepare(operand_b, seed, 0, operand_b->rows, entries);
+    bool ok = VERIFY_check(operand_a, product, seed, 0, product->rows, entries);
+    free(entries);
+    return ok;
+}
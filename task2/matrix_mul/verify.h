@@ -0,0 +1,45 @@
+/**
+ * EE23B135 Kaushik G Iyer
+ * 17/10/2026
+ * 
+ * Provides Freivalds' check for products (is C really A * B?) in O(N^2) instead of recomputing A * B in O(N^3)
+ * 
+ * Pick a random vector r and compare A * (B * r) with C * r, a wrong C gets caught with high probability
+ * (run more rounds with fresh vectors to make a miss even less likely)
+ *  - Integer dtypes are checked exactly: everything is done modulo 2^64 and only the dtype's own bits are compared
+ *    (so products that wrapped around in int32 still check out, just like the kernel computed them)
+ *  - Floating point dtypes are compared with a tolerance derived from the usual error bound of a K term dot product
+ * 
+ * The work is split in two phases so that it can be spread over threads: VERIFY_prepare computes B * r a block of rows
+ * at a time, and once all of it is done VERIFY_check compares a block of rows of A * (B * r) with C * r
+ * 
+*/ 
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include "matrix.h"
+#include "rng.h"
+
+// The float tolerance is this many times the worst case rounding error (so that we don't flag perfectly fine products)
+#define VERIFY_TOLERANCE_FACTOR 4
+
+struct VERIFY_Entry{
+    uint64_t exact; // Row of B * r modulo 2^64 (integer dtypes)
+    double value; // Row of B * r (floating point dtypes)
+    double bound; // Row of |B| * |r| (floating point dtypes, scales the tolerance)
+};
+
+bool VERIFY_is_exact(enum MATRIX_DType dtype);
+void VERIFY_prepare(struct Matrix* operand_b, uint64_t seed, long long int row_start, long long int row_end, struct VERIFY_Entry* entries);
+bool VERIFY_check(struct Matrix* operand_a, struct Matrix* product, uint64_t seed, long long int row_start, long long int row_end, const struct VERIFY_Entry* entries);
+bool VERIFY_product(struct Matrix* operand_a, struct Matrix* operand_b, struct Matrix* product, uint64_t seed);
+uint64_t _VERIFY_load_exact(struct Matrix* matrix, long long int idx);
+double _VERIFY_load_value(struct Matrix* matrix, long long int idx);
+double _VERIFY_r(uint64_t seed, long long int j);
+
+#include "verify.c"
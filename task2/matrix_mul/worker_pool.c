@@ -1,31 +1,75 @@
 #include "worker_pool.h"
 
+// The worker the current thread is (NULL if this thread is not part of a pool)
+static _Thread_local struct WP_Worker* _WP_current_worker = NULL;
+
+/**
+ * Runs the task held in a slot
+*/
+inline void _WP_execute(void (*func)(void *), struct WP_TaskSlot* slot){
+    if (slot->task_type == WP_EXEC_HEAP){
+        void* task; memcpy(&task, slot->task, sizeof(void*));
+        func(task);
+        free(task);
+    } else{
+        func(slot->task);
+    }
+}
+
+/**
+ * Counts down a latch, waking up everyone waiting on it if it hit 0
+ * NOTE: The final count down happens under the mutex since a waiter is free to destroy the latch the moment it sees 0
+*/
+void _WP_latch_arrive(struct WP_Latch* latch){
+    long long int count = atomic_load_explicit(&latch->count, memory_order_relaxed);
+    while (count > 1){ // Common case, someone else will be the last one
+        if (atomic_compare_exchange_weak_explicit(&latch->count, &count, count - 1, memory_order_release, memory_order_relaxed)) return;
+    }
+
+    pthread_mutex_lock(&latch->mutex);
+    if (atomic_fetch_sub_explicit(&latch->count, 1, memory_order_acq_rel) == 1) pthread_cond_broadcast(&latch->cond);
+    pthread_mutex_unlock(&latch->mutex);
+}
+
+/**
+ * Book keeping once a task is done: its group (if any) first, then the pool wide count
+ * NOTE: Call this after the queue/deque counters are updated so that the pool looks fully idle once WP_wait_idle returns
+*/
+void _WP_finish(struct WorkerPool* worker_pool, struct WP_TaskSlot* slot){
+    if (slot->latch != NULL) _WP_latch_arrive(slot->latch);
+    _WP_latch_arrive(&worker_pool->idle);
+}
+
 /**
  * The worker function
 */
 void* _WP_run_helper_function(void* varg){
-    struct WP_Argument* arg = varg;
+    struct WP_Worker* self = varg;
+    struct WP_Argument* arg = self->pool->arg;
     struct Queue* queue = arg->queue;
     void (*func)(void *) = arg->func;
+    _WP_current_worker = self;
+    TRACE_set_label(self->id);
+    if (self->cpu >= 0) TOPO_pin_current_thread(self->cpu); // Before touching any memory, so that whatever we allocate lands on our node
     
     while (true){
-        struct WP_TaskWrapper* tw = QUEUE_get(queue); // NOTE: This is blocking
-        switch (tw->task_type)
+        struct WP_TaskSlot slot;
+        QUEUE_take(queue, &slot); // NOTE: This is blocking
+        switch (slot.task_type)
         {
         case WP_KILL:
-            free(tw);
             QUEUE_register_completion(queue);
             return NULL;
         
         case WP_EXEC:
-            func(tw->task);
-            free(tw->task);
-            free(tw);
+        case WP_EXEC_HEAP:
+            _WP_execute(func, &slot);
             QUEUE_register_completion(queue);
+            _WP_finish(arg->pool, &slot);
             break;
         
         default:
-            fprintf(stderr, "UNREACHABLE! Unexpected task_type %d\n", tw->task_type);
+            fprintf(stderr, "UNREACHABLE! Unexpected task_type %d\n", slot.task_type);
             exit(1);
             break;
         }
@@ -33,10 +77,120 @@ void* _WP_run_helper_function(void* varg){
 }
 
 /**
- * Creates the worker pool and spawns threads for each worker
+ * Looks for a task: own deque first (newest first), then own inbox, then steals from everyone else
+ * *source is set to the inbox the task came from (NULL if it came from a deque)
+ * Returns false if nothing was found after _WP_STEAL_ROUNDS rounds
+*/
+bool _WP_find_task(struct WP_Worker* self, struct WP_TaskSlot* slot, struct Queue** source){
+    struct WorkerPool* pool = self->pool;
+    *source = NULL;
+    if (DEQUE_pop(&self->deque, slot)) return true;
+    
+    if (QUEUE_try_take(self->inbox, slot)){
+        *source = self->inbox;
+        return true;
+    }
+
+    for (int round = 0; round < _WP_STEAL_ROUNDS; ++round){
+        if (atomic_load_explicit(&pool->pending, memory_order_relaxed) == 0) return false; // Nothing anywhere, don't bother
+
+        // Start at a random victim so that thieves spread out instead of all hammering worker 0
+        self->rng ^= self->rng << 13; self->rng ^= self->rng >> 17; self->rng ^= self->rng << 5;
+        int start = self->rng % pool->thread_count;
+        for (int i = 0; i < pool->thread_count; ++i){
+            struct WP_Worker* victim = &pool->workers[(start + i) % pool->thread_count];
+            if (victim == self) continue;
+
+            enum DEQUE_StealResult result;
+            while ((result = DEQUE_steal(&victim->deque, slot)) == DEQUE_ABORT);
+            if (result == DEQUE_STOLEN) return true;
+
+            if (QUEUE_try_take(victim->inbox, slot)){
+                *source = victim->inbox;
+                return true;
+            }
+        }
+        _QUEUE_relax();
+    }
+    return false;
+}
+
+/**
+ * Puts the calling worker to sleep till there is something to do
+ * Returns false if the pool is stopping and there is nothing left to do (the worker should exit)
+*/
+bool _WP_park(struct WorkerPool* worker_pool){
+    pthread_mutex_lock(&worker_pool->park_mutex);
+    atomic_fetch_add_explicit(&worker_pool->parked, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst); // Pairs with the fence in _WP_push_slot (so we never miss a wake up)
+    while (atomic_load(&worker_pool->pending) == 0 && !atomic_load(&worker_pool->stopping)){
+        pthread_cond_wait(&worker_pool->work_cond, &worker_pool->park_mutex);
+    }
+    atomic_fetch_sub_explicit(&worker_pool->parked, 1, memory_order_relaxed);
+    bool keep_going = atomic_load(&worker_pool->pending) != 0 || !atomic_load(&worker_pool->stopping);
+    pthread_mutex_unlock(&worker_pool->park_mutex);
+    return keep_going;
+}
+
+/**
+ * The worker function (WP_WORK_STEALING)
+*/
+void* _WP_steal_helper_function(void* varg){
+    struct WP_Worker* self = varg;
+    struct WorkerPool* pool = self->pool;
+    void (*func)(void *) = pool->arg->func;
+    _WP_current_worker = self;
+    TRACE_set_label(self->id);
+    if (self->cpu >= 0) TOPO_pin_current_thread(self->cpu); // Before touching any memory, so that whatever we allocate lands on our node
+
+    long long int idle_start = 0; // When we last ran out of work (for the trace, 0 while busy)
+    while (true){
+        struct Queue* source;
+        struct WP_TaskSlot slot;
+        if (!_WP_find_task(self, &slot, &source)){
+            if (idle_start == 0) idle_start = TRACE_now();
+            if (!_WP_park(pool)) return NULL;
+            continue;
+        }
+        if (idle_start != 0) TRACE_span("idle (stealing/parked)", idle_start);
+        idle_start = 0;
+        // NOTE: dispatched goes up before pending goes down so that pending + dispatched never reads 0 while a task is in flight
+        atomic_fetch_add(&pool->dispatched, 1);
+        atomic_fetch_sub(&pool->pending, 1);
+
+        _WP_execute(func, &slot);
+
+        if (source != NULL) QUEUE_register_completion(source);
+        atomic_fetch_sub(&pool->dispatched, 1);
+        _WP_finish(pool, &slot);
+    }
+}
+
+/**
+ * Creates the worker pool (with a single shared queue) and spawns threads for each worker
  * RAISES: Exits if could not allocate memory
 */
 struct WorkerPool* WP_create(void (*func)(void *), int thread_count){
+    return WP_create_mode(func, thread_count, WP_SHARED_QUEUE);
+}
+
+/**
+ * Creates the worker pool with the given scheduling mode and spawns (unpinned) threads for each worker
+ * RAISES: Exits if could not allocate memory
+*/
+struct WorkerPool* WP_create_mode(void (*func)(void *), int thread_count, enum WP_Mode mode){
+    return WP_create_pinned(func, thread_count, mode, NULL, 0);
+}
+
+/**
+ * Creates the worker pool with the given scheduling mode and spawns threads for each worker
+ * Worker i is pinned to cpus[i] (pass NULL, or -1 for a worker, to leave it unpinned). TOPO_plan fills cpus in for you
+ * queue_capacity is the number of slots in the shared queue (WP_SHARED_QUEUE) or in each inbox (WP_WORK_STEALING), 0 for the defaults
+ * NOTE: queue_capacity must be a power of 2 >= 2 (or 0)
+ * NOTE: Pinning is best effort, if the os says no the worker just runs unpinned
+ * RAISES: Exits if could not allocate memory
+*/
+struct WorkerPool* WP_create_pinned(void (*func)(void *), int thread_count, enum WP_Mode mode, const int* cpus, size_t queue_capacity){
     struct WorkerPool* wp = malloc(sizeof(struct WorkerPool));
     if (wp == NULL){
         fprintf(stderr, "ERROR! Could not allocate memory for WorkerPool\n");
@@ -56,33 +210,169 @@ struct WorkerPool* WP_create(void (*func)(void *), int thread_count){
         exit(1);
     }
 
-    wp->arg->queue = QUEUE_create();
+    wp->mode = mode;
+    wp->arg->queue = (mode == WP_SHARED_QUEUE)? QUEUE_create_sized(sizeof(struct WP_TaskSlot), (queue_capacity > 0)? queue_capacity : _QUEUE_CAPACITY) : NULL;
     wp->arg->func = func;
+    wp->arg->pool = wp;
+    WP_latch_init(&wp->idle);
 
+    wp->workers = malloc(wp->thread_count * sizeof(struct WP_Worker));
+    if (wp->workers == NULL){
+        fprintf(stderr, "ERROR! Could not allocate memory for WorkerPool\n");
+        exit(1);
+    }
+    for (int i = 0; i < wp->thread_count; ++i){
+        wp->workers[i].pool = wp;
+        wp->workers[i].id = i;
+        wp->workers[i].cpu = (cpus == NULL)? -1 : cpus[i];
+    }
+
+    if (mode == WP_WORK_STEALING){
+        for (int i = 0; i < wp->thread_count; ++i){
+            wp->workers[i].rng = 2654435761u * (i + 1); // Any non zero seed works for xorshift
+            wp->workers[i].inbox = QUEUE_create_sized(sizeof(struct WP_TaskSlot), (queue_capacity > 0)? queue_capacity : _WP_INBOX_CAPACITY);
+            DEQUE_init(&wp->workers[i].deque, sizeof(struct WP_TaskSlot));
+        }
+        atomic_init(&wp->next_inbox, 0);
+        atomic_init(&wp->pending, 0);
+        atomic_init(&wp->dispatched, 0);
+        atomic_init(&wp->parked, 0);
+        atomic_init(&wp->stopping, false);
+        pthread_mutex_init(&wp->park_mutex, NULL);
+        pthread_cond_init(&wp->work_cond, NULL);
+    }
 
     for (int i = 0; i < wp->thread_count; ++i){
-        pthread_create(&wp->threads[i], NULL, _WP_run_helper_function, (void*)wp->arg);
+        if (mode == WP_WORK_STEALING) pthread_create(&wp->threads[i], NULL, _WP_steal_helper_function, (void*)&wp->workers[i]);
+        else pthread_create(&wp->threads[i], NULL, _WP_run_helper_function, (void*)&wp->workers[i]);
     }
 
     return wp;
 }
 
+/**
+ * Hands a filled in slot to the workers
+ * In WP_WORK_STEALING mode tasks submitted from inside a task go on the calling worker's own deque, everything else is spread over the inboxes
+ * NOTE: If the queue is already at its maximum capacity, waits until space is made then adds the task
+ * NOTE: A worker never waits though (if every worker did, nothing would ever make space), if its deque is full it runs the task
+ *       right away instead
+*/
+void _WP_push_slot(struct WorkerPool* worker_pool, struct WP_TaskSlot* slot){
+    atomic_fetch_add_explicit(&worker_pool->idle.count, 1, memory_order_relaxed);
+    if (worker_pool->mode == WP_SHARED_QUEUE){
+        QUEUE_put(worker_pool->arg->queue, slot); // NOTE: This is blocking
+        return;
+    }
+
+    atomic_fetch_add(&worker_pool->pending, 1);
+
+    struct WP_Worker* self = _WP_current_worker;
+    if (self != NULL && self->pool == worker_pool){ // Submitted from inside a task, keep it close
+        if (!DEQUE_push(&self->deque, slot)){ // Deque is full, do it ourselves (it still counts towards its latch and idle)
+            atomic_fetch_sub(&worker_pool->pending, 1);
+            _WP_execute(worker_pool->arg->func, slot);
+            _WP_finish(worker_pool, slot);
+            return;
+        }
+    } else{
+        unsigned int idx = atomic_fetch_add_explicit(&worker_pool->next_inbox, 1, memory_order_relaxed) % worker_pool->thread_count;
+        QUEUE_put(worker_pool->workers[idx].inbox, slot); // NOTE: This is blocking
+    }
+
+    atomic_thread_fence(memory_order_seq_cst); // Pairs with the fence in _WP_park
+    if (atomic_load_explicit(&worker_pool->parked, memory_order_relaxed) > 0){
+        pthread_mutex_lock(&worker_pool->park_mutex);
+        pthread_cond_signal(&worker_pool->work_cond);
+        pthread_mutex_unlock(&worker_pool->park_mutex);
+    }
+}
+
+/**
+ * Copies a task (of `size` bytes) into the pool, the worker gets a pointer to its own copy
+ * NOTE: This never allocates, so the task must fit in WP_TASK_SIZE bytes
+ * NOTE: If the queue is already at its maximum capacity, waits until space is made then adds the task
+ * RAISES: Exits if the task is too big
+*/
+void WP_submit(struct WorkerPool* worker_pool, const void* task, size_t size){
+    WP_submit_to(worker_pool, task, size, NULL);
+}
+
+/**
+ * Same as WP_submit, but the task is also counted in latch (so WP_latch_wait(latch) returns once it and the rest of the group are done)
+ * NOTE: The latch must outlive the task (so wait on it before destroying it)
+ * RAISES: Exits if the task is too big
+*/
+void WP_submit_to(struct WorkerPool* worker_pool, const void* task, size_t size, struct WP_Latch* latch){
+    if (size > WP_TASK_SIZE){
+        fprintf(stderr, "ERROR! Task of %zu bytes does not fit in a slot (WP_TASK_SIZE is %d)\n", size, WP_TASK_SIZE);
+        exit(1);
+    }
+    struct WP_TaskSlot slot;
+    slot.task_type = WP_EXEC;
+    slot.latch = latch;
+    if (latch != NULL) atomic_fetch_add_explicit(&latch->count, 1, memory_order_relaxed);
+    memcpy(slot.task, task, size);
+    _WP_push_slot(worker_pool, &slot);
+}
+
 /**
  * Adds a task to the queue
- * NOTE: The task must be a pointer to some malloced memory (since free will be called on it)
+ * NOTE: The task must be a pointer to some malloced memory (since free will be called on it), prefer WP_submit
  * NOTE: If the queue is already at its maximum capacity, waits until space is made then adds the task
- * RAISES: Exits if could not allocate memory for wrapper
 */
 void WP_enqueue_task(struct WorkerPool* worker_pool, void* task){
-    struct WP_TaskWrapper* tw = malloc(sizeof(struct WP_TaskWrapper));
-    if (tw == NULL){
-        fprintf(stderr, "ERROR! Could not allocate memory for task wrapper\n");
-        exit(1);
+    struct WP_TaskSlot slot = {.task_type = WP_EXEC_HEAP};
+    memcpy(slot.task, &task, sizeof(void*));
+    _WP_push_slot(worker_pool, &slot);
+}
+
+/**
+ * Blocks till every task submitted so far (including the ones those tasks submit) is done
+ * Unlike WP_request_stop + WP_join the threads stay alive, so the pool can be reused for the next batch
+ * NOTE: Don't call this from inside a task (it would be waiting on itself)
+*/
+void WP_wait_idle(struct WorkerPool* worker_pool){
+    long long int start = TRACE_now();
+    WP_latch_wait(&worker_pool->idle);
+    TRACE_span("WP_wait_idle", start);
+}
+
+/**
+ * Sets up an empty latch (a completion handle for a group of tasks)
+*/
+void WP_latch_init(struct WP_Latch* latch){
+    atomic_init(&latch->count, 0);
+    pthread_mutex_init(&latch->mutex, NULL);
+    pthread_cond_init(&latch->cond, NULL);
+}
+
+/**
+ * Cleans up a latch
+ * NOTE: WP_latch_wait on it first, there must not be any tasks left that count it down
+*/
+void WP_latch_destroy(struct WP_Latch* latch){
+    pthread_mutex_destroy(&latch->mutex);
+    pthread_cond_destroy(&latch->cond);
+}
+
+/**
+ * Blocks till every task submitted with this latch is done
+ * NOTE: The latch can be reused for another group once this returns
+*/
+void WP_latch_wait(struct WP_Latch* latch){
+    pthread_mutex_lock(&latch->mutex);
+    while (atomic_load_explicit(&latch->count, memory_order_acquire) != 0){
+        pthread_cond_wait(&latch->cond, &latch->mutex);
     }
-    tw->task = task;
-    tw->task_type = WP_EXEC;
+    pthread_mutex_unlock(&latch->mutex);
+}
 
-    QUEUE_add(worker_pool->arg->queue, tw); // NOTE: This is blocking
+/**
+ * Checks (without blocking) whether every task submitted with this latch is done
+ * NOTE: Still WP_latch_wait before destroying the latch (the last task may still be on its way out)
+*/
+bool WP_latch_done(struct WP_Latch* latch){
+    return atomic_load_explicit(&latch->count, memory_order_acquire) == 0;
 }
 
 /**
@@ -90,36 +380,73 @@ void WP_enqueue_task(struct WorkerPool* worker_pool, void* task){
  * NOTE: This will not prevent you from enqueueing additional tasks (But it is idiotic to do so)
 */
 void WP_request_stop(struct WorkerPool* worker_pool){
-    for (int i = 0; i < worker_pool->thread_count; ++i){
-        struct WP_TaskWrapper* tw = malloc(sizeof(struct WP_TaskWrapper));
-        if (tw == NULL){
-            fprintf(stderr, "ERROR! Could not allocate memory for task wrapper\n");
-            exit(1);
-        }
-
-        tw->task = NULL;
-        tw->task_type = WP_KILL;
+    if (worker_pool->mode == WP_WORK_STEALING){
+        // Kill tasks could get stolen ahead of real work, so instead workers exit once they are out of work and see this flag
+        pthread_mutex_lock(&worker_pool->park_mutex);
+        atomic_store(&worker_pool->stopping, true);
+        pthread_cond_broadcast(&worker_pool->work_cond);
+        pthread_mutex_unlock(&worker_pool->park_mutex);
+        return;
+    }
 
-        QUEUE_add(worker_pool->arg->queue, tw); // NOTE: This is blocking
+    struct WP_TaskSlot slot = {.task_type = WP_KILL};
+    for (int i = 0; i < worker_pool->thread_count; ++i){
+        QUEUE_put(worker_pool->arg->queue, &slot); // NOTE: This is blocking
     }
 }
 
 /**
  * Joins all threads spawned
  * NOTE: You probably want to WP_request_stop before calling this
+ * NOTE: Also writes out the trace (see trace.h) if tracing is on
  * RAISES: You'll get random segfaults if the threads weren't created properly :)
 */
 void WP_join(struct WorkerPool* worker_pool){
     for (int i = 0; i < worker_pool->thread_count; ++i){
         pthread_join(worker_pool->threads[i], NULL);
     }
+    TRACE_flush(); // Every worker is done recording now (does nothing unless tracing)
+}
+
+/**
+ * Gets the id (0 to thread_count - 1) of the worker the calling thread is, or -1 if it isn't a worker thread
+*/
+int WP_current_worker_id(){
+    return (_WP_current_worker != NULL)? _WP_current_worker->id : -1;
+}
+
+/**
+ * Gets the number of tasks that have been enqueued but not picked up by a worker yet
+*/
+long long int WP_pending_tasks(struct WorkerPool* worker_pool){
+    if (worker_pool->mode == WP_WORK_STEALING) return atomic_load(&worker_pool->pending);
+    return QUEUE_pending(worker_pool->arg->queue);
+}
+
+/**
+ * Gets the number of tasks that are currently being worked on
+*/
+long long int WP_dispatched_tasks(struct WorkerPool* worker_pool){
+    if (worker_pool->mode == WP_WORK_STEALING) return atomic_load(&worker_pool->dispatched);
+    return atomic_load(&worker_pool->arg->queue->dispatched);
 }
 
 /**
  * Frees all memory associated with the worker pool
 */
 void WP_free(struct WorkerPool* worker_pool){
-    QUEUE_free(worker_pool->arg->queue);
+    if (worker_pool->mode == WP_WORK_STEALING){
+        for (int i = 0; i < worker_pool->thread_count; ++i){
+            QUEUE_free(worker_pool->workers[i].inbox);
+            DEQUE_destroy(&worker_pool->workers[i].deque);
+        }
+        pthread_mutex_destroy(&worker_pool->park_mutex);
+        pthread_cond_destroy(&worker_pool->work_cond);
+    } else{
+        QUEUE_free(worker_pool->arg->queue);
+    }
+    WP_latch_destroy(&worker_pool->idle);
+    free(worker_pool->workers);
     free(worker_pool->arg);
     free(worker_pool->threads);
     free(worker_pool);
@@ -4,6 +4,20 @@
  * 
  * Provides definitions for WorkerPool
  * 
+ * Two scheduling modes:
+ *  WP_SHARED_QUEUE: Every worker pulls from one shared Queue (what WP_create gives you)
+ *  WP_WORK_STEALING: Every worker owns a Chase-Lev deque (plus an inbox for tasks submitted from outside the pool),
+ *                    submissions are spread round robin over the inboxes and idle workers steal from the others
+ * 
+ * Tasks live inline in the queue/deque slots (WP_TaskSlot), so WP_submit never touches the heap.
+ * WP_enqueue_task is still around for tasks that are malloced by the caller (the pool frees them)
+ * 
+ * WP_create_pinned pins every worker to a cpu (see topology.h for picking them), the other constructors leave threads unpinned
+ * 
+ * The pool can be reused for any number of batches:
+ *  WP_wait_idle: Blocks till every task submitted so far is done (the threads stay alive)
+ *  WP_Latch: A completion handle for a group of tasks (submit them with WP_submit_to, then WP_latch_wait)
+ * 
 */ 
 
 
@@ -12,34 +26,100 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include "queue.h"
+#include "deque.h"
+#include "topology.h"
+
+// Number of full passes over every other worker an idle worker makes (looking for something to steal) before it goes to sleep
+#define _WP_STEAL_ROUNDS 64
+// The biggest task (in bytes) that can be handed to WP_submit
+#define WP_TASK_SIZE 128
+// Number of slots in each worker's inbox (WP_WORK_STEALING only, must be a power of 2 >= 2)
+#define _WP_INBOX_CAPACITY (1 << 10)
+
+enum WP_Mode{
+    WP_SHARED_QUEUE, // One queue shared by every worker
+    WP_WORK_STEALING, // A deque per worker, idle workers steal
+};
 
 struct WP_Argument{
+    struct WorkerPool* pool; // The pool the worker belongs to
     struct Queue* queue; // The queue of tasks that the WorkerPool is to do
     void (*func)(void *); // The function that operates on each task
 };
 
+struct WP_Latch{
+    atomic_llong count; // Number of tasks in the group that are not done yet
+    pthread_mutex_t mutex; // Taken by waiters and by whoever brings count down to 0
+    pthread_cond_t cond; // Signal that is sent when count hits 0
+};
+
 enum WP_TaskType{
-    WP_EXEC, // Requests the worker to finish a task
+    WP_EXEC, // Requests the worker to finish a task (stored inline in the slot)
+    WP_EXEC_HEAP, // Requests the worker to finish a task (the slot holds a pointer to malloced memory that is freed after)
     WP_KILL, // Notifies the worker to just kill itself
 };
 
-struct WP_TaskWrapper{
-    void* task; // The task to be accomplished
+struct WP_TaskSlot{
     enum WP_TaskType task_type; // I'm bored
+    struct WP_Latch* latch; // Counted down once the task is done (NULL if the task isn't part of a group)
+    _Alignas(max_align_t) unsigned char task[WP_TASK_SIZE]; // The task to be accomplished (or a pointer to it for WP_EXEC_HEAP)
+};
+
+struct WP_Worker{
+    struct WorkerPool* pool; // The pool this worker belongs to
+    int id; // Index of the worker in the pool
+    int cpu; // The cpu the worker is pinned to (-1 if it isn't pinned)
+    struct Deque deque; // Tasks this worker submitted itself (others may steal from here)
+    struct Queue* inbox; // Tasks submitted to this worker from outside the pool (others may steal from here too)
+    unsigned int rng; // State for picking random victims
 };
 
 struct WorkerPool{
     pthread_t* threads; // An array of all pthreads spawned
     int thread_count; // A count of number of threads spawned
-    struct WP_Argument* arg; // Passed to each worker when their thread is spawned
+    enum WP_Mode mode; // How tasks are handed out
+    struct WP_Argument* arg; // Passed to each worker when their thread is spawned (the queue is only used in WP_SHARED_QUEUE)
+    struct WP_Latch idle; // Counts every task submitted but not finished yet, in both modes (WP_wait_idle waits on this)
+    struct WP_Worker* workers; // One per thread (the deque and inbox are only set up in WP_WORK_STEALING)
+
+    // WP_WORK_STEALING only
+    atomic_uint next_inbox; // Round robin counter for submissions from outside the pool
+    atomic_llong pending; // Number of tasks submitted but not yet picked up
+    atomic_llong dispatched; // Number of tasks that are currently being worked on
+    atomic_int parked; // Number of workers sleeping on work_cond
+    atomic_bool stopping; // Set by WP_request_stop
+    pthread_mutex_t park_mutex; // Only protects the sleeping
+    pthread_cond_t work_cond; // Signal that is sent when work is submitted (only if someone is parked)
 };
 
 void* _WP_run_helper_function(void* arg);
+void* _WP_steal_helper_function(void* arg);
+bool _WP_find_task(struct WP_Worker* self, struct WP_TaskSlot* slot, struct Queue** source);
+bool _WP_park(struct WorkerPool* worker_pool);
+void _WP_execute(void (*func)(void *), struct WP_TaskSlot* slot);
+void _WP_push_slot(struct WorkerPool* worker_pool, struct WP_TaskSlot* slot);
+void _WP_finish(struct WorkerPool* worker_pool, struct WP_TaskSlot* slot);
+void _WP_latch_arrive(struct WP_Latch* latch);
 struct WorkerPool* WP_create(void (*func)(void *), int thread_count);
+struct WorkerPool* WP_create_mode(void (*func)(void *), int thread_count, enum WP_Mode mode);
+struct WorkerPool* WP_create_pinned(void (*func)(void *), int thread_count, enum WP_Mode mode, const int* cpus, size_t queue_capacity);
+void WP_submit(struct WorkerPool* worker_pool, const void* task, size_t size);
+void WP_submit_to(struct WorkerPool* worker_pool, const void* task, size_t size, struct WP_Latch* latch);
 void WP_enqueue_task(struct WorkerPool* worker_pool, void* task);
+void WP_wait_idle(struct WorkerPool* worker_pool);
+void WP_latch_init(struct WP_Latch* latch);
+void WP_latch_destroy(struct WP_Latch* latch);
+void WP_latch_wait(struct WP_Latch* latch);
+bool WP_latch_done(struct WP_Latch* latch);
 void WP_request_stop(struct WorkerPool* worker_pool);
 void WP_join(struct WorkerPool* worker_pool);
 void WP_free(struct WorkerPool* worker_pool);
+long long int WP_pending_tasks(struct WorkerPool* worker_pool);
+long long int WP_dispatched_tasks(struct WorkerPool* worker_pool);
+int WP_current_worker_id();
 
-#include "worker_pool.c"
\ No newline at end of file
+#include "worker_pool.c"